@@ -0,0 +1,148 @@
+// Allocations and throughput of per-message work: parsing request Json and writing response Json.
+// Each case is measured in "heap" (plain nlohmann::json, as before arenas) and "arena" variants.
+// Malformed and adversarial messages compare the throwing MakeRequest with DecodeMessage used by the server
+
+#include "Arena.h"
+#include "ArenaJson.h"
+#include "Requests.h"
+#include "ResponseWriter.h"
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <exception>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+
+}  // namespace
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+constexpr int kIterations = 200000;
+
+const std::string kGetMessage = R"({"url": "http://httpbin.org", "path": "/get?name=value", "method": "GET",
+    "headers": {"Accept": "application/json", "User-Agent": "websockproxy-bench", "X-Request-Id": "0123456789abcdef"}})";
+
+const std::string kPostMessage = R"({"url": "http://httpbin.org", "path": "/post", "method": "POST",
+    "form_data": [
+        {"name": "name1", "content": "content1", "filename": "fname1", "content_type": "text/plain"},
+        {"name": "name2", "content": "content2", "content_type": "image/jpeg"}]})";
+
+// Valid Json, but not a request
+const std::string kWrongTypeMessage = R"({"url": "http://httpbin.org", "path": "/get", "method": 123})";
+const std::string kTruncatedMessage = kGetMessage.substr(0, kGetMessage.size() / 2);
+
+// Many levels of nesting, DecodeMessage stops reading at max_depth
+const std::string kDeepMessage = R"({"url": "http://httpbin.org", "method": "GET", "extra": )" +
+                                 std::string(100000, '[') + std::string(100000, ']') + "}";
+
+std::string ManyHeadersMessage(int count) {
+    std::string message = R"({"url": "http://httpbin.org", "method": "GET", "headers": {)";
+    for (int i = 0; i < count; ++i)
+        message += (i == 0 ? "" : ",") + ("\"X-Header-" + std::to_string(i) + "\": \"value\"");
+    return message + "}}";
+}
+
+const std::string kManyHeadersMessage = ManyHeadersMessage(10000);
+
+const std::string kResponseBody = R"({"args": {}, "headers": {"Accept": "application/json", "Host": "httpbin.org"},
+    "origin": "127.0.0.1", "url": "http://httpbin.org/get"})";
+
+void Run(const char* name, const std::function<void()>& body, int iterations = kIterations) {
+    body();  // Warm up thread-local buffers
+
+    const auto allocations = g_allocations.load();
+    const auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        body();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    const auto per_message = static_cast<double>(g_allocations.load() - allocations) / iterations;
+    std::printf("%-32s %8.1f allocs/msg %12.0f msg/s\n", name, per_message, iterations / elapsed);
+}
+
+// Throwing API, as the server used it before DecodeMessage
+size_t MakeRequestOrError(const std::string& message) {
+    try {
+        return MakeRequest(message).Url().size();
+    } catch (const std::exception& e) {
+        return std::strlen(e.what());
+    }
+}
+
+size_t DecodeOrError(const std::string& message) {
+    const auto decoded = DecodeMessage(message);
+    return decoded.message ? 1 : decoded.ErrorText().size();
+}
+
+}  // namespace
+
+int main() {
+    size_t sink = 0;
+
+    Run("GET parse, heap", [&] { sink += nlohmann::json::parse(kGetMessage).size(); });
+    Run("GET parse, arena", [&] {
+        ArenaScope scope;
+        sink += ArenaJson::parse(kGetMessage).size();
+    });
+    Run("GET MakeRequest", [&] { sink += MakeRequest(kGetMessage).Url().size(); });
+    Run("GET DecodeMessage", [&] { sink += DecodeOrError(kGetMessage); });
+
+    Run("POST parse, heap", [&] { sink += nlohmann::json::parse(kPostMessage).size(); });
+    Run("POST parse, arena", [&] {
+        ArenaScope scope;
+        sink += ArenaJson::parse(kPostMessage).size();
+    });
+    Run("POST MakeRequest", [&] { sink += MakeRequest(kPostMessage).Url().size(); });
+
+    Run("Wrong type, MakeRequest", [&] { sink += MakeRequestOrError(kWrongTypeMessage); });
+    Run("Wrong type, DecodeMessage", [&] { sink += DecodeOrError(kWrongTypeMessage); });
+    Run("Truncated, MakeRequest", [&] { sink += MakeRequestOrError(kTruncatedMessage); });
+    Run("Truncated, DecodeMessage", [&] { sink += DecodeOrError(kTruncatedMessage); });
+    Run("Deep nesting, parse", [&] {
+        ArenaScope scope;
+        sink += ArenaJson::parse(kDeepMessage, nullptr, false).size();
+    }, 100);
+    Run("Deep nesting, DecodeMessage", [&] { sink += DecodeOrError(kDeepMessage); }, 100);
+    Run("10000 headers, parse", [&] {
+        ArenaScope scope;
+        sink += ArenaJson::parse(kManyHeadersMessage).size();
+    }, 100);
+    Run("10000 headers, DecodeMessage", [&] { sink += DecodeOrError(kManyHeadersMessage); }, 100);
+
+    Run("Response, json.dump", [&] {
+        nlohmann::json json;
+        json["status"] = 200;
+        json["body"] = kResponseBody;
+        sink += json.dump().size();
+    });
+    Run("Response, WriteResponseJson", [&] { sink += WriteResponseJson(200, kResponseBody).size(); });
+
+    return sink == 0 ? 1 : 0;
+}
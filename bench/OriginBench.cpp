@@ -0,0 +1,68 @@
+// Cost of checking a request against origin rules, by number of rules: compiled OriginMatcher against
+// a linear scan of canonical origin keys (what a plain list lookup would do)
+
+#include "Origin.h"
+#include "OriginMatcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kIterations = 200000;
+
+// Rules alike real ones: exact hosts, subdomain wildcards and path prefixes over a number of domains
+std::vector<std::string> MakeRules(size_t count) {
+    std::vector<std::string> rules;
+    for (size_t i = 0; rules.size() < count; ++i) {
+        const auto domain = "service" + std::to_string(i) + ".example.com";
+        rules.push_back("https://" + domain);
+        rules.push_back("https://*." + domain);
+        rules.push_back("http://" + domain + ":8080/api/v" + std::to_string(i % 3));
+    }
+    rules.resize(count);
+    return rules;
+}
+
+void Run(const char* name, size_t rules, const std::function<bool()>& body) {
+    size_t allowed = 0;
+    const auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; ++i)
+        allowed += body();
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+    std::printf("%-24s %6zu rules %10.1f ns/check (%zu allowed)\n", name, rules, elapsed / kIterations, allowed);
+}
+
+}  // namespace
+
+int main() {
+    const std::string hit_url = "https://api.service1.example.com";
+    const std::string miss_url = "https://unknown.example.org";
+    const std::string path = "/api/v1/items?id=1";
+
+    for (const size_t count : {10, 1000, 10000}) {
+        const auto rules = MakeRules(count);
+
+        const auto started = std::chrono::steady_clock::now();
+        const OriginMatcher matcher(rules, {});
+        const auto compiled = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started);
+        std::printf("%-24s %6zu rules %10.2f ms\n", "compile", count, compiled.count());
+
+        Run("matcher, hit", count, [&] { return matcher.Allows(hit_url, path); });
+        Run("matcher, miss", count, [&] { return matcher.Allows(miss_url, path); });
+
+        // Baseline only knows exact origins
+        std::vector<std::string> keys;
+        for (const auto& rule : rules)
+            keys.push_back(ParseOrigin(rule.substr(0, rule.find('/', rule.find("://") + 3))).Key());
+        Run("linear scan, miss", count, [&] {
+            const auto key = ParseOrigin(miss_url).Key();
+            return std::find(begin(keys), end(keys), key) != end(keys);
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+// libFuzzer target over disk cache file loading. Input is the file after its header, so mutations go to records
+// rather than to the magic that has the whole file discarded. The cache is then appended to and compacted
+
+#include "DiskCache.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+namespace {
+
+// Unique per process, so parallel fuzzing jobs don't share the file
+const std::string& CachePath() {
+    static const auto path =
+        (std::filesystem::temp_directory_path() / ("websockproxy_fuzz_" + std::to_string(std::random_device{}()) +
+                                                   ".cache"))
+            .string();
+    return path;
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    {
+        std::ofstream file(CachePath(), std::ios::binary | std::ios::trunc);
+        // Same as DiskCache writes: magic, version 1, padding
+        const uint32_t version = 1;
+        char header[16] = "WSPCACHE";
+        std::memcpy(header + 8, &version, sizeof(version));
+        file.write(header, sizeof(header));
+        file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    }
+
+    DiskCacheConfig config;
+    config.enabled = true;
+    config.path = CachePath();
+    config.max_bytes = 4096;
+    config.max_entry_bytes = 1024;
+
+    // Epoch, so any expiry the fuzzer picks can be live
+    DiskCache cache(config, [] { return DiskCache::Clock::time_point(); });
+    Response response{200, std::string(512, 'b')};
+    for (int i = 0; i < 8; ++i) {
+        const auto key = "http://fuzz.example.com/" + std::to_string(i);
+        if (!cache.Store(key, response))
+            continue;
+        const auto hit = cache.Lookup(key);
+        if (!hit || hit->Body() != response.body)
+            std::abort();
+    }
+    return 0;
+}
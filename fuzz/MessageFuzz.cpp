@@ -0,0 +1,29 @@
+// libFuzzer target over client message decoding. Besides crashes and sanitizer reports, it fails if DecodeMessage and
+// MakeMessage disagree on whether a message is valid
+
+#include "Requests.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    const std::string message(reinterpret_cast<const char*>(data), size);
+    const auto decoded = DecodeMessage(message);
+
+    bool thrown = false;
+    try {
+        MakeMessage(message);
+    } catch (const std::exception&) {
+        thrown = true;
+    }
+    if (thrown == decoded.message.has_value())
+        std::abort();
+
+    // Decoded request is handed to httplib as is
+    if (decoded.message) {
+        if (const auto* request = std::get_if<Request>(&*decoded.message))
+            request->Headers();
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "AdminReport.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+
+namespace {
+
+int64_t AgeMs(std::chrono::steady_clock::time_point since, std::chrono::steady_clock::time_point now) {
+    // Entries added after now was taken count as just started
+    return std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(now - since).count());
+}
+
+// Keeps the slowest entries, oldest first
+template <class Entry, class Started>
+void KeepSlowest(std::vector<Entry>& entries, size_t slowest, Started started) {
+    const auto older = [&started](const Entry& lhs, const Entry& rhs) { return started(lhs) < started(rhs); };
+    if (entries.size() > slowest) {
+        std::nth_element(begin(entries), begin(entries) + slowest, end(entries), older);
+        entries.resize(slowest);
+    }
+    std::sort(begin(entries), end(entries), older);
+}
+
+}  // namespace
+
+std::string WriteAdminReport(AdminReport report, std::chrono::steady_clock::time_point now, size_t slowest) {
+    std::sort(begin(report.connections), end(report.connections),
+              [](const ClientStats& lhs, const ClientStats& rhs) { return lhs.id < rhs.id; });
+    auto connections = nlohmann::json::array();
+    for (const auto& client : report.connections) {
+        nlohmann::json connection = {
+            {"id", client.id},
+            {"remote_ip", client.remote_ip},
+            {"age_ms", AgeMs(client.opened, now)},
+            {"in_flight", client.in_flight},
+            {"queued_bytes", client.queued_bytes},
+            {"paused", client.paused},
+            {"session", client.session},
+        };
+        if (client.oldest_request)
+            connection["oldest_request_ms"] = AgeMs(*client.oldest_request, now);
+        connections.push_back(std::move(connection));
+    }
+
+    const auto requests_total = report.requests.size();
+    KeepSlowest(report.requests, slowest, [](const ClientRequest& request) { return request.received; });
+    auto requests = nlohmann::json::array();
+    for (const auto& request : report.requests) {
+        requests.push_back({
+            {"connection", request.client},
+            {"method", MethodName(request.method)},
+            {"url", request.url},
+            {"path", request.path},
+            {"age_ms", AgeMs(request.received, now)},
+        });
+    }
+
+    auto pool = nlohmann::json::array();
+    for (const auto& origin : report.pool)
+        pool.push_back({{"origin", origin.origin}, {"idle", origin.idle}, {"in_use", origin.in_use}});
+
+    const auto calls_total = report.upstream_calls.size();
+    KeepSlowest(report.upstream_calls, slowest, [](const UpstreamCall& call) { return call.started; });
+    auto calls = nlohmann::json::array();
+    for (const auto& call : report.upstream_calls) {
+        calls.push_back({
+            {"origin", call.origin},
+            {"method", MethodName(call.method)},
+            {"path", call.path},
+            {"age_ms", AgeMs(call.started, now)},
+        });
+    }
+
+    const nlohmann::json json = {
+        {"connections", std::move(connections)},
+        {"requests_in_flight", requests_total},
+        {"slowest_requests", std::move(requests)},
+        {"pool", std::move(pool)},
+        {"upstream_calls_in_flight", calls_total},
+        {"slowest_upstream_calls", std::move(calls)},
+    };
+    // Urls are as clients sent them, not necessarily valid UTF-8
+    return json.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Method.h"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Live state shown by the admin route. Pieces are collected one after another, not at a single point in time
+
+struct ClientStats {
+    uint64_t id = 0;
+    std::string remote_ip;
+    std::chrono::steady_clock::time_point opened;
+    size_t in_flight = 0;
+    size_t queued_bytes = 0;  // Of requests in flight and responses not sent yet
+    bool paused = false;
+    std::optional<std::chrono::steady_clock::time_point> oldest_request;
+    bool session = false;
+};
+
+// Request of a client being handled, as the client sent it
+struct ClientRequest {
+    uint64_t client = 0;
+    Method method = Method::METHOD_GET;
+    std::string url;
+    std::string path;
+    std::chrono::steady_clock::time_point received;
+};
+
+// Upstream call on a connection
+struct UpstreamCall {
+    std::string origin;  // Origin::Key()
+    Method method = Method::METHOD_GET;
+    std::string path;
+    std::chrono::steady_clock::time_point started;
+};
+
+struct OriginOccupancy {
+    std::string origin;
+    size_t idle = 0;    // Pooled connections
+    size_t in_use = 0;  // Calls running
+};
+
+struct AdminReport {
+    std::vector<ClientStats> connections;
+    std::vector<ClientRequest> requests;
+    std::vector<OriginOccupancy> pool;
+    std::vector<UpstreamCall> upstream_calls;
+};
+
+// Json object with ages relative to now. Requests and upstream calls are cut to the slowest ones, longest running
+// first, their totals are kept
+std::string WriteAdminReport(AdminReport report, std::chrono::steady_clock::time_point now, size_t slowest);
@@ -0,0 +1,73 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+constexpr size_t kArenaBlockSize = 16 * 1024;
+
+Arena& Arena::OfThread() {
+    thread_local Arena arena;
+    return arena;
+}
+
+Arena* Arena::Current() {
+    auto& arena = OfThread();
+    return arena.scopes_ > 0 ? &arena : nullptr;
+}
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+    if (!blocks_.empty()) {
+        auto& block = blocks_.back();
+        const auto base = reinterpret_cast<uintptr_t>(block.data.get());
+        const auto offset = ((base + used_ + alignment - 1) & ~(alignment - 1)) - base;
+        if (offset + size <= block.size) {
+            used_ = offset + size;
+            return block.data.get() + offset;
+        }
+    }
+
+    AddBlock(size + alignment);
+    auto& block = blocks_.back();
+    const auto base = reinterpret_cast<uintptr_t>(block.data.get());
+    const auto offset = ((base + alignment - 1) & ~(alignment - 1)) - base;
+    used_ = offset + size;
+    return block.data.get() + offset;
+}
+
+bool Arena::Owns(const void* ptr) const {
+    // Comparing unrelated pointers is unspecified, addresses are compared instead
+    const auto address = reinterpret_cast<uintptr_t>(ptr);
+    return std::any_of(begin(blocks_), end(blocks_), [address](const Block& block) {
+        const auto base = reinterpret_cast<uintptr_t>(block.data.get());
+        return address >= base && address < base + block.size;
+    });
+}
+
+void Arena::Reset() {
+    // First block is kept for the next message, bigger ones are returned, so one large message doesn't pin memory
+    if (blocks_.size() > 1)
+        blocks_.resize(1);
+    if (!blocks_.empty() && blocks_.front().size > kArenaBlockSize)
+        blocks_.clear();
+    used_ = 0;
+}
+
+size_t Arena::BlockCount() const {
+    return blocks_.size();
+}
+
+void Arena::AddBlock(size_t min_size) {
+    const auto size = std::max(min_size, kArenaBlockSize);
+    blocks_.push_back({std::make_unique<std::byte[]>(size), size});
+    used_ = 0;
+}
+
+ArenaScope::ArenaScope() {
+    ++Arena::OfThread().scopes_;
+}
+
+ArenaScope::~ArenaScope() {
+    auto& arena = Arena::OfThread();
+    if (--arena.scopes_ == 0)
+        arena.Reset();
+}
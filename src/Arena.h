@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Bump allocator for objects that live no longer than one message. Nothing is freed individually: memory is
+// released all at once when the outermost ArenaScope ends, and the first block is kept by the thread for
+// the next message. Each thread has its own arena, so allocation takes no locks
+class Arena final {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena(Arena&&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena& operator=(Arena&&) = delete;
+
+    ~Arena() = default;
+
+    static Arena& OfThread();
+    // Thread's arena, or nullptr if no ArenaScope is active on this thread
+    static Arena* Current();
+
+    void* Allocate(size_t size, size_t alignment);
+    bool Owns(const void* ptr) const;
+    void Reset();
+
+    size_t BlockCount() const;
+
+private:
+    friend class ArenaScope;
+
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size = 0;
+    };
+
+    void AddBlock(size_t min_size);
+
+    std::vector<Block> blocks_;
+    size_t used_ = 0;  // In the last block
+    int scopes_ = 0;
+};
+
+// Makes thread's arena current. Scopes nest, arena is reset when the outermost one ends, so everything allocated
+// from it must be destroyed by then
+class ArenaScope final {
+public:
+    ArenaScope();
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope(ArenaScope&&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+    ArenaScope& operator=(ArenaScope&&) = delete;
+
+    ~ArenaScope();
+};
+
+// Stateless allocator: takes memory from the current arena, or from the heap if there's none
+template <class T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    ArenaAllocator() noexcept = default;
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& /*other*/) noexcept {}
+
+    T* allocate(size_t n) {
+        if (auto* arena = Arena::Current())
+            return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T)));
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t /*n*/) noexcept {
+        if (!Arena::OfThread().Owns(ptr))
+            ::operator delete(ptr);
+    }
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U>& /*other*/) const noexcept {
+        return true;
+    }
+    template <class U>
+    bool operator!=(const ArenaAllocator<U>& /*other*/) const noexcept {
+        return false;
+    }
+};
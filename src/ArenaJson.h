@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Arena.h"
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Json DOM whose nodes come from the thread's arena while an ArenaScope is active, for documents that only live
+// while a message is processed
+using ArenaJson = nlohmann::basic_json<std::map, std::vector, std::string, bool, std::int64_t, std::uint64_t, double,
+                                       ArenaAllocator>;
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Locale-independent case folding, usable in constant expressions and without allocating
+
+constexpr char ToLowerAscii(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+constexpr bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs) {
+    if (lhs.size() != rhs.size())
+        return false;
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        if (ToLowerAscii(lhs[i]) != ToLowerAscii(rhs[i]))
+            return false;
+    }
+    return true;
+}
+
+inline std::string LowerAscii(std::string_view str) {
+    std::string lower(str);
+    for (auto& c : lower)
+        c = ToLowerAscii(c);
+    return lower;
+}
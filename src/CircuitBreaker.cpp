@@ -0,0 +1,218 @@
+#include "CircuitBreaker.h"
+
+CircuitBreaker::CircuitBreaker(const CircuitBreakerConfig& config, std::function<Clock::time_point()> now)
+    : config_(config)
+    , now_(std::move(now))
+    , bucket_width_ms_(config.window.count() / config.buckets)
+    , buckets_(std::make_unique<Bucket[]>(config.buckets)) {
+}
+
+bool CircuitBreaker::Allow() {
+    auto packed = state_.load(std::memory_order_acquire);
+    const auto state = StateOf(packed);
+    if (state == CircuitState::Closed)
+        return true;
+
+    if (state == CircuitState::Open) {
+        const auto opened_at_ms = OpenedAtOf(packed);
+        if (NowMs() - opened_at_ms < config_.open_duration.count()) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        // Losing this race is fine, someone else switched to half-open (or it already tripped again)
+        state_.compare_exchange_strong(packed, Pack(CircuitState::HalfOpen, opened_at_ms), std::memory_order_acq_rel);
+        if (StateOf(state_.load(std::memory_order_acquire)) != CircuitState::HalfOpen) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    if (probes_.fetch_add(1, std::memory_order_relaxed) < config_.half_open_calls)
+        return true;
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void CircuitBreaker::Record(bool failure, std::chrono::microseconds latency) {
+    const bool slow = latency >= config_.slow_call;
+    auto packed = state_.load(std::memory_order_acquire);
+    const auto state = StateOf(packed);
+    const auto now_ms = NowMs();
+
+    if (state == CircuitState::HalfOpen) {
+        if (failure || slow) {
+            Trip(packed, now_ms);
+        } else if (probe_successes_.fetch_add(1, std::memory_order_relaxed) + 1 >= config_.half_open_calls) {
+            // Failures from before the circuit opened shouldn't trip it right away
+            ResetWindow();
+            state_.compare_exchange_strong(packed, Pack(CircuitState::Closed, 0), std::memory_order_acq_rel);
+        }
+        return;
+    }
+    if (state == CircuitState::Open)
+        return;  // Call started before the circuit opened
+
+    Count(now_ms, failure, slow);
+    if ((failure || slow) && ShouldTrip(now_ms))
+        Trip(packed, now_ms);
+}
+
+void CircuitBreaker::Abandon() {
+    // Gives the probe back, otherwise half-open circuit could wait for a result that never comes
+    if (StateOf(state_.load(std::memory_order_acquire)) == CircuitState::HalfOpen)
+        probes_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+CircuitState CircuitBreaker::State() const {
+    return StateOf(state_.load(std::memory_order_acquire));
+}
+
+uint64_t CircuitBreaker::Rejected() const {
+    return rejected_.load(std::memory_order_relaxed);
+}
+
+uint64_t CircuitBreaker::Opened() const {
+    return opened_.load(std::memory_order_relaxed);
+}
+
+bool CircuitBreaker::IsIdle() const {
+    if (StateOf(state_.load(std::memory_order_acquire)) != CircuitState::Closed)
+        return false;
+    const auto epoch = NowMs() / bucket_width_ms_;
+    for (int i = 0; i < config_.buckets; ++i) {
+        const auto& bucket = buckets_[i];
+        if (epoch - bucket.epoch.load(std::memory_order_acquire) < config_.buckets &&
+            bucket.calls.load(std::memory_order_relaxed) > 0)
+            return false;
+    }
+    return true;
+}
+
+uint64_t CircuitBreaker::Pack(CircuitState state, int64_t opened_at_ms) {
+    return static_cast<uint64_t>(opened_at_ms) << 2 | static_cast<uint64_t>(state);
+}
+
+CircuitState CircuitBreaker::StateOf(uint64_t packed) {
+    return static_cast<CircuitState>(packed & 3);
+}
+
+int64_t CircuitBreaker::OpenedAtOf(uint64_t packed) {
+    return static_cast<int64_t>(packed >> 2);
+}
+
+int64_t CircuitBreaker::NowMs() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(now_().time_since_epoch()).count();
+}
+
+void CircuitBreaker::Count(int64_t now_ms, bool failure, bool slow) {
+    const auto epoch = now_ms / bucket_width_ms_;
+    auto& bucket = buckets_[epoch % config_.buckets];
+
+    // Whoever moves the bucket to the new epoch clears it. Calls counted concurrently with the reset may be lost,
+    // which doesn't matter for a rate
+    auto seen = bucket.epoch.load(std::memory_order_acquire);
+    if (seen != epoch && bucket.epoch.compare_exchange_strong(seen, epoch, std::memory_order_acq_rel)) {
+        bucket.calls.store(0, std::memory_order_relaxed);
+        bucket.failures.store(0, std::memory_order_relaxed);
+        bucket.slow.store(0, std::memory_order_relaxed);
+    }
+
+    bucket.calls.fetch_add(1, std::memory_order_relaxed);
+    if (failure)
+        bucket.failures.fetch_add(1, std::memory_order_relaxed);
+    if (slow)
+        bucket.slow.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool CircuitBreaker::ShouldTrip(int64_t now_ms) const {
+    const auto epoch = now_ms / bucket_width_ms_;
+    uint64_t calls = 0;
+    uint64_t failures = 0;
+    uint64_t slow = 0;
+    for (int i = 0; i < config_.buckets; ++i) {
+        const auto& bucket = buckets_[i];
+        if (epoch - bucket.epoch.load(std::memory_order_acquire) >= config_.buckets)
+            continue;  // Stale
+        calls += bucket.calls.load(std::memory_order_relaxed);
+        failures += bucket.failures.load(std::memory_order_relaxed);
+        slow += bucket.slow.load(std::memory_order_relaxed);
+    }
+
+    if (calls == 0 || calls < config_.min_calls)
+        return false;
+    return static_cast<double>(failures) / calls >= config_.failure_rate ||
+           static_cast<double>(slow) / calls >= config_.slow_call_rate;
+}
+
+void CircuitBreaker::Trip(uint64_t from, int64_t now_ms) {
+    // Only the caller that still sees the state it judged opens the circuit, with its own open time. Probe counters
+    // aren't touched until open_duration passes, so they can be reset afterwards
+    if (!state_.compare_exchange_strong(from, Pack(CircuitState::Open, now_ms), std::memory_order_acq_rel))
+        return;
+    probes_.store(0, std::memory_order_relaxed);
+    probe_successes_.store(0, std::memory_order_relaxed);
+    opened_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CircuitBreaker::ResetWindow() {
+    for (int i = 0; i < config_.buckets; ++i)
+        buckets_[i].epoch.store(-1, std::memory_order_release);
+}
+
+
+CircuitBreakerRegistry::CircuitBreakerRegistry(const CircuitBreakerConfig& config,
+                                               const std::vector<std::string>& known_origins, size_t max_others,
+                                               std::function<Clock::time_point()> now)
+    : config_(config)
+    , max_others_(max_others)
+    , now_(std::move(now)) {
+    for (const auto& origin : known_origins) {
+        auto& breaker = known_[origin];
+        if (!breaker)
+            breaker = std::make_unique<CircuitBreaker>(config_, now_);
+    }
+}
+
+CircuitBreaker* CircuitBreakerRegistry::Find(const std::string& origin, std::shared_ptr<CircuitBreaker>& holder) {
+    const auto known = known_.find(origin);
+    if (known != known_.end())
+        return known->second.get();
+
+    auto lock = std::lock_guard(guard_);
+    const auto it = others_.find(origin);
+    if (it != others_.end()) {
+        holder = it->second;
+        return holder.get();
+    }
+
+    if (others_.size() >= max_others_)
+        DropIdle();
+    if (others_.size() >= max_others_)
+        return nullptr;
+    holder = std::make_shared<CircuitBreaker>(config_, now_);
+    others_.emplace(origin, holder);
+    return holder.get();
+}
+
+std::vector<CircuitStats> CircuitBreakerRegistry::Stats() const {
+    std::vector<CircuitStats> stats;
+    const auto add = [&stats](const std::string& origin, const CircuitBreaker& breaker) {
+        stats.push_back({origin, breaker.State(), breaker.Opened(), breaker.Rejected()});
+    };
+    for (const auto& [origin, breaker] : known_)
+        add(origin, *breaker);
+
+    auto lock = std::lock_guard(guard_);
+    for (const auto& [origin, breaker] : others_)
+        add(origin, *breaker);
+    return stats;
+}
+
+void CircuitBreakerRegistry::DropIdle() {
+    for (auto it = others_.begin(); it != others_.end();) {
+        if (it->second->IsIdle())
+            it = others_.erase(it);
+        else
+            ++it;
+    }
+}
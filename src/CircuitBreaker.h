@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Config.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class CircuitState : uint8_t {
+    Closed,
+    Open,
+    HalfOpen
+};
+
+// Per-origin breaker. Closed: calls pass, outcomes are counted in a rolling window of buckets, and the circuit opens
+// when failure or slow call rate crosses its threshold. Open: calls are rejected until open_duration passes.
+// HalfOpen: half_open_calls probes are let through, all of them must succeed to close the circuit again.
+// State and open time are packed in a single atomic, so Allow() in closed state is one load and a circuit tripped
+// by two callers at once can't end up with the loser's open time
+class CircuitBreaker final {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit CircuitBreaker(const CircuitBreakerConfig& config, std::function<Clock::time_point()> now = Clock::now);
+    CircuitBreaker(const CircuitBreaker&) = delete;
+    CircuitBreaker(CircuitBreaker&&) = delete;
+    CircuitBreaker& operator=(const CircuitBreaker&) = delete;
+    CircuitBreaker& operator=(CircuitBreaker&&) = delete;
+
+    ~CircuitBreaker() = default;
+
+    // Returns false if call should fail fast
+    bool Allow();
+    // Called for every allowed call
+    void Record(bool failure, std::chrono::microseconds latency);
+    // Allowed call ended without telling anything about origin health (was cancelled or threw)
+    void Abandon();
+
+    CircuitState State() const;
+    uint64_t Rejected() const;
+    uint64_t Opened() const;
+    // Closed, with no calls counted in the window
+    bool IsIdle() const;
+
+private:
+    struct Bucket {
+        std::atomic<int64_t> epoch{-1};
+        std::atomic<uint32_t> calls{0};
+        std::atomic<uint32_t> failures{0};
+        std::atomic<uint32_t> slow{0};
+    };
+
+    // Open time in milliseconds above the two state bits
+    static uint64_t Pack(CircuitState state, int64_t opened_at_ms);
+    static CircuitState StateOf(uint64_t packed);
+    static int64_t OpenedAtOf(uint64_t packed);
+
+    int64_t NowMs() const;
+    void Count(int64_t now_ms, bool failure, bool slow);
+    bool ShouldTrip(int64_t now_ms) const;
+    void Trip(uint64_t from, int64_t now_ms);
+    void ResetWindow();
+
+    CircuitBreakerConfig config_;
+    std::function<Clock::time_point()> now_;
+    int64_t bucket_width_ms_;
+    std::unique_ptr<Bucket[]> buckets_;
+
+    std::atomic<uint64_t> state_{0};  // Pack(Closed, 0)
+    std::atomic<uint32_t> probes_{0};
+    std::atomic<uint32_t> probe_successes_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> opened_{0};
+};
+
+struct CircuitStats {
+    std::string origin;
+    CircuitState state = CircuitState::Closed;
+    uint64_t opened = 0;
+    uint64_t rejected = 0;
+};
+
+// Breakers by origin key. Known origins get theirs up front, in a map that never changes afterwards, so finding them
+// takes no lock. Others are added on demand, up to max_others: when full, idle ones are dropped, and if none is idle
+// the new origin goes without a breaker. Open circuits are never dropped
+class CircuitBreakerRegistry final {
+public:
+    using Clock = CircuitBreaker::Clock;
+
+    CircuitBreakerRegistry(const CircuitBreakerConfig& config, const std::vector<std::string>& known_origins,
+                           size_t max_others = 1024, std::function<Clock::time_point()> now = Clock::now);
+    CircuitBreakerRegistry(const CircuitBreakerRegistry&) = delete;
+    CircuitBreakerRegistry(CircuitBreakerRegistry&&) = delete;
+    CircuitBreakerRegistry& operator=(const CircuitBreakerRegistry&) = delete;
+    CircuitBreakerRegistry& operator=(CircuitBreakerRegistry&&) = delete;
+
+    ~CircuitBreakerRegistry() = default;
+
+    // Null if origin has no breaker. Holder keeps breaker of an origin that isn't known alive while it's used
+    CircuitBreaker* Find(const std::string& origin, std::shared_ptr<CircuitBreaker>& holder);
+    std::vector<CircuitStats> Stats() const;
+
+private:
+    void DropIdle();
+
+    CircuitBreakerConfig config_;
+    size_t max_others_;
+    std::function<Clock::time_point()> now_;
+    std::unordered_map<std::string, std::unique_ptr<CircuitBreaker>> known_;  // Read-only after construction
+
+    mutable std::mutex guard_;
+    std::unordered_map<std::string, std::shared_ptr<CircuitBreaker>> others_;
+};
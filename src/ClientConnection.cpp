@@ -0,0 +1,143 @@
+#include "ClientConnection.h"
+
+ClientConnection::ClientConnection(uint64_t id, crow::websocket::connection& conn, const SendQueueConfig& config,
+                                   SendQueueMetrics& metrics, std::unique_ptr<Session> session)
+    : id_(id)
+    , remote_ip_(conn.get_remote_ip())
+    , opened_(std::chrono::steady_clock::now())
+    , session_(std::move(session))
+    , conn_(&conn)
+    , queue_(config)
+    , metrics_(metrics) {
+}
+
+ClientConnection::~ClientConnection() {
+    // Responses that were never sent leave the totals with the client
+    metrics_.pending_bytes.Add(-static_cast<int64_t>(reported_bytes_));
+    if (reported_paused_)
+        metrics_.paused_clients.Add(-1);
+}
+
+std::optional<uint64_t> ClientConnection::BeginRequest(size_t request_bytes) {
+    auto lock = std::lock_guard(guard_);
+    const auto sequence = queue_.Reserve(request_bytes);
+    if (!sequence)
+        metrics_.rejected.Increment();
+    ReportQueueState();
+    return sequence;
+}
+
+void ClientConnection::Respond(uint64_t sequence, std::string frame, OnSent on_sent) {
+    std::vector<OnSent> sent_callbacks;
+    bool sent = false;
+    {
+        auto lock = std::lock_guard(guard_);
+        queue_.Complete(sequence, std::move(frame));
+        if (on_sent)
+            on_sent_.emplace(sequence, std::move(on_sent));
+        sent = SendReady(sent_callbacks);
+    }
+    // Outside the lock, callbacks may take their own
+    for (const auto& callback : sent_callbacks)
+        callback(sent);
+}
+
+bool ClientConnection::Reject(std::string frame) {
+    std::vector<OnSent> sent_callbacks;
+    bool sent = false;
+    {
+        auto lock = std::lock_guard(guard_);
+        if (!queue_.AppendRejection(std::move(frame))) {
+            const bool first = !overflowed_;
+            overflowed_ = true;
+            return !first;
+        }
+        sent = SendReady(sent_callbacks);
+    }
+    for (const auto& callback : sent_callbacks)
+        callback(sent);
+    return true;
+}
+
+PushResult ClientConnection::Push(std::string frame) {
+    std::vector<OnSent> sent_callbacks;
+    {
+        auto lock = std::lock_guard(guard_);
+        if (!conn_)
+            return PushResult::Gone;
+        if (queue_.IsPaused())
+            return PushResult::Busy;
+        queue_.Append(std::move(frame));
+        SendReady(sent_callbacks);
+    }
+    for (const auto& callback : sent_callbacks)
+        callback(true);
+    return PushResult::Sent;
+}
+
+bool ClientConnection::IfOpen(const std::function<void()>& action) {
+    auto lock = std::lock_guard(open_guard_);
+    if (closed_)
+        return false;
+    action();
+    return true;
+}
+
+void ClientConnection::Close() {
+    auto open_lock = std::lock_guard(open_guard_);
+    closed_ = true;
+    auto lock = std::lock_guard(guard_);
+    conn_ = nullptr;
+}
+
+bool ClientConnection::SendReady(std::vector<OnSent>& sent_callbacks) {
+    // Sent under the lock, so batches from different workers can't overtake each other. Crow writes frames
+    // queued while a write is in progress with a single socket write
+    const auto ready = queue_.TakeReady();
+    if (conn_) {
+        for (const auto& response : ready)
+            conn_->send_text(response);
+    }
+    const auto first = on_sent_.lower_bound(next_sent_);
+    next_sent_ += ready.size();
+    const auto last = on_sent_.lower_bound(next_sent_);
+    for (auto it = first; it != last; ++it)
+        sent_callbacks.push_back(std::move(it->second));
+    on_sent_.erase(first, last);
+    ReportQueueState();
+    return conn_ != nullptr;
+}
+
+void ClientConnection::ReportQueueState() {
+    const auto bytes = queue_.PendingBytes();
+    metrics_.pending_bytes.Add(static_cast<int64_t>(bytes) - static_cast<int64_t>(reported_bytes_));
+    reported_bytes_ = bytes;
+
+    const auto paused = queue_.IsPaused();
+    if (paused != reported_paused_)
+        metrics_.paused_clients.Add(paused ? 1 : -1);
+    reported_paused_ = paused;
+}
+
+uint64_t ClientConnection::Id() const {
+    return id_;
+}
+
+Session* ClientConnection::GetSession() const {
+    return session_.get();
+}
+
+ClientStats ClientConnection::Stats() {
+    ClientStats stats;
+    stats.id = id_;
+    stats.remote_ip = remote_ip_;
+    stats.opened = opened_;
+    stats.session = session_ != nullptr;
+
+    auto lock = std::lock_guard(guard_);
+    stats.in_flight = queue_.InFlight();
+    stats.queued_bytes = queue_.PendingBytes();
+    stats.paused = queue_.IsPaused();
+    stats.oldest_request = queue_.OldestInFlight();
+    return stats;
+}
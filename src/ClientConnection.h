@@ -0,0 +1,83 @@
+#pragma once
+
+#include "AdminReport.h"
+#include "Config.h"
+#include "Metrics.h"
+#include "SendQueue.h"
+#include "Session.h"
+#include "SubscriptionHub.h"
+
+#include <crow.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct SendQueueMetrics {
+    Gauge& pending_bytes;  // Of all clients
+    Gauge& paused_clients;
+    Counter& rejected;
+};
+
+// State of one WebSocket client, shared by Crow handlers and dispatch workers, kept in connection's userdata
+class ClientConnection final {
+public:
+    ClientConnection(uint64_t id, crow::websocket::connection& conn, const SendQueueConfig& config,
+                     SendQueueMetrics& metrics, std::unique_ptr<Session> session = nullptr);
+    ClientConnection(const ClientConnection&) = delete;
+    ClientConnection(ClientConnection&&) = delete;
+    ClientConnection& operator=(const ClientConnection&) = delete;
+    ClientConnection& operator=(ClientConnection&&) = delete;
+
+    ~ClientConnection();
+
+    // Response slot for the request, or nothing if client is too far behind
+    std::optional<uint64_t> BeginRequest(size_t request_bytes);
+    // Called once response leaves the queue, with false if the client was gone
+    using OnSent = std::function<void(bool sent)>;
+
+    // Queues response and sends every response that is next in order
+    void Respond(uint64_t sequence, std::string frame, OnSent on_sent = {});
+    // Answers request BeginRequest() turned down, after the responses to requests before it. False the first time
+    // too many rejections are waiting already, the client should be closed then; later ones are just dropped
+    bool Reject(std::string frame);
+    // Queues frame that answers no request, e.g. subscription update, after the responses already queued.
+    // Refused while client is paused
+    PushResult Push(std::string frame);
+    // Runs action unless client is closed, Close() waits for it. False if it was closed
+    bool IfOpen(const std::function<void()>& action);
+    // Called from close handler, Crow connection must not be touched afterwards
+    void Close();
+
+    uint64_t Id() const;
+    // Null unless client asked for a session
+    Session* GetSession() const;
+    ClientStats Stats();
+
+private:
+    // Hands responses that are next in order to Crow, under the lock. False if client is gone
+    bool SendReady(std::vector<OnSent>& sent_callbacks);
+    void ReportQueueState();
+
+    uint64_t id_;
+    std::string remote_ip_;
+    std::chrono::steady_clock::time_point opened_;
+    std::unique_ptr<Session> session_;
+    std::mutex open_guard_;  // Taken before guard_
+    bool closed_ = false;
+    std::mutex guard_;
+    crow::websocket::connection* conn_;
+    SendQueue queue_;
+    SendQueueMetrics& metrics_;
+    std::map<uint64_t, OnSent> on_sent_;  // By sequence, for responses waiting in the queue
+    uint64_t next_sent_ = 0;              // Sequence of the next frame TakeReady() returns
+    size_t reported_bytes_ = 0;
+    bool reported_paused_ = false;
+    bool overflowed_ = false;  // Reject() refused, client is being closed
+};
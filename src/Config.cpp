@@ -0,0 +1,349 @@
+#include "Config.h"
+
+#include "Ascii.h"
+#include "Method.h"
+
+#include <nlohmann/json.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+std::chrono::milliseconds Milliseconds(const nlohmann::json& json, const char* key, std::chrono::milliseconds def) {
+    return std::chrono::milliseconds(json.value(key, static_cast<int64_t>(def.count())));
+}
+
+BalancePolicy ParseBalancePolicy(const std::string& str) {
+    const auto policy = LowerAscii(str);
+    if (policy == "least_outstanding")
+        return BalancePolicy::LeastOutstanding;
+    else if (policy == "p2c" || policy == "power_of_two_choices")
+        return BalancePolicy::PowerOfTwoChoices;
+    else
+        throw std::runtime_error("ParseConfig(): unknown balance policy " + str);
+}
+
+TraceExporterType ParseTraceExporterType(const std::string& str) {
+    const auto exporter = LowerAscii(str);
+    if (exporter == "none")
+        return TraceExporterType::None;
+    else if (exporter == "file")
+        return TraceExporterType::File;
+    else if (exporter == "otlp")
+        return TraceExporterType::Otlp;
+    else
+        throw std::runtime_error("ParseConfig(): unknown trace exporter " + str);
+}
+
+HealthCheckConfig ParseHealthCheck(const nlohmann::json& json) {
+    HealthCheckConfig health_check;
+    health_check.path = json.value("path", health_check.path);
+    health_check.interval = Milliseconds(json, "interval_ms", health_check.interval);
+    health_check.timeout = Milliseconds(json, "timeout_ms", health_check.timeout);
+    health_check.healthy_threshold = json.value("healthy_threshold", health_check.healthy_threshold);
+    health_check.unhealthy_threshold = json.value("unhealthy_threshold", health_check.unhealthy_threshold);
+    return health_check;
+}
+
+OutlierDetectionConfig ParseOutlierDetection(const nlohmann::json& json) {
+    OutlierDetectionConfig outlier;
+    outlier.consecutive_failures = json.value("consecutive_failures", outlier.consecutive_failures);
+    outlier.base_ejection = Milliseconds(json, "base_ejection_ms", outlier.base_ejection);
+    outlier.max_ejection = Milliseconds(json, "max_ejection_ms", outlier.max_ejection);
+    outlier.max_ejection_percent = json.value("max_ejection_percent", outlier.max_ejection_percent);
+    return outlier;
+}
+
+UpstreamConfig ParseUpstream(const std::string& name, const nlohmann::json& json) {
+    UpstreamConfig upstream;
+    upstream.name = name;
+    upstream.backends = json.at("backends").get<std::vector<std::string>>();
+    if (upstream.backends.empty())
+        throw std::runtime_error("ParseConfig(): upstream " + name + " has no backends");
+    if (json.contains("policy"))
+        upstream.policy = ParseBalancePolicy(json["policy"].get<std::string>());
+    if (json.contains("health_check"))
+        upstream.health_check = ParseHealthCheck(json["health_check"]);
+    if (json.contains("outlier_detection"))
+        upstream.outlier_detection = ParseOutlierDetection(json["outlier_detection"]);
+    return upstream;
+}
+
+HedgingConfig ParseHedging(const nlohmann::json& json) {
+    HedgingConfig hedging;
+    hedging.enabled = json.value("enabled", hedging.enabled);
+    hedging.percentile = json.value("percentile", hedging.percentile);
+    hedging.min_delay = Milliseconds(json, "min_delay_ms", hedging.min_delay);
+    hedging.min_samples = json.value("min_samples", hedging.min_samples);
+    hedging.max_concurrent = json.value("max_concurrent", hedging.max_concurrent);
+    if (hedging.percentile <= 0.0 || hedging.percentile > 100.0)
+        throw std::runtime_error("ParseConfig(): hedging percentile should be in (0, 100]");
+    if (hedging.enabled && hedging.max_concurrent == 0)
+        throw std::runtime_error("ParseConfig(): hedging max_concurrent should be at least 1");
+    return hedging;
+}
+
+RetryConfig ParseRetry(const nlohmann::json& json) {
+    RetryConfig retry;
+    retry.max_attempts = json.value("max_attempts", retry.max_attempts);
+    retry.base_backoff = Milliseconds(json, "base_backoff_ms", retry.base_backoff);
+    retry.max_backoff = Milliseconds(json, "max_backoff_ms", retry.max_backoff);
+    retry.budget_ratio = json.value("budget_ratio", retry.budget_ratio);
+    retry.budget_min_per_second = json.value("budget_min_per_second", retry.budget_min_per_second);
+    if (json.contains("methods")) {
+        retry.methods.clear();
+        for (const auto& method : json["methods"])
+            retry.methods.push_back(MethodFromString(method.get<std::string>()));
+    }
+    if (json.contains("hedging"))
+        retry.hedging = ParseHedging(json["hedging"]);
+    if (retry.max_attempts < 1)
+        throw std::runtime_error("ParseConfig(): retry max_attempts should be at least 1");
+    return retry;
+}
+
+CircuitBreakerConfig ParseCircuitBreaker(const nlohmann::json& json) {
+    CircuitBreakerConfig breaker;
+    breaker.enabled = json.value("enabled", breaker.enabled);
+    breaker.window = Milliseconds(json, "window_ms", breaker.window);
+    breaker.buckets = json.value("buckets", breaker.buckets);
+    breaker.min_calls = json.value("min_calls", breaker.min_calls);
+    breaker.failure_rate = json.value("failure_rate", breaker.failure_rate);
+    breaker.slow_call = Milliseconds(json, "slow_call_ms", breaker.slow_call);
+    breaker.slow_call_rate = json.value("slow_call_rate", breaker.slow_call_rate);
+    breaker.open_duration = Milliseconds(json, "open_ms", breaker.open_duration);
+    breaker.half_open_calls = json.value("half_open_calls", breaker.half_open_calls);
+    if (breaker.buckets < 1 || breaker.window.count() < breaker.buckets)
+        throw std::runtime_error("ParseConfig(): circuit breaker window should have at least 1 ms per bucket");
+    if (breaker.failure_rate <= 0.0 || breaker.failure_rate > 1.0 || breaker.slow_call_rate <= 0.0 ||
+        breaker.slow_call_rate > 1.0)
+        throw std::runtime_error("ParseConfig(): circuit breaker rates should be in (0, 1]");
+    if (breaker.half_open_calls < 1)
+        throw std::runtime_error("ParseConfig(): circuit breaker half_open_calls should be at least 1");
+    return breaker;
+}
+
+SendQueueConfig ParseSendQueue(const nlohmann::json& json) {
+    SendQueueConfig send_queue;
+    send_queue.high_watermark_bytes = json.value("high_watermark_bytes", send_queue.high_watermark_bytes);
+    send_queue.low_watermark_bytes = json.value("low_watermark_bytes", send_queue.high_watermark_bytes / 4);
+    send_queue.max_in_flight = json.value("max_in_flight", send_queue.max_in_flight);
+    send_queue.max_queued_rejections = json.value("max_queued_rejections", send_queue.max_queued_rejections);
+    if (send_queue.low_watermark_bytes > send_queue.high_watermark_bytes)
+        throw std::runtime_error("ParseConfig(): send queue low watermark should not exceed high watermark");
+    if (send_queue.max_in_flight < 1)
+        throw std::runtime_error("ParseConfig(): send queue max_in_flight should be at least 1");
+    if (send_queue.max_queued_rejections < 1)
+        throw std::runtime_error("ParseConfig(): send queue max_queued_rejections should be at least 1");
+    return send_queue;
+}
+
+DecoderConfig ParseDecoder(const nlohmann::json& json) {
+    DecoderConfig decoder;
+    decoder.max_depth = json.value("max_depth", decoder.max_depth);
+    decoder.max_headers = json.value("max_headers", decoder.max_headers);
+    if (decoder.max_depth < 3)
+        throw std::runtime_error("ParseConfig(): decoder max_depth should be at least 3");
+    return decoder;
+}
+
+PoolConfig ParsePool(const nlohmann::json& json) {
+    PoolConfig pool;
+    pool.origins = json.value("origins", pool.origins);
+    pool.warm_connections = json.value("warm_connections", pool.warm_connections);
+    pool.min_idle = json.value("min_idle", pool.min_idle);
+    pool.max_idle = json.value("max_idle", pool.max_idle);
+    pool.idle_timeout = Milliseconds(json, "idle_timeout_ms", pool.idle_timeout);
+    pool.refill_interval = Milliseconds(json, "refill_interval_ms", pool.refill_interval);
+    pool.warm_path = json.value("warm_path", pool.warm_path);
+    if (pool.warm_connections > pool.max_idle || pool.min_idle > pool.max_idle)
+        throw std::runtime_error("ParseConfig(): pool warm_connections and min_idle should not exceed max_idle");
+    if (pool.refill_interval.count() < 1)
+        throw std::runtime_error("ParseConfig(): pool refill_interval_ms should be at least 1");
+    return pool;
+}
+
+DiskCacheConfig ParseDiskCache(const nlohmann::json& json) {
+    DiskCacheConfig cache;
+    cache.enabled = json.value("enabled", cache.enabled);
+    cache.path = json.value("path", cache.path);
+    cache.max_bytes = json.value("max_bytes", cache.max_bytes);
+    cache.max_entry_bytes = json.value("max_entry_bytes", cache.max_entry_bytes);
+    cache.ttl = Milliseconds(json, "ttl_ms", cache.ttl);
+    cache.match = json.value("match", cache.match);
+    // Compaction has to leave room for any entry
+    if (cache.max_entry_bytes > cache.max_bytes / 2)
+        throw std::runtime_error("ParseConfig(): disk_cache max_entry_bytes should be at most half of max_bytes");
+    if (cache.ttl.count() < 1)
+        throw std::runtime_error("ParseConfig(): disk_cache ttl_ms should be at least 1");
+    return cache;
+}
+
+SessionConfig ParseSessions(const nlohmann::json& json) {
+    SessionConfig sessions;
+    sessions.enabled = json.value("enabled", sessions.enabled);
+    sessions.max_cookies = json.value("max_cookies", sessions.max_cookies);
+    sessions.max_cookie_bytes = json.value("max_cookie_bytes", sessions.max_cookie_bytes);
+    sessions.max_pinned = json.value("max_pinned", sessions.max_pinned);
+    // Cookie of the size browsers have to support should fit
+    if (sessions.max_cookie_bytes < 4096)
+        throw std::runtime_error("ParseConfig(): sessions max_cookie_bytes should be at least 4096");
+    return sessions;
+}
+
+SubscriptionConfig ParseSubscriptions(const nlohmann::json& json) {
+    SubscriptionConfig subscriptions;
+    subscriptions.min_interval = Milliseconds(json, "min_interval_ms", subscriptions.min_interval);
+    subscriptions.max_per_client = json.value("max_per_client", subscriptions.max_per_client);
+    subscriptions.max_polls = json.value("max_polls", subscriptions.max_polls);
+    if (subscriptions.min_interval.count() < 1)
+        throw std::runtime_error("ParseConfig(): subscriptions min_interval_ms should be at least 1");
+    return subscriptions;
+}
+
+TracingConfig ParseTracing(const nlohmann::json& json) {
+    TracingConfig tracing;
+    tracing.enabled = json.value("enabled", tracing.enabled);
+    tracing.timing = json.value("timing", tracing.timing);
+    if (json.contains("exporter"))
+        tracing.exporter = ParseTraceExporterType(json["exporter"].get<std::string>());
+    tracing.file = json.value("file", tracing.file);
+    tracing.otlp_endpoint = json.value("otlp_endpoint", tracing.otlp_endpoint);
+    tracing.service_name = json.value("service_name", tracing.service_name);
+    tracing.max_queued = json.value("max_queued", tracing.max_queued);
+    tracing.flush_interval = Milliseconds(json, "flush_interval_ms", tracing.flush_interval);
+    if (tracing.flush_interval.count() < 1)
+        throw std::runtime_error("ParseConfig(): tracing flush_interval_ms should be at least 1");
+    return tracing;
+}
+
+AdminConfig ParseAdmin(const nlohmann::json& json) {
+    AdminConfig admin;
+    admin.enabled = json.value("enabled", admin.enabled);
+    admin.slowest = json.value("slowest", admin.slowest);
+    return admin;
+}
+
+AccessConfig ParseAccess(const nlohmann::json& json) {
+    AccessConfig access;
+    access.allow = json.value("allow", access.allow);
+    access.deny = json.value("deny", access.deny);
+    return access;
+}
+
+RequestStageConfig ParseRequestStage(const nlohmann::json& json) {
+    const auto type = json.at("type").get<std::string>();
+    if (type == "set_headers") {
+        SetHeadersStage stage;
+        for (const auto& [name, value] : json.at("headers").items())
+            stage.headers.emplace_back(name, value.get<std::string>());
+        return stage;
+    } else if (type == "auth_token") {
+        AuthTokenStage stage;
+        stage.header = json.value("header", stage.header);
+        stage.token = json.value("token", stage.token);
+        stage.token_env = json.value("token_env", stage.token_env);
+        if (stage.token.empty() == stage.token_env.empty())
+            throw std::runtime_error("ParseConfig(): auth_token stage needs either token or token_env");
+        return stage;
+    } else if (type == "rewrite_url") {
+        RewriteUrlStage stage;
+        stage.from = json.value("from", stage.from);
+        stage.to = json.value("to", stage.to);
+        stage.path_from = json.value("path_from", stage.path_from);
+        stage.path_to = json.value("path_to", stage.path_to);
+        return stage;
+    } else if (type == "origin_filter") {
+        OriginFilterStage stage;
+        stage.allow = json.value("allow", stage.allow);
+        stage.deny = json.value("deny", stage.deny);
+        return stage;
+    } else {
+        throw std::runtime_error("ParseConfig(): unknown request stage " + type);
+    }
+}
+
+ResponseStageConfig ParseResponseStage(const nlohmann::json& json) {
+    const auto type = json.at("type").get<std::string>();
+    if (type == "filter_headers") {
+        FilterHeadersStage stage;
+        stage.allow = json.value("allow", stage.allow);
+        stage.deny = json.value("deny", stage.deny);
+        return stage;
+    } else if (type == "truncate_body") {
+        TruncateBodyStage stage;
+        stage.max_bytes = json.at("max_bytes").get<size_t>();
+        return stage;
+    } else if (type == "project") {
+        ProjectStage stage;
+        stage.fields = json.at("fields").get<std::vector<std::string>>();
+        if (stage.fields.empty())
+            throw std::runtime_error("ParseConfig(): project stage has no fields");
+        return stage;
+    } else {
+        throw std::runtime_error("ParseConfig(): unknown response stage " + type);
+    }
+}
+
+RouteConfig ParseRoute(const nlohmann::json& json) {
+    RouteConfig route;
+    route.match = json.value("match", route.match);
+    if (json.contains("pre")) {
+        for (const auto& stage : json["pre"])
+            route.pre.push_back(ParseRequestStage(stage));
+    }
+    if (json.contains("post")) {
+        for (const auto& stage : json["post"])
+            route.post.push_back(ParseResponseStage(stage));
+    }
+    return route;
+}
+
+}  // namespace
+
+Config ParseConfig(const std::string& data) {
+    const auto json = nlohmann::json::parse(data);
+    Config config;
+    if (json.contains("upstreams")) {
+        for (const auto& [name, upstream] : json["upstreams"].items())
+            config.upstreams.push_back(ParseUpstream(name, upstream));
+    }
+    if (json.contains("retry"))
+        config.retry = ParseRetry(json["retry"]);
+    if (json.contains("circuit_breaker"))
+        config.circuit_breaker = ParseCircuitBreaker(json["circuit_breaker"]);
+    if (json.contains("send_queue"))
+        config.send_queue = ParseSendQueue(json["send_queue"]);
+    if (json.contains("decoder"))
+        config.decoder = ParseDecoder(json["decoder"]);
+    if (json.contains("pool"))
+        config.pool = ParsePool(json["pool"]);
+    if (json.contains("disk_cache"))
+        config.disk_cache = ParseDiskCache(json["disk_cache"]);
+    if (json.contains("subscriptions"))
+        config.subscriptions = ParseSubscriptions(json["subscriptions"]);
+    if (json.contains("sessions"))
+        config.sessions = ParseSessions(json["sessions"]);
+    if (json.contains("tracing"))
+        config.tracing = ParseTracing(json["tracing"]);
+    if (json.contains("admin"))
+        config.admin = ParseAdmin(json["admin"]);
+    if (json.contains("access"))
+        config.access = ParseAccess(json["access"]);
+    if (json.contains("routes")) {
+        for (const auto& route : json["routes"])
+            config.routes.push_back(ParseRoute(route));
+    }
+    return config;
+}
+
+Config LoadConfig(const std::string& path) {
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("LoadConfig(): can't open " + path);
+    std::stringstream data;
+    data << file.rdbuf();
+    return ParseConfig(data.str());
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "Method.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+enum class BalancePolicy {
+    LeastOutstanding,
+    PowerOfTwoChoices
+};
+
+struct HealthCheckConfig {
+    std::string path = "/health";
+    std::chrono::milliseconds interval{1000};
+    std::chrono::milliseconds timeout{500};
+    int healthy_threshold = 2;
+    int unhealthy_threshold = 3;
+};
+
+struct OutlierDetectionConfig {
+    int consecutive_failures = 5;
+    std::chrono::milliseconds base_ejection{1000};
+    std::chrono::milliseconds max_ejection{30000};
+    int max_ejection_percent = 50;
+};
+
+struct UpstreamConfig {
+    std::string name;
+    std::vector<std::string> backends;
+    BalancePolicy policy = BalancePolicy::PowerOfTwoChoices;
+    std::optional<HealthCheckConfig> health_check;
+    OutlierDetectionConfig outlier_detection;
+};
+
+struct HedgingConfig {
+    bool enabled = false;
+    double percentile = 95.0;
+    std::chrono::milliseconds min_delay{10};
+    uint32_t min_samples = 100;
+    size_t max_concurrent = 16;
+};
+
+struct RetryConfig {
+    int max_attempts = 1;
+    std::chrono::milliseconds base_backoff{25};
+    std::chrono::milliseconds max_backoff{1000};
+    double budget_ratio = 0.2;
+    int budget_min_per_second = 10;
+    std::vector<Method> methods = {Method::METHOD_GET, Method::METHOD_HEAD, Method::METHOD_OPTIONS};
+    HedgingConfig hedging;
+};
+
+struct CircuitBreakerConfig {
+    bool enabled = false;
+    std::chrono::milliseconds window{10000};
+    int buckets = 10;
+    uint32_t min_calls = 20;
+    double failure_rate = 0.5;
+    std::chrono::milliseconds slow_call{2000};
+    double slow_call_rate = 0.8;
+    std::chrono::milliseconds open_duration{5000};
+    uint32_t half_open_calls = 3;
+};
+
+struct SendQueueConfig {
+    size_t high_watermark_bytes = 1024 * 1024;
+    size_t low_watermark_bytes = 256 * 1024;
+    size_t max_in_flight = 8;
+    size_t max_queued_rejections = 64;  // Client flooding past them is closed
+};
+
+struct PoolConfig {
+    std::vector<std::string> origins;  // Warmed besides backends of upstream groups
+    size_t warm_connections = 2;       // Opened to each known origin before server reports ready
+    size_t min_idle = 1;               // Kept open to each known origin in background
+    size_t max_idle = 8;               // Per origin, connections above it are closed after use
+    std::chrono::milliseconds idle_timeout{30000};
+    std::chrono::milliseconds refill_interval{1000};
+    std::string warm_path = "/";  // HEAD request that opens a connection
+};
+
+// Limits of client messages, so hostile ones are refused before they cost a full decode
+struct DecoderConfig {
+    size_t max_depth = 8;  // Nesting of Json objects and arrays, valid requests need 3
+    size_t max_headers = 128;
+};
+
+// Second life for GET responses, in a file that survives restarts
+struct DiskCacheConfig {
+    bool enabled = false;
+    std::string path = "websockproxy.cache";
+    size_t max_bytes = 1024 * 1024 * 1024;  // File is compacted before it grows above it
+    size_t max_entry_bytes = 64 * 1024 * 1024;
+    std::chrono::milliseconds ttl{3600000};  // Shortened by response's Cache-Control max-age
+    std::vector<std::string> match;          // Url prefixes of cached requests, empty for any GET
+};
+
+// State kept for clients that ask for it, bounded per client
+struct SessionConfig {
+    bool enabled = false;
+    size_t max_cookies = 64;
+    size_t max_cookie_bytes = 16 * 1024;  // Names and values of all cookies
+    size_t max_pinned = 4;                // Origins a session keeps its own connection to
+};
+
+// Limits of polling done for subscribed clients
+struct SubscriptionConfig {
+    std::chrono::milliseconds min_interval{250};
+    size_t max_per_client = 64;
+    size_t max_polls = 1024;  // Distinct polls of all clients
+};
+
+enum class TraceExporterType {
+    None,
+    File,
+    Otlp
+};
+
+struct TracingConfig {
+    bool enabled = false;
+    bool timing = false;  // Adds "timing" block to responses
+    TraceExporterType exporter = TraceExporterType::None;
+    std::string file = "traces.jsonl";
+    std::string otlp_endpoint = "http://127.0.0.1:4318/v1/traces";
+    std::string service_name = "websockproxy";
+    size_t max_queued = 8192;  // Traces waiting for export, more are dropped
+    std::chrono::milliseconds flush_interval{1000};
+};
+
+// Introspection route with live connections and calls, off by default as it shows what clients request
+struct AdminConfig {
+    bool enabled = false;
+    size_t slowest = 10;  // In-flight requests and upstream calls listed, longest running first
+};
+
+// Origins clients may call, in OriginMatcher rule format. Empty lists allow everything
+struct AccessConfig {
+    std::vector<std::string> allow;
+    std::vector<std::string> deny;
+};
+
+// Route stages, see README for what each one does
+struct SetHeadersStage {
+    std::vector<std::pair<std::string, std::string>> headers;
+};
+
+struct AuthTokenStage {
+    std::string header = "Authorization";
+    std::string token;
+    std::string token_env;  // Name of environment variable with the token, read at startup
+};
+
+struct RewriteUrlStage {
+    std::string from;
+    std::string to;
+    std::string path_from;
+    std::string path_to;
+};
+
+struct OriginFilterStage {
+    std::vector<std::string> allow;
+    std::vector<std::string> deny;
+};
+
+struct FilterHeadersStage {
+    std::vector<std::string> allow;
+    std::vector<std::string> deny;
+};
+
+struct TruncateBodyStage {
+    size_t max_bytes = 0;
+};
+
+struct ProjectStage {
+    std::vector<std::string> fields;  // Dot-separated paths
+};
+
+using RequestStageConfig = std::variant<SetHeadersStage, AuthTokenStage, RewriteUrlStage, OriginFilterStage>;
+using ResponseStageConfig = std::variant<FilterHeadersStage, TruncateBodyStage, ProjectStage>;
+
+struct RouteConfig {
+    std::string match;  // Url prefix, empty matches everything
+    std::vector<RequestStageConfig> pre;
+    std::vector<ResponseStageConfig> post;
+};
+
+struct Config {
+    std::vector<UpstreamConfig> upstreams;
+    RetryConfig retry;
+    CircuitBreakerConfig circuit_breaker;
+    SendQueueConfig send_queue;
+    DecoderConfig decoder;
+    PoolConfig pool;
+    DiskCacheConfig disk_cache;
+    SubscriptionConfig subscriptions;
+    SessionConfig sessions;
+    TracingConfig tracing;
+    AdminConfig admin;
+    AccessConfig access;
+    std::vector<RouteConfig> routes;
+};
+
+// Config file is a Json object, see README for the format
+Config ParseConfig(const std::string& data);
+Config LoadConfig(const std::string& path);
@@ -0,0 +1,171 @@
+#include "ConnectionPool.h"
+
+#include "Origin.h"
+
+#include <algorithm>
+#include <future>
+#include <iterator>
+
+constexpr size_t kMaxPooledOrigins = 1024;
+
+ConnectionPool::ConnectionPool(const PoolConfig& config, const std::vector<std::string>& known_origins,
+                               Connector connect, std::function<Clock::time_point()> now)
+    : config_(config)
+    , connect_(std::move(connect))
+    , now_(std::move(now)) {
+    for (const auto& url : known_origins) {
+        auto key = ParseOrigin(url).Key();
+        // Backends listed under several urls of one origin share its connections
+        const bool listed = std::any_of(begin(known_origins_), end(known_origins_),
+                                        [&key](const auto& origin) { return origin.key == key; });
+        if (!listed)
+            known_origins_.push_back({url, std::move(key)});
+    }
+    refiller_ = std::thread(&ConnectionPool::RefillLoop, this);
+}
+
+ConnectionPool::~ConnectionPool() {
+    {
+        auto lock = std::lock_guard(guard_);
+        stop_ = true;
+    }
+    stop_cv_.notify_all();
+    if (refiller_.joinable())
+        refiller_.join();
+}
+
+std::unique_ptr<HttpClient> ConnectionPool::Acquire(const std::string& origin, const std::string& address) {
+    std::unique_ptr<HttpClient> client;
+    IdleList stale;  // Closed after the lock is released
+
+    auto lock = std::lock_guard(guard_);
+    const auto it = idle_.find(origin);
+    if (it == idle_.end())
+        return nullptr;
+
+    auto& idle = it->second;
+    const auto expired_before = now_() - config_.idle_timeout;
+    while (!idle.empty() && !client) {
+        auto candidate = std::move(idle.back());
+        idle.pop_back();
+        if (candidate.since < expired_before) {
+            // The rest have been idle even longer
+            stale.push_back(std::move(candidate));
+            std::move(begin(idle), end(idle), back_inserter(stale));
+            idle.clear();
+        } else if (candidate.connection.address != address) {
+            // Host resolves elsewhere now
+            stale.push_back(std::move(candidate));
+        } else {
+            client = std::move(candidate.connection.client);
+        }
+    }
+    if (idle.empty())
+        idle_.erase(it);
+    return client;
+}
+
+bool ConnectionPool::Release(const std::string& origin, Connection connection) {
+    if (!connection.client)
+        return false;
+
+    auto lock = std::lock_guard(guard_);
+    auto it = idle_.find(origin);
+    if (it == idle_.end()) {
+        // Arbitrary client urls shouldn't grow the map without a bound
+        if (idle_.size() >= kMaxPooledOrigins)
+            return false;
+        it = idle_.emplace(origin, IdleList{}).first;
+    }
+    if (it->second.size() >= config_.max_idle)
+        return false;
+    it->second.push_back({std::move(connection), now_()});
+    return true;
+}
+
+bool ConnectionPool::IsWarm() const {
+    if (!warm_.load(std::memory_order_acquire))
+        return false;
+    auto lock = std::lock_guard(guard_);
+    return reached_.size() == known_origins_.size();
+}
+
+size_t ConnectionPool::Idle(const std::string& origin) const {
+    auto lock = std::lock_guard(guard_);
+    const auto it = idle_.find(origin);
+    return it == idle_.end() ? 0 : it->second.size();
+}
+
+std::vector<std::pair<std::string, size_t>> ConnectionPool::IdleCounts() const {
+    auto lock = std::lock_guard(guard_);
+    std::vector<std::pair<std::string, size_t>> counts;
+    for (const auto& [origin, idle] : idle_)
+        counts.emplace_back(origin, idle.size());
+    return counts;
+}
+
+void ConnectionPool::WarmUp() {
+    // Origins are warmed in parallel, so it takes as long as the slowest one
+    std::vector<std::future<void>> warming;
+    for (const auto& origin : known_origins_)
+        warming.push_back(std::async(std::launch::async, [this, &origin] { Refill(origin, config_.warm_connections); }));
+    for (auto& origin : warming)
+        origin.wait();
+    warm_.store(true, std::memory_order_release);
+}
+
+void ConnectionPool::Refill(const KnownOrigin& origin, size_t target) {
+    while (Idle(origin.key) < target) {
+        {
+            auto lock = std::lock_guard(guard_);
+            if (stop_)
+                return;
+        }
+
+        std::optional<Connection> connection;
+        try {
+            connection = connect_(origin.url);
+        } catch (const std::exception&) {
+        }
+        // Unreachable origin is tried again on the next round
+        if (!connection)
+            return;
+        {
+            auto lock = std::lock_guard(guard_);
+            reached_.insert(origin.key);
+        }
+        if (!Release(origin.key, std::move(*connection)))
+            return;
+    }
+}
+
+void ConnectionPool::Expire() {
+    IdleList stale;  // Closed after the lock is released
+
+    auto lock = std::lock_guard(guard_);
+    const auto expired_before = now_() - config_.idle_timeout;
+    for (auto it = idle_.begin(); it != idle_.end();) {
+        auto& idle = it->second;
+        while (!idle.empty() && idle.front().since < expired_before) {
+            stale.push_back(std::move(idle.front()));
+            idle.pop_front();
+        }
+        it = idle.empty() ? idle_.erase(it) : std::next(it);
+    }
+}
+
+void ConnectionPool::RefillLoop() {
+    WarmUp();
+
+    while (true) {
+        {
+            auto lock = std::unique_lock(guard_);
+            if (stop_cv_.wait_for(lock, config_.refill_interval, [this] { return stop_; }))
+                return;
+        }
+
+        Expire();
+        for (const auto& origin : known_origins_)
+            Refill(origin, config_.min_idle);
+    }
+}
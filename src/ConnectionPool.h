@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Config.h"
+#include "HttpClient.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Idle keep-alive connections per origin, so calls reuse them instead of paying for DNS, TCP and TLS every time.
+// Known origins (configured ones and backends of upstream groups) are warmed by a background thread at startup,
+// then refilled to min_idle. Any origin's connection is kept after a call, up to max_idle, for idle_timeout
+class ConnectionPool final {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Connection {
+        std::string address;  // Resolved address connection was made to, empty for IP literals
+        std::unique_ptr<HttpClient> client;
+    };
+
+    // Resolves origin's host and opens a connection to it, or returns nothing if it couldn't
+    using Connector = std::function<std::optional<Connection>(const std::string& url)>;
+
+    ConnectionPool(const PoolConfig& config, const std::vector<std::string>& known_origins, Connector connect,
+                   std::function<Clock::time_point()> now = Clock::now);
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool(ConnectionPool&&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(ConnectionPool&&) = delete;
+
+    ~ConnectionPool();
+
+    // Most recently used idle connection to origin (Origin::Key()) made to this address, or nullptr
+    std::unique_ptr<HttpClient> Acquire(const std::string& origin, const std::string& address);
+    // Puts connection back after a call that completed, so it's left at a response boundary.
+    // Returns false if it was closed instead, because the pool is full
+    bool Release(const std::string& origin, Connection connection);
+
+    // Startup warm-up is over and a connection to every known origin succeeded, then or on a later refill
+    bool IsWarm() const;
+    size_t Idle(const std::string& origin) const;
+    std::vector<std::pair<std::string, size_t>> IdleCounts() const;
+
+private:
+    struct IdleConnection {
+        Connection connection;
+        Clock::time_point since;
+    };
+    using IdleList = std::deque<IdleConnection>;  // Oldest first
+
+    struct KnownOrigin {
+        std::string url;
+        std::string key;
+    };
+
+    void WarmUp();
+    void Refill(const KnownOrigin& origin, size_t target);
+    void Expire();
+    void RefillLoop();
+
+    PoolConfig config_;
+    std::vector<KnownOrigin> known_origins_;
+    Connector connect_;
+    std::function<Clock::time_point()> now_;
+
+    mutable std::mutex guard_;
+    std::unordered_map<std::string, IdleList> idle_;
+    std::unordered_set<std::string> reached_;  // Known origins connected to at least once
+    std::condition_variable stop_cv_;
+    bool stop_ = false;
+    std::atomic<bool> warm_{false};
+    std::thread refiller_;
+};
@@ -0,0 +1,408 @@
+#include "DiskCache.h"
+
+#include "Ascii.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+constexpr std::string_view kFileMagic = "WSPCACHE";
+constexpr uint32_t kFileVersion = 1;
+constexpr size_t kFileHeaderSize = 16;
+constexpr uint32_t kRecordMagic = 0x52435057;
+constexpr size_t kMinGrowBytes = 64 * 1024;
+
+namespace {
+
+// Written as is, so the file is only readable on machines of the same byte order
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t status;
+    uint64_t key_hash;
+    int64_t expires_ms;  // Since Unix epoch
+    uint64_t body_size;
+    uint32_t key_size;
+    uint32_t headers_size;
+};
+static_assert(sizeof(RecordHeader) == 40);
+
+// FNV-1a. Unlike std::hash it's the same in every build, as it's kept in the file
+uint64_t HashKey(std::string_view key) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const auto c : key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string FileHeader() {
+    std::string header(kFileMagic);
+    header.resize(kFileHeaderSize, '\0');
+    std::memcpy(header.data() + kFileMagic.size(), &kFileVersion, sizeof(kFileVersion));
+    return header;
+}
+
+std::optional<RecordHeader> ReadRecordHeader(std::string_view data, size_t offset) {
+    if (offset > data.size() || data.size() - offset < sizeof(RecordHeader))
+        return {};
+    RecordHeader header;
+    std::memcpy(&header, data.data() + offset, sizeof(header));
+    if (header.magic != kRecordMagic)
+        return {};
+    return header;
+}
+
+uint64_t RecordSize(const RecordHeader& header) {
+    return sizeof(RecordHeader) + header.key_size + header.headers_size + header.body_size;
+}
+
+// Header names and values can't hold NUL, so it separates them
+std::string SerializeHeaders(const HeaderList& headers) {
+    std::string serialized;
+    for (size_t i = 0; i < headers.Size(); ++i) {
+        serialized += headers[i].name;
+        serialized += '\0';
+        serialized += headers[i].value;
+        serialized += '\0';
+    }
+    return serialized;
+}
+
+void ParseHeaders(std::string_view serialized, HeaderList& headers) {
+    while (!serialized.empty()) {
+        const auto name_end = serialized.find('\0');
+        const auto value_end = serialized.find('\0', name_end + 1);
+        if (name_end == std::string_view::npos || value_end == std::string_view::npos)
+            return;
+        headers.Add(std::string(serialized.substr(0, name_end)),
+                    std::string(serialized.substr(name_end + 1, value_end - name_end - 1)));
+        serialized.remove_prefix(value_end + 1);
+    }
+}
+
+std::string_view Trim(std::string_view str) {
+    while (!str.empty() && str.front() == ' ')
+        str.remove_prefix(1);
+    while (!str.empty() && str.back() == ' ')
+        str.remove_suffix(1);
+    return str;
+}
+
+// How long response may be kept in a shared cache: ttl, shortened by max-age (s-maxage wins over it).
+// Nothing if it mustn't be kept at all
+std::optional<std::chrono::milliseconds> Lifetime(const HeaderList& headers, std::chrono::milliseconds ttl) {
+    // Key is url and path only, so a response that depends on request headers would reach clients that sent other
+    // ones. Cookies set for one client mustn't be replayed to all of them
+    if (headers.Find("Vary") || headers.Find(HeaderId::SetCookie))
+        return {};
+    const auto* cache_control = headers.Find(HeaderId::CacheControl);
+    if (!cache_control)
+        return ttl;
+
+    std::optional<std::chrono::seconds> max_age;
+    std::optional<std::chrono::seconds> shared_max_age;
+    std::string_view directives = cache_control->value;
+    while (!directives.empty()) {
+        const auto comma = directives.find(',');
+        const auto directive = Trim(directives.substr(0, comma));
+        directives.remove_prefix(comma == std::string_view::npos ? directives.size() : comma + 1);
+
+        if (EqualsIgnoreCase(directive, "no-store") || EqualsIgnoreCase(directive, "no-cache") ||
+            EqualsIgnoreCase(directive, "private"))
+            return {};
+        const auto equals = directive.find('=');
+        if (equals == std::string_view::npos)
+            continue;
+        const auto name = directive.substr(0, equals);
+        const bool shared = EqualsIgnoreCase(name, "s-maxage");
+        if (!shared && !EqualsIgnoreCase(name, "max-age"))
+            continue;
+        auto& age = shared ? shared_max_age : max_age;
+        try {
+            age = std::chrono::seconds(std::stoll(std::string(directive.substr(equals + 1))));
+        } catch (const std::exception&) {
+            return {};  // Malformed, kept by no one
+        }
+    }
+
+    const auto age = shared_max_age ? shared_max_age : max_age;
+    if (!age)
+        return ttl;
+    if (age->count() <= 0)
+        return {};
+    return std::min(ttl, std::chrono::duration_cast<std::chrono::milliseconds>(*age));
+}
+
+}  // namespace
+
+DiskCache::DiskCache(const DiskCacheConfig& config, std::function<Clock::time_point()> now)
+    : config_(config)
+    , now_(std::move(now)) {
+    Load();
+}
+
+DiskCache::~DiskCache() {
+    // Space grown ahead isn't left on disk. Loading would stop at it anyway, it's all zeros
+    std::error_code error;
+    std::filesystem::resize_file(config_.path, file_size_, error);
+}
+
+std::optional<std::string> DiskCache::KeyOf(const Request& request) const {
+    if (request.GetMethod() != Method::METHOD_GET)
+        return {};
+    // Entries are shared by all clients, so responses to credentialed requests aren't kept
+    const auto& headers = request.HeaderFields();
+    if (headers.Find(HeaderId::Authorization) || headers.Find(HeaderId::Cookie))
+        return {};
+
+    auto key = request.Url() + request.Path();
+    const auto& match = config_.match;
+    const auto matches = [&key](const std::string& prefix) { return key.compare(0, prefix.size(), prefix) == 0; };
+    if (!match.empty() && std::none_of(begin(match), end(match), matches))
+        return {};
+    return key;
+}
+
+std::optional<Response> DiskCache::Lookup(const std::string& key) {
+    const auto key_hash = HashKey(key);
+    Entry entry;
+    std::shared_ptr<const MappedFile> mapping;
+    {
+        auto lock = std::lock_guard(guard_);
+        const auto it = index_.find(key_hash);
+        if (it == end(index_))
+            return {};
+        if (it->second.expires_ms <= NowMs()) {
+            index_.erase(it);
+            return {};
+        }
+        entry = it->second;
+        mapping = mapping_;
+    }
+
+    // Mapping may be behind the file if it couldn't be renewed
+    const auto data = mapping ? mapping->Data() : std::string_view();
+    const auto header = ReadRecordHeader(data, entry.offset);
+    if (!header || entry.offset + entry.size > data.size())
+        return {};
+    auto pos = entry.offset + sizeof(RecordHeader);
+    if (data.substr(pos, header->key_size) != key)
+        return {};  // Other key with the same hash
+    pos += header->key_size;
+
+    Response response{static_cast<int>(header->status), {}};
+    ParseHeaders(data.substr(pos, header->headers_size), response.headers);
+    pos += header->headers_size;
+    response.shared_body = {std::move(mapping), data.substr(pos, header->body_size)};
+    return response;
+}
+
+bool DiskCache::Store(const std::string& key, const Response& response) {
+    if (response.status != 200)
+        return false;
+    const auto lifetime = Lifetime(response.headers, config_.ttl);
+    if (!lifetime)
+        return false;
+
+    const auto body = response.Body();
+    const auto headers = SerializeHeaders(response.headers);
+    const auto record_size = sizeof(RecordHeader) + key.size() + headers.size() + body.size();
+    if (record_size > config_.max_entry_bytes)
+        return false;
+
+    const RecordHeader header{kRecordMagic,
+                              static_cast<uint32_t>(response.status),
+                              HashKey(key),
+                              NowMs() + lifetime->count(),
+                              body.size(),
+                              static_cast<uint32_t>(key.size()),
+                              static_cast<uint32_t>(headers.size())};
+    size_t offset = 0;
+    {
+        auto lock = std::unique_lock(guard_);
+        if (file_size_ + record_size > config_.max_bytes) {
+            // Compaction rewrites the file, records being written have to land first
+            written_cv_.wait(lock, [this] { return writing_ == 0; });
+            if (file_size_ + record_size > config_.max_bytes)
+                Compact(record_size);
+        }
+        if (file_size_ + record_size > config_.max_bytes || !Grow(file_size_ + record_size))
+            return false;
+        offset = file_size_;
+        file_size_ += record_size;
+        ++writing_;
+    }
+
+    // Written piece by piece, so body isn't copied. Header goes last: a record cut short has zeros where its magic
+    // would be, and loading stops at it
+    std::ofstream file(config_.path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(static_cast<std::streamoff>(offset + sizeof(header)));
+    file.write(key.data(), static_cast<std::streamsize>(key.size()));
+    file.write(headers.data(), static_cast<std::streamsize>(headers.size()));
+    file.write(body.data(), static_cast<std::streamsize>(body.size()));
+    file.flush();
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.flush();
+    const bool written = static_cast<bool>(file);
+
+    {
+        auto lock = std::lock_guard(guard_);
+        --writing_;
+        // Record of the same key reserved later may have been written first, the later one wins as in Load()
+        const auto it = index_.find(header.key_hash);
+        if (written && (it == end(index_) || it->second.offset < offset))
+            index_[header.key_hash] = {offset, record_size, header.expires_ms};
+    }
+    written_cv_.notify_all();
+    return written;
+}
+
+size_t DiskCache::Entries() const {
+    auto lock = std::lock_guard(guard_);
+    return index_.size();
+}
+
+size_t DiskCache::FileBytes() const {
+    auto lock = std::lock_guard(guard_);
+    return file_size_;
+}
+
+void DiskCache::Load() {
+    namespace fs = std::filesystem;
+    std::error_code error;
+    const auto size = fs::exists(config_.path, error) ? fs::file_size(config_.path, error) : 0;
+
+    // Only record headers are read, every one is at the start of its record and tells where the next one is
+    size_t offset = 0;
+    if (!error && size >= kFileHeaderSize) {
+        const auto mapping = std::make_unique<MappedFile>(config_.path, size);
+        const auto data = mapping->Data();
+        if (data.substr(0, kFileHeaderSize) == FileHeader()) {
+            offset = kFileHeaderSize;
+            const auto now = NowMs();
+            while (const auto header = ReadRecordHeader(data, offset)) {
+                // Body size is checked alone first, so a corrupt one can't wrap the sum around
+                if (header->body_size > data.size() - offset)
+                    break;
+                const auto record_size = RecordSize(*header);
+                if (record_size > data.size() - offset)
+                    break;
+                // Later record replaces earlier ones of the same key, even if it has expired itself
+                if (header->expires_ms > now)
+                    index_[header->key_hash] = {offset, record_size, header->expires_ms};
+                else
+                    index_.erase(header->key_hash);
+                offset += record_size;
+            }
+        }
+    }
+
+    if (offset == 0) {
+        // New, foreign or unreadable file is started over
+        std::ofstream file(config_.path, std::ios::binary | std::ios::trunc);
+        file << FileHeader();
+        if (!file)
+            throw std::runtime_error("DiskCache(): can't create " + config_.path);
+        offset = kFileHeaderSize;
+    } else if (offset < size) {
+        // Tail of a record that was being written when process stopped
+        fs::resize_file(config_.path, offset, error);
+        if (error)
+            throw std::runtime_error("DiskCache(): can't truncate " + config_.path + ": " + error.message());
+    }
+
+    if (!std::ofstream(config_.path, std::ios::binary | std::ios::app))
+        throw std::runtime_error("DiskCache(): can't open " + config_.path);
+    file_size_ = offset;
+    Grow(file_size_);
+}
+
+void DiskCache::Compact(size_t incoming) {
+    namespace fs = std::filesystem;
+    if (!mapping_)
+        return;
+
+    // Newest live records are kept, leaving a quarter of max_bytes free so the next stores don't compact again
+    const auto now = NowMs();
+    std::vector<std::pair<uint64_t, Entry>> live;
+    for (const auto& [key_hash, entry] : index_) {
+        if (entry.expires_ms > now)
+            live.emplace_back(key_hash, entry);
+    }
+    std::sort(begin(live), end(live), [](const auto& a, const auto& b) { return a.second.offset > b.second.offset; });
+
+    const auto budget = config_.max_bytes / 4 * 3;
+    size_t used = kFileHeaderSize + incoming;
+    std::vector<std::pair<uint64_t, Entry>> kept;
+    for (const auto& record : live) {
+        if (used + record.second.size <= budget) {
+            used += record.second.size;
+            kept.push_back(record);
+        }
+    }
+    // Same order as before, so a later record still replaces an earlier one when the file is loaded
+    std::sort(begin(kept), end(kept), [](const auto& a, const auto& b) { return a.second.offset < b.second.offset; });
+
+    const auto compacted_path = config_.path + ".compact";
+    const auto data = mapping_->Data();
+    std::unordered_map<uint64_t, Entry> index;
+    size_t offset = kFileHeaderSize;
+    {
+        std::ofstream compacted(compacted_path, std::ios::binary | std::ios::trunc);
+        compacted << FileHeader();
+        for (const auto& [key_hash, entry] : kept) {
+            if (entry.offset + entry.size > data.size())
+                continue;
+            compacted.write(data.data() + entry.offset, static_cast<std::streamsize>(entry.size));
+            index[key_hash] = {offset, entry.size, entry.expires_ms};
+            offset += entry.size;
+        }
+        compacted.flush();
+        if (!compacted) {
+            std::error_code error;
+            fs::remove(compacted_path, error);
+            return;
+        }
+    }
+
+    // Mapping stays valid for hits being sent, the replaced file goes away with the last of them
+    std::error_code error;
+    fs::rename(compacted_path, config_.path, error);
+    if (error) {
+        fs::remove(compacted_path, error);
+        return;
+    }
+    index_ = std::move(index);
+    file_size_ = offset;
+    mapping_.reset();
+    Grow(file_size_);
+}
+
+bool DiskCache::Grow(size_t end) {
+    if (mapping_ && mapping_->Size() >= end)
+        return true;
+
+    // Doubled, so a run of stores remaps a few times rather than on each of them
+    const auto current = mapping_ ? mapping_->Size() : 0;
+    const auto size = std::min(std::max({end, current * 2, kMinGrowBytes}), std::max(end, config_.max_bytes));
+    std::error_code error;
+    if (std::filesystem::file_size(config_.path, error) < size && !error)
+        std::filesystem::resize_file(config_.path, size, error);
+    if (error)
+        return false;
+    try {
+        mapping_ = std::make_shared<const MappedFile>(config_.path, size);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+int64_t DiskCache::NowMs() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(now_().time_since_epoch()).count();
+}
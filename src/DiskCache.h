@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Config.h"
+#include "MappedFile.h"
+#include "Requests.h"
+#include "Response.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+// Responses to GET requests kept in an append-only file, so they survive restarts.
+// Records are appended as they come and read through a mapping of the file: a hit's body is a view into it, not a
+// copy. Space for a record is reserved under the lock and written outside it, so a big store doesn't hold up lookups.
+// The file is grown and remapped in doubling steps, not on every store, and its unused tail is cut off on close.
+// Index in memory holds offsets only, it's rebuilt at startup from record headers without reading bodies.
+// Replaced and expired records stay in the file until it would grow above max_bytes, then the newest live ones are
+// copied to a new file that replaces it
+class DiskCache final {
+public:
+    // Expiry is kept across restarts, so it's wall time
+    using Clock = std::chrono::system_clock;
+
+    // Throws if file can't be opened
+    explicit DiskCache(const DiskCacheConfig& config, std::function<Clock::time_point()> now = Clock::now);
+    DiskCache(const DiskCache&) = delete;
+    DiskCache(DiskCache&&) = delete;
+    DiskCache& operator=(const DiskCache&) = delete;
+    DiskCache& operator=(DiskCache&&) = delete;
+
+    ~DiskCache();
+
+    // Key for request if its response may be cached: GET to a matching url, without credentials
+    std::optional<std::string> KeyOf(const Request& request) const;
+    // Fresh response for key. Its shared body keeps the mapping alive, even past compaction
+    std::optional<Response> Lookup(const std::string& key);
+    // Keeps successful response unless Cache-Control forbids it or it's too big. False if it wasn't kept
+    bool Store(const std::string& key, const Response& response);
+
+    size_t Entries() const;
+    size_t FileBytes() const;
+
+private:
+    struct Entry {
+        uint64_t offset;
+        uint64_t size;  // Whole record
+        int64_t expires_ms;
+    };
+
+    void Load();
+    void Compact(size_t incoming);
+    // Makes the file and its mapping cover the first end bytes. False if it couldn't
+    bool Grow(size_t end);
+    int64_t NowMs() const;
+
+    DiskCacheConfig config_;
+    std::function<Clock::time_point()> now_;
+
+    mutable std::mutex guard_;
+    std::unordered_map<uint64_t, Entry> index_;  // By key hash, key itself is checked in the record
+    size_t file_size_ = 0;                       // End of the records, written or reserved
+    size_t writing_ = 0;                         // Records reserved and being written outside the lock
+    std::condition_variable written_cv_;
+    std::shared_ptr<const MappedFile> mapping_;  // Whole file, replaced when it grows, hits keep older ones
+};
@@ -0,0 +1,457 @@
+#include "Dispatcher.h"
+
+#include "HttpClient.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// Lets hedging abort the losing call, which may still be connecting
+class CallCanceller final {
+public:
+    // Returns false if call was cancelled before it started
+    bool Attach(HttpClient& http_client) {
+        auto lock = std::lock_guard(guard_);
+        http_client_ = &http_client;
+        return !cancelled_;
+    }
+
+    void Detach() {
+        auto lock = std::lock_guard(guard_);
+        http_client_ = nullptr;
+    }
+
+    bool IsCancelled() {
+        auto lock = std::lock_guard(guard_);
+        return cancelled_;
+    }
+
+    void Cancel() {
+        auto lock = std::lock_guard(guard_);
+        cancelled_ = true;
+        if (http_client_)
+            http_client_->Stop();
+    }
+
+private:
+    std::mutex guard_;
+    HttpClient* http_client_ = nullptr;
+    bool cancelled_ = false;
+};
+
+namespace {
+
+// Session's cookies go along with whatever client sent itself
+Request WithSessionCookies(const Request& request, const std::string& url, Session& session) {
+    auto with_cookies = request;
+    if (auto cookies = session.CookieHeader(url, request.Path()); !cookies.empty()) {
+        auto& headers = with_cookies.MutableHeaderFields();
+        if (const auto* sent = headers.Find(HeaderId::Cookie))
+            cookies = sent->value + "; " + cookies;
+        headers.Set("Cookie", std::move(cookies));
+    }
+    return with_cookies;
+}
+
+Response CallUpstream(HttpClient& http_client, const Request& request, CallCanceller* canceller) {
+    if (!canceller)
+        return request.Accept(http_client);
+
+    if (!canceller->Attach(http_client)) {
+        canceller->Detach();
+        return {static_cast<int>(httplib::Error::Canceled), "Failed"};
+    }
+    try {
+        auto response = request.Accept(http_client);
+        canceller->Detach();
+        return response;
+    } catch (...) {
+        canceller->Detach();
+        throw;
+    }
+}
+
+std::unique_ptr<HttpClient> MakeClient(const std::string& url, const std::string& address) {
+    return address.empty() ? std::make_unique<HttpClient>(url) : std::make_unique<HttpClient>(url, address);
+}
+
+// Latencies of an upstream's backends are tracked together, as hedge delay is needed before one is picked
+std::string LatencyKey(const std::string& url) {
+    const auto upstream = UpstreamName(url);
+    return upstream ? "upstream://" + *upstream : ParseOrigin(url).Key();
+}
+
+// Origins worth keeping connections to before any request comes
+std::vector<std::string> KnownOrigins(const Config& config) {
+    auto origins = config.pool.origins;
+    for (const auto& upstream : config.upstreams)
+        origins.insert(end(origins), begin(upstream.backends), end(upstream.backends));
+    return origins;
+}
+
+std::vector<std::string> OriginKeys(const std::vector<std::string>& urls) {
+    std::vector<std::string> keys;
+    for (const auto& url : urls)
+        keys.push_back(ParseOrigin(url).Key());
+    return keys;
+}
+
+}  // namespace
+
+Dispatcher::Dispatcher(const Config& config, MetricsRegistry& metrics)
+    : retry_config_(config.retry)
+    , breaker_config_(config.circuit_breaker)
+    , resolver_(std::make_unique<SystemResolverSource>())
+    , upstreams_(config.upstreams)
+    , retry_budget_(config.retry)
+    , cache_(config.disk_cache.enabled ? std::make_unique<DiskCache>(config.disk_cache) : nullptr)
+    , breakers_(config.circuit_breaker,
+                config.circuit_breaker.enabled ? OriginKeys(KnownOrigins(config)) : std::vector<std::string>{})
+    , requests_total_(metrics.AddCounter("websockproxy_requests_total", "Requests dispatched"))
+    , retries_total_(metrics.AddCounter("websockproxy_retries_total", "Retried upstream calls"))
+    , hedges_total_(metrics.AddCounter("websockproxy_hedges_total", "Hedged upstream calls"))
+    , connections_opened_total_(metrics.AddCounter("websockproxy_connections_opened_total", "Upstream connections opened"))
+    , connections_reused_total_(
+          metrics.AddCounter("websockproxy_connections_reused_total", "Upstream calls made on pooled connections"))
+    , cache_hits_total_(metrics.AddCounter("websockproxy_cache_hits_total", "GET requests served from disk cache"))
+    , cache_misses_total_(
+          metrics.AddCounter("websockproxy_cache_misses_total", "Cacheable GET requests sent upstream"))
+    , track_calls_(config.admin.enabled)
+    , pool_(config.pool, KnownOrigins(config),
+            [this, warm_path = config.pool.warm_path](const std::string& url) { return Connect(url, warm_path); })
+    , hedge_executor_(config.retry.hedging.enabled ? config.retry.hedging.max_concurrent : 0) {
+    metrics.AddCollector([this](std::ostream& out) { CollectMetrics(out); });
+}
+
+Response Dispatcher::Dispatch(const Request& request, Session* session) {
+    // Session's cookies are added per call, so its requests don't go through the cache
+    if (session)
+        return DispatchUpstream(request, session);
+    return DispatchCached(request);
+}
+
+void Dispatcher::EndSession(Session& session) {
+    for (auto& [origin, connection] : session.Close())
+        pool_.Release(origin, std::move(connection));
+}
+
+Response Dispatcher::DispatchCached(const Request& request) {
+    const auto cache_key = cache_ ? cache_->KeyOf(request) : std::nullopt;
+    if (!cache_key)
+        return DispatchUpstream(request, nullptr);
+
+    if (auto cached = cache_->Lookup(*cache_key)) {
+        cache_hits_total_.Increment();
+        return std::move(*cached);
+    }
+    cache_misses_total_.Increment();
+    auto response = DispatchUpstream(request, nullptr);
+    cache_->Store(*cache_key, response);
+    return response;
+}
+
+Response Dispatcher::DispatchUpstream(const Request& request, Session* session) {
+    requests_total_.Increment();
+    retry_budget_.Deposit();
+
+    if (!IsRetryable(request))
+        return Attempt(request, nullptr, session);
+
+    Response response;
+    for (int attempt = 0;; ++attempt) {
+        const auto hedge_delay = HedgeDelay(request.Url());
+        response = hedge_delay ? AttemptHedged(request, *hedge_delay, session) : Attempt(request, nullptr, session);
+
+        if (attempt + 1 >= retry_config_.max_attempts || !IsRetryableStatus(response.status) ||
+            !retry_budget_.TryWithdraw())
+            break;
+        retries_total_.Increment();
+
+        std::this_thread::sleep_for(BackoffDelay(attempt, retry_config_.base_backoff, retry_config_.max_backoff));
+    }
+    return response;
+}
+
+bool Dispatcher::IsWarm() const {
+    return pool_.IsWarm();
+}
+
+std::vector<UpstreamCall> Dispatcher::UpstreamCalls() const {
+    std::vector<UpstreamCall> calls;
+    for (auto& [id, call] : upstream_calls_.Snapshot())
+        calls.push_back(std::move(call));
+    return calls;
+}
+
+std::vector<OriginOccupancy> Dispatcher::PoolOccupancy() const {
+    std::map<std::string, OriginOccupancy> by_origin;
+    for (const auto& [origin, idle] : pool_.IdleCounts())
+        by_origin[origin].idle = idle;
+    for (const auto& [id, call] : upstream_calls_.Snapshot())
+        ++by_origin[call.origin].in_use;
+
+    std::vector<OriginOccupancy> occupancy;
+    for (auto& [origin, counts] : by_origin) {
+        counts.origin = origin;
+        occupancy.push_back(std::move(counts));
+    }
+    return occupancy;
+}
+
+bool Dispatcher::IsRetryable(const Request& request) const {
+    const auto& methods = retry_config_.methods;
+    return std::find(begin(methods), end(methods), request.GetMethod()) != end(methods);
+}
+
+Response Dispatcher::Attempt(const Request& request, CallCanceller* canceller, Session* session) {
+    const auto started = std::chrono::steady_clock::now();
+
+    Response response;
+    const auto upstream = UpstreamName(request.Url());
+    if (!upstream) {
+        response = ForwardTo(request.Url(), request, canceller, session);
+    } else {
+        auto* group = upstreams_.Find(*upstream);
+        if (!group)
+            throw std::runtime_error("Dispatch(): unknown upstream " + *upstream);
+
+        const auto backend = session ? session->Backend(*upstream) : std::nullopt;
+        auto lease = backend ? group->PickPreferred(*backend) : group->Pick();
+        if (!lease)
+            return {static_cast<int>(httplib::Error::Connection), "Failed"};
+        if (session)
+            session->SetBackend(*upstream, lease->Url());
+
+        response = ForwardTo(lease->Url(), request, canceller, session);
+        // Aborted hedge loser or open circuit say nothing new about backend health
+        if ((!canceller || !canceller->IsCancelled()) && !IsProxyStatus(response.status))
+            lease->Complete(response);
+    }
+
+    if (retry_config_.hedging.enabled && !IsUpstreamFailure(response.status))
+        RecordLatency(request.Url(), std::chrono::steady_clock::now() - started);
+    return response;
+}
+
+Response Dispatcher::AttemptHedged(const Request& request, std::chrono::milliseconds delay, Session* session) {
+    struct Race {
+        std::mutex guard;
+        std::condition_variable done_cv;
+        bool primary_done = false;
+        bool hedge_done = false;
+        std::optional<Response> hedge_result;
+    } race;
+    CallCanceller cancellers[2];
+
+    const auto succeeded = [](const std::optional<Response>& result) {
+        return result && !IsUpstreamFailure(result->status);
+    };
+
+    // Hedge waits on an executor thread for the primary call, which runs here, to take longer than delay
+    auto* trace = Trace::Current();
+    const bool posted = hedge_executor_.TryPost([&, trace] {
+        TraceScope trace_scope(trace);
+        bool launch = false;
+        {
+            auto lock = std::unique_lock(race.guard);
+            launch = !race.done_cv.wait_for(lock, delay, [&race] { return race.primary_done; });
+        }
+
+        // Failed hedge doesn't matter, primary's outcome is used then
+        std::optional<Response> result;
+        if (launch && retry_budget_.TryWithdraw()) {
+            hedges_total_.Increment();
+            try {
+                result = Attempt(request, &cancellers[1], session);
+            } catch (...) {
+            }
+            if (succeeded(result))
+                cancellers[0].Cancel();
+        }
+
+        auto lock = std::lock_guard(race.guard);
+        race.hedge_result = std::move(result);
+        race.hedge_done = true;
+        race.done_cv.notify_all();
+    });
+    if (!posted)
+        return Attempt(request, nullptr, session);
+
+    std::optional<Response> primary;
+    std::exception_ptr primary_error;
+    try {
+        primary = Attempt(request, &cancellers[0], session);
+    } catch (...) {
+        primary_error = std::current_exception();
+    }
+
+    {
+        auto lock = std::lock_guard(race.guard);
+        race.primary_done = true;
+        race.done_cv.notify_all();
+    }
+    if (succeeded(primary))
+        cancellers[1].Cancel();
+
+    // Hedge uses request and race, it's waited for even when it lost
+    auto lock = std::unique_lock(race.guard);
+    race.done_cv.wait(lock, [&race] { return race.hedge_done; });
+    if (succeeded(race.hedge_result) && !succeeded(primary))
+        return std::move(*race.hedge_result);
+    if (primary_error)
+        std::rethrow_exception(primary_error);
+    return std::move(*primary);
+}
+
+Response Dispatcher::ForwardTo(const std::string& url, const Request& request, CallCanceller* canceller,
+                               Session* session) {
+    const auto origin = ParseOrigin(url);
+    if (!breaker_config_.enabled)
+        return CallOrigin(url, origin, request, canceller, session);
+
+    std::shared_ptr<CircuitBreaker> holder;
+    auto* breaker = breakers_.Find(origin.Key(), holder);
+    if (!breaker)
+        return CallOrigin(url, origin, request, canceller, session);
+    if (!breaker->Allow())
+        return {static_cast<int>(ProxyStatus::CircuitOpen), "Circuit open"};
+
+    const auto started = std::chrono::steady_clock::now();
+    Response response;
+    try {
+        response = CallOrigin(url, origin, request, canceller, session);
+    } catch (...) {
+        breaker->Abandon();
+        throw;
+    }
+
+    if (canceller && canceller->IsCancelled()) {
+        breaker->Abandon();
+    } else {
+        const auto elapsed = std::chrono::steady_clock::now() - started;
+        breaker->Record(IsUpstreamFailure(response.status),
+                        std::chrono::duration_cast<std::chrono::microseconds>(elapsed));
+    }
+    return response;
+}
+
+Response Dispatcher::CallOrigin(const std::string& url, const Origin& origin, const Request& request,
+                                CallCanceller* canceller, Session* session) {
+    const auto key = origin.Key();
+    // Pinned connection keeps the address it was made to
+    auto connection = session ? session->TakeConnection(key) : std::nullopt;
+    if (connection) {
+        connections_reused_total_.Increment();
+    } else {
+        connection.emplace();
+        if (!origin.IsIpLiteral()) {
+            auto resolved = resolver_.Lookup(origin.host, origin.port);
+            if (!resolved)
+                return {static_cast<int>(httplib::Error::Connection), "Failed"};
+            connection->address = std::move(*resolved);
+        }
+
+        connection->client = pool_.Acquire(key, connection->address);
+        if (connection->client) {
+            connections_reused_total_.Increment();
+        } else {
+            connection->client = MakeClient(url, connection->address);
+            connections_opened_total_.Increment();
+        }
+    }
+    Trace::MarkCurrent(TraceStage::Connected);
+
+    std::optional<LiveRegistry<UpstreamCall>::Scoped> in_flight;
+    if (track_calls_)
+        in_flight.emplace(upstream_calls_, ++next_call_id_,
+                          UpstreamCall{key, request.GetMethod(), request.Path(), std::chrono::steady_clock::now()});
+    // Jar is keyed by the url actually called, so each backend of a group gets its own cookies
+    auto response = session ? CallUpstream(*connection->client, WithSessionCookies(request, url, *session), canceller)
+                            : CallUpstream(*connection->client, request, canceller);
+    in_flight.reset();
+    if (session)
+        session->StoreCookies(url, request.Path(), response.headers);
+    // Failed or stopped call may have left connection in the middle of a response
+    if (response.status >= 100 && (!canceller || !canceller->IsCancelled()))
+        KeepConnection(key, std::move(*connection), session);
+    return response;
+}
+
+void Dispatcher::KeepConnection(const std::string& origin, ConnectionPool::Connection connection, Session* session) {
+    if (!session) {
+        pool_.Release(origin, std::move(connection));
+        return;
+    }
+    // Connection the session has no room for goes to the pool
+    if (auto displaced = session->PinConnection(origin, std::move(connection)))
+        pool_.Release(displaced->first, std::move(displaced->second));
+}
+
+std::optional<ConnectionPool::Connection> Dispatcher::Connect(const std::string& url, const std::string& warm_path) {
+    const auto origin = ParseOrigin(url);
+    ConnectionPool::Connection connection;
+    if (!origin.IsIpLiteral()) {
+        auto resolved = resolver_.Lookup(origin.host, origin.port);
+        if (!resolved)
+            return {};
+        connection.address = std::move(*resolved);
+    }
+
+    connection.client = MakeClient(url, connection.address);
+    if (!connection.client->Warm(warm_path))
+        return {};
+    connections_opened_total_.Increment();
+    return connection;
+}
+
+std::optional<std::chrono::milliseconds> Dispatcher::HedgeDelay(const std::string& url) {
+    const auto& hedging = retry_config_.hedging;
+    if (!hedging.enabled)
+        return {};
+
+    const auto latency = latency_.Get(LatencyKey(url));
+    if (latency->Count() < hedging.min_samples)
+        return {};
+
+    const auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(latency->Percentile(hedging.percentile));
+    return std::max(delay, hedging.min_delay);
+}
+
+void Dispatcher::RecordLatency(const std::string& url, std::chrono::steady_clock::duration elapsed) {
+    latency_.Get(LatencyKey(url))->Record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed));
+}
+
+void Dispatcher::CollectMetrics(std::ostream& out) {
+    if (cache_) {
+        WriteMetricHeader(out, "websockproxy_cache_entries", "Responses in disk cache", "gauge");
+        out << "websockproxy_cache_entries " << cache_->Entries() << "\n";
+        WriteMetricHeader(out, "websockproxy_cache_file_bytes", "Size of disk cache file, with records to compact",
+                          "gauge");
+        out << "websockproxy_cache_file_bytes " << cache_->FileBytes() << "\n";
+    }
+
+    WriteMetricHeader(out, "websockproxy_pool_idle_connections", "Idle upstream connections per origin", "gauge");
+    for (const auto& [origin, idle] : pool_.IdleCounts())
+        out << "websockproxy_pool_idle_connections{origin=\"" << EscapeLabel(origin) << "\"} " << idle << "\n";
+
+    const auto circuits = breakers_.Stats();
+    WriteMetricHeader(out, "websockproxy_circuit_state", "Circuit state per origin: 0 closed, 1 open, 2 half-open",
+                      "gauge");
+    for (const auto& circuit : circuits)
+        out << "websockproxy_circuit_state{origin=\"" << EscapeLabel(circuit.origin) << "\"} "
+            << static_cast<int>(circuit.state) << "\n";
+
+    WriteMetricHeader(out, "websockproxy_circuit_opened_total", "Times circuit opened per origin", "counter");
+    for (const auto& circuit : circuits)
+        out << "websockproxy_circuit_opened_total{origin=\"" << EscapeLabel(circuit.origin) << "\"} "
+            << circuit.opened << "\n";
+
+    WriteMetricHeader(out, "websockproxy_circuit_rejected_total", "Calls failed fast per origin", "counter");
+    for (const auto& circuit : circuits)
+        out << "websockproxy_circuit_rejected_total{origin=\"" << EscapeLabel(circuit.origin) << "\"} "
+            << circuit.rejected << "\n";
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "AdminReport.h"
+#include "CircuitBreaker.h"
+#include "Config.h"
+#include "ConnectionPool.h"
+#include "DiskCache.h"
+#include "LatencyHistogram.h"
+#include "LiveRegistry.h"
+#include "Metrics.h"
+#include "Requests.h"
+#include "ResolverCache.h"
+#include "Retry.h"
+#include "Origin.h"
+#include "Session.h"
+#include "Upstream.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CallCanceller;
+
+// Sends request upstream: picks backend of upstream group, resolves host, reuses pooled connection, retries and
+// hedges idempotent calls, fails fast while origin's circuit is open. GET responses may be served from disk cache.
+// Calls made for a client session carry its cookies and go over its pinned connections
+class Dispatcher final {
+public:
+    Dispatcher(const Config& config, MetricsRegistry& metrics);
+    Dispatcher(const Dispatcher&) = delete;
+    Dispatcher(Dispatcher&&) = delete;
+    Dispatcher& operator=(const Dispatcher&) = delete;
+    Dispatcher& operator=(Dispatcher&&) = delete;
+
+    ~Dispatcher() = default;
+
+    Response Dispatch(const Request& request, Session* session = nullptr);
+    // Session's connections go back to the pool
+    void EndSession(Session& session);
+    // Connections to known origins are opened
+    bool IsWarm() const;
+
+    // Calls running now, tracked only if admin route is enabled
+    std::vector<UpstreamCall> UpstreamCalls() const;
+    // Idle and in use connections by origin
+    std::vector<OriginOccupancy> PoolOccupancy() const;
+
+private:
+    Response DispatchCached(const Request& request);
+    Response DispatchUpstream(const Request& request, Session* session);
+    bool IsRetryable(const Request& request) const;
+    Response Attempt(const Request& request, CallCanceller* canceller, Session* session);
+    Response AttemptHedged(const Request& request, std::chrono::milliseconds delay, Session* session);
+    Response ForwardTo(const std::string& url, const Request& request, CallCanceller* canceller, Session* session);
+    Response CallOrigin(const std::string& url, const Origin& origin, const Request& request, CallCanceller* canceller,
+                        Session* session);
+    void KeepConnection(const std::string& origin, ConnectionPool::Connection connection, Session* session);
+    std::optional<std::chrono::milliseconds> HedgeDelay(const std::string& url);
+    void RecordLatency(const std::string& url, std::chrono::steady_clock::duration elapsed);
+    std::optional<ConnectionPool::Connection> Connect(const std::string& url, const std::string& warm_path);
+    void CollectMetrics(std::ostream& out);
+
+    RetryConfig retry_config_;
+    CircuitBreakerConfig breaker_config_;
+    ResolverCache resolver_;
+    UpstreamRegistry upstreams_;
+    RetryBudget retry_budget_;
+    std::unique_ptr<DiskCache> cache_;  // Null if disabled
+
+    LatencyTracker latency_;  // By origin or upstream
+
+    CircuitBreakerRegistry breakers_;
+
+    Counter& requests_total_;
+    Counter& retries_total_;
+    Counter& hedges_total_;
+    Counter& connections_opened_total_;
+    Counter& connections_reused_total_;
+    Counter& cache_hits_total_;
+    Counter& cache_misses_total_;
+
+    bool track_calls_;
+    std::atomic<uint64_t> next_call_id_{0};
+    LiveRegistry<UpstreamCall> upstream_calls_;
+
+    ConnectionPool pool_;  // Its refill thread uses the members above
+    HedgeExecutor hedge_executor_;  // Last, hedges use the rest
+};
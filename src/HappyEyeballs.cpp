@@ -0,0 +1,207 @@
+#include "HappyEyeballs.h"
+
+// httplib pulls in the platform socket headers (and WSAStartup on Windows)
+#include <httplib.h>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+
+namespace {
+
+#ifdef _WIN32
+using socket_handle = SOCKET;
+constexpr socket_handle kInvalidSocketHandle = INVALID_SOCKET;
+
+void CloseSocket(socket_handle sock) {
+    closesocket(sock);
+}
+
+bool SetNonBlocking(socket_handle sock) {
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+}
+
+bool ConnectInProgress() {
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+
+int PollSockets(std::vector<WSAPOLLFD>& fds, int timeout_ms) {
+    return WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), timeout_ms);
+}
+
+using poll_entry = WSAPOLLFD;
+#else
+using socket_handle = int;
+constexpr socket_handle kInvalidSocketHandle = -1;
+
+void CloseSocket(socket_handle sock) {
+    close(sock);
+}
+
+bool SetNonBlocking(socket_handle sock) {
+    const auto flags = fcntl(sock, F_GETFL, 0);
+    return flags >= 0 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+bool ConnectInProgress() {
+    return errno == EINPROGRESS;
+}
+
+int PollSockets(std::vector<pollfd>& fds, int timeout_ms) {
+    return poll(fds.data(), static_cast<nfds_t>(fds.size()), timeout_ms);
+}
+
+using poll_entry = pollfd;
+#endif
+
+// Returns connected socket, kInvalidSocketHandle on immediate failure; in_progress is set for pending connects
+socket_handle StartConnect(const ResolvedAddress& address, uint16_t port, bool& in_progress) {
+    in_progress = false;
+
+    sockaddr_storage storage{};
+    socklen_t length = 0;
+    if (address.family == ResolvedAddress::Family::V6) {
+        auto* addr = reinterpret_cast<sockaddr_in6*>(&storage);
+        addr->sin6_family = AF_INET6;
+        addr->sin6_port = htons(port);
+        if (inet_pton(AF_INET6, address.ip.c_str(), &addr->sin6_addr) != 1)
+            return kInvalidSocketHandle;
+        length = sizeof(sockaddr_in6);
+    } else {
+        auto* addr = reinterpret_cast<sockaddr_in*>(&storage);
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(port);
+        if (inet_pton(AF_INET, address.ip.c_str(), &addr->sin_addr) != 1)
+            return kInvalidSocketHandle;
+        length = sizeof(sockaddr_in);
+    }
+
+    const auto sock = socket(storage.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == kInvalidSocketHandle)
+        return kInvalidSocketHandle;
+
+    if (!SetNonBlocking(sock)) {
+        CloseSocket(sock);
+        return kInvalidSocketHandle;
+    }
+
+    if (connect(sock, reinterpret_cast<const sockaddr*>(&storage), length) == 0)
+        return sock;
+
+    if (ConnectInProgress()) {
+        in_progress = true;
+        return sock;
+    }
+
+    CloseSocket(sock);
+    return kInvalidSocketHandle;
+}
+
+bool ConnectSucceeded(socket_handle sock) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &length) != 0)
+        return false;
+    return error == 0;
+}
+
+}  // namespace
+
+std::vector<ResolvedAddress> InterleaveFamilies(std::vector<ResolvedAddress> addresses) {
+    std::vector<ResolvedAddress> v4;
+    std::vector<ResolvedAddress> v6;
+    for (auto& address : addresses)
+        (address.family == ResolvedAddress::Family::V6 ? v6 : v4).push_back(std::move(address));
+
+    std::vector<ResolvedAddress> result;
+    result.reserve(v4.size() + v6.size());
+    for (size_t i = 0; i < std::max(v4.size(), v6.size()); ++i) {
+        if (i < v6.size())
+            result.push_back(std::move(v6[i]));
+        if (i < v4.size())
+            result.push_back(std::move(v4[i]));
+    }
+    return result;
+}
+
+std::optional<size_t> RaceConnect(const std::vector<ResolvedAddress>& addresses, uint16_t port,
+                                  std::chrono::milliseconds attempt_delay, std::chrono::milliseconds timeout) {
+    using Clock = std::chrono::steady_clock;
+
+    const auto deadline = Clock::now() + timeout;
+    auto next_attempt_at = Clock::now();
+    size_t next = 0;
+
+    std::vector<poll_entry> pending;
+    std::vector<size_t> pending_index;
+    std::optional<size_t> winner;
+
+    while (!winner) {
+        auto now = Clock::now();
+        if (now >= deadline)
+            break;
+
+        if (next < addresses.size() && now >= next_attempt_at) {
+            bool in_progress = false;
+            const auto sock = StartConnect(addresses[next], port, in_progress);
+            if (sock != kInvalidSocketHandle && !in_progress) {
+                CloseSocket(sock);
+                winner = next;
+                break;
+            }
+            if (sock != kInvalidSocketHandle) {
+                poll_entry entry{};
+                entry.fd = sock;
+                entry.events = POLLOUT;
+                pending.push_back(entry);
+                pending_index.push_back(next);
+                next_attempt_at = now + attempt_delay;
+            }
+            ++next;
+            continue;
+        }
+
+        if (pending.empty()) {
+            if (next >= addresses.size())
+                break;
+            continue;
+        }
+
+        auto wait_until = deadline;
+        if (next < addresses.size())
+            wait_until = std::min(wait_until, next_attempt_at);
+        const auto wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(wait_until - now).count();
+        if (PollSockets(pending, static_cast<int>(std::max<long long>(wait_ms, 0))) <= 0)
+            continue;
+
+        for (size_t i = 0; i < pending.size();) {
+            if (pending[i].revents == 0) {
+                ++i;
+                continue;
+            }
+            if (ConnectSucceeded(pending[i].fd)) {
+                winner = pending_index[i];
+                break;
+            }
+            // Failed attempt: don't wait for attempt_delay before starting the next one
+            CloseSocket(pending[i].fd);
+            pending.erase(pending.begin() + i);
+            pending_index.erase(pending_index.begin() + i);
+            next_attempt_at = Clock::now();
+        }
+    }
+
+    for (const auto& entry : pending)
+        CloseSocket(entry.fd);
+
+    return winner;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "ResolverCache.h"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Orders addresses for connection racing: families alternate, IPv6 first (RFC 8305, section 4)
+std::vector<ResolvedAddress> InterleaveFamilies(std::vector<ResolvedAddress> addresses);
+
+// Starts non-blocking connects to addresses in order, a new attempt every attempt_delay (or as soon as
+// the previous one fails), and returns index of the first address that connected. Sockets are closed.
+std::optional<size_t> RaceConnect(const std::vector<ResolvedAddress>& addresses, uint16_t port,
+                                  std::chrono::milliseconds attempt_delay, std::chrono::milliseconds timeout);
@@ -0,0 +1,71 @@
+#include "HeaderList.h"
+
+HeaderList::HeaderList(std::initializer_list<std::pair<std::string, std::string>> headers) {
+    for (const auto& [name, value] : headers)
+        Add(name, value);
+}
+
+void HeaderList::Add(std::string name, std::string value) {
+    const auto id = LookupHeader(name);
+    if (size_ < kInlineHeaders)
+        inline_[size_] = {id, std::move(name), std::move(value)};
+    else
+        overflow_.push_back({id, std::move(name), std::move(value)});
+    ++size_;
+}
+
+void HeaderList::Set(std::string name, std::string value) {
+    const auto id = LookupHeader(name);
+    RemoveIf([&](const Header& header) {
+        return id != HeaderId::Unknown ? header.id == id : EqualsIgnoreCase(header.name, name);
+    });
+    Add(std::move(name), std::move(value));
+}
+
+void HeaderList::RemoveIf(const std::function<bool(const Header&)>& predicate) {
+    HeaderList kept;
+    for (size_t i = 0; i < size_; ++i) {
+        auto& header = i < kInlineHeaders ? inline_[i] : overflow_[i - kInlineHeaders];
+        if (!predicate(header))
+            kept.Add(std::move(header.name), std::move(header.value));
+    }
+    *this = std::move(kept);
+}
+
+size_t HeaderList::Size() const {
+    return size_;
+}
+
+bool HeaderList::Empty() const {
+    return size_ == 0;
+}
+
+const Header& HeaderList::operator[](size_t index) const {
+    return index < kInlineHeaders ? inline_[index] : overflow_[index - kInlineHeaders];
+}
+
+const Header* HeaderList::Find(HeaderId id) const {
+    for (size_t i = 0; i < size_; ++i) {
+        if ((*this)[i].id == id)
+            return &(*this)[i];
+    }
+    return nullptr;
+}
+
+const Header* HeaderList::Find(std::string_view name) const {
+    const auto id = LookupHeader(name);
+    if (id != HeaderId::Unknown)
+        return Find(id);
+    for (size_t i = 0; i < size_; ++i) {
+        if (EqualsIgnoreCase((*this)[i].name, name))
+            return &(*this)[i];
+    }
+    return nullptr;
+}
+
+httplib::Headers HeaderList::ToHttplib() const {
+    httplib::Headers headers;
+    for (size_t i = 0; i < size_; ++i)
+        headers.emplace((*this)[i].name, (*this)[i].value);
+    return headers;
+}
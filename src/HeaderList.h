@@ -0,0 +1,146 @@
+#pragma once
+
+#include "Ascii.h"
+
+#include <httplib.h>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Well-known header names, so stages can check for them without comparing strings
+enum class HeaderId : uint8_t {
+    Unknown,
+    Accept,
+    AcceptEncoding,
+    AcceptLanguage,
+    Authorization,
+    CacheControl,
+    Connection,
+    ContentEncoding,
+    ContentLength,
+    ContentType,
+    Cookie,
+    Host,
+    IfModifiedSince,
+    IfNoneMatch,
+    Origin,
+    Referer,
+    SetCookie,
+    Traceparent,
+    TransferEncoding,
+    UserAgent,
+    XForwardedFor,
+    XRequestId,
+    Count_
+};
+
+constexpr std::array<std::string_view, static_cast<size_t>(HeaderId::Count_)> kHeaderNames = {
+    "",
+    "Accept",
+    "Accept-Encoding",
+    "Accept-Language",
+    "Authorization",
+    "Cache-Control",
+    "Connection",
+    "Content-Encoding",
+    "Content-Length",
+    "Content-Type",
+    "Cookie",
+    "Host",
+    "If-Modified-Since",
+    "If-None-Match",
+    "Origin",
+    "Referer",
+    "Set-Cookie",
+    "Traceparent",
+    "Transfer-Encoding",
+    "User-Agent",
+    "X-Forwarded-For",
+    "X-Request-Id",
+};
+
+namespace header_hash {
+
+constexpr size_t kTableSize = 64;
+
+// Picked so that all well-known names land in distinct slots, which is checked below
+constexpr size_t Hash(std::string_view name) {
+    if (name.empty())
+        return 0;
+    const auto first = static_cast<unsigned char>(ToLowerAscii(name.front()));
+    const auto last = static_cast<unsigned char>(ToLowerAscii(name.back()));
+    return (name.size() * 4 + first + last * 9) % kTableSize;
+}
+
+constexpr std::array<HeaderId, kTableSize> MakeTable() {
+    std::array<HeaderId, kTableSize> table{};
+    for (size_t id = 1; id < kHeaderNames.size(); ++id)
+        table[Hash(kHeaderNames[id])] = static_cast<HeaderId>(id);
+    return table;
+}
+
+constexpr auto kTable = MakeTable();
+
+constexpr bool IsPerfect() {
+    for (size_t id = 1; id < kHeaderNames.size(); ++id) {
+        if (kTable[Hash(kHeaderNames[id])] != static_cast<HeaderId>(id))
+            return false;
+    }
+    return true;
+}
+
+static_assert(IsPerfect(), "Well-known header names collide, adjust Hash()");
+
+}  // namespace header_hash
+
+// Case-insensitive, one hash and at most one comparison
+constexpr HeaderId LookupHeader(std::string_view name) {
+    const auto id = header_hash::kTable[header_hash::Hash(name)];
+    if (id == HeaderId::Unknown || !EqualsIgnoreCase(kHeaderNames[static_cast<size_t>(id)], name))
+        return HeaderId::Unknown;
+    return id;
+}
+
+static_assert(LookupHeader("content-type") == HeaderId::ContentType);
+static_assert(LookupHeader("X-Custom") == HeaderId::Unknown);
+
+struct Header {
+    HeaderId id = HeaderId::Unknown;
+    std::string name;
+    std::string value;
+};
+
+// Request headers in arrival order. The first kInlineHeaders live inside the object, so a typical request
+// allocates nothing for the list itself. Converted to httplib::Headers only when the call is made
+class HeaderList {
+public:
+    static constexpr size_t kInlineHeaders = 8;
+
+    HeaderList() = default;
+    HeaderList(std::initializer_list<std::pair<std::string, std::string>> headers);
+
+    void Add(std::string name, std::string value);
+    // Replaces all headers with this name
+    void Set(std::string name, std::string value);
+    void RemoveIf(const std::function<bool(const Header&)>& predicate);
+    size_t Size() const;
+    bool Empty() const;
+    const Header& operator[](size_t index) const;
+
+    // First header with this name, or nullptr
+    const Header* Find(HeaderId id) const;
+    const Header* Find(std::string_view name) const;
+
+    httplib::Headers ToHttplib() const;
+
+private:
+    std::array<Header, kInlineHeaders> inline_;
+    size_t size_ = 0;
+    std::vector<Header> overflow_;
+};
@@ -1,27 +1,49 @@
 #include "HttpClient.h"
 
+#include "Origin.h"
+#include "Trace.h"
+
 namespace {
 
-Response FormatResult(const httplib::Result& result) {
+Response FormatResult(httplib::Result& result) {
     if (result.error() != httplib::Error::Success)
         return {static_cast<int>(result.error()), "Failed"};
 
-    return {result->status, result->body};
+    Response response{result->status, std::move(result->body)};
+    for (auto& [name, value] : result->headers)
+        response.headers.Add(name, std::move(value));
+    return response;
 }
 
 }  // namespace
 
 HttpClient::HttpClient(const std::string& url)
     : client_(url) {
+    client_.set_keep_alive(true);
+}
+
+HttpClient::HttpClient(const std::string& url, const std::string& address)
+    : client_(url) {
+    client_.set_keep_alive(true);
+    client_.set_hostname_addr_map({{ParseOrigin(url).host, address}});
 }
 
 Response HttpClient::Visit(const GetRequest& request) {
-    const auto res = client_.Get(request.Path(), request.Headers());
+    // Only GET exposes body progress, so first byte is known for it alone
+    auto* trace = Trace::Current();
+    bool first_byte = false;
+    auto res = client_.Get(request.Path(), request.Headers(), [trace, &first_byte](uint64_t, uint64_t) {
+        if (trace && !first_byte) {
+            trace->Mark(TraceStage::FirstByte);
+            first_byte = true;
+        }
+        return true;
+    });
     return FormatResult(res);
 }
 
 Response HttpClient::Visit(const HeadRequest& request) {
-    const auto res = client_.Head(request.Path(), request.Headers());
+    auto res = client_.Head(request.Path(), request.Headers());
     return FormatResult(res);
 }
 
@@ -48,16 +70,25 @@ Response HttpClient::Visit(const PutRequest& request) {
 }
 
 Response HttpClient::Visit(const DeleteRequest& request) {
-    const auto res = client_.Delete(request.Path(), request.Headers(), request.Body(), request.ContentType());
+    auto res = client_.Delete(request.Path(), request.Headers(), request.Body(), request.ContentType());
     return FormatResult(res);
 }
 
 Response HttpClient::Visit(const OptionsRequest& request) {
-    const auto res = client_.Options(request.Path(), request.Headers());
+    auto res = client_.Options(request.Path(), request.Headers());
     return FormatResult(res);
 }
 
 Response HttpClient::Visit(const PatchRequest& request) {
-    const auto res = client_.Patch(request.Path(), request.Headers(), request.Body(), request.ContentType());
+    auto res = client_.Patch(request.Path(), request.Headers(), request.Body(), request.ContentType());
     return FormatResult(res);
 }
+
+bool HttpClient::Warm(const std::string& path) {
+    const auto res = client_.Head(path);
+    return res.error() == httplib::Error::Success;
+}
+
+void HttpClient::Stop() {
+    client_.stop();
+}
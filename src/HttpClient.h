@@ -6,6 +6,8 @@
 class HttpClient final {
 public:
     explicit HttpClient(const std::string& url);
+    // Connects to pre-resolved address instead of resolving url's host again
+    HttpClient(const std::string& url, const std::string& address);
     HttpClient(const HttpClient&) = delete;
     HttpClient(HttpClient&&) = delete;
     HttpClient& operator=(const HttpClient&) = delete;
@@ -21,6 +23,13 @@ public:
     Response Visit(const OptionsRequest& request);
     Response Visit(const PatchRequest& request);
 
+    // Opens connection with a HEAD request, so it's kept alive for the calls that follow.
+    // Returns false if upstream couldn't be reached
+    bool Warm(const std::string& path);
+
+    // Aborts call in progress from another thread
+    void Stop();
+
 private:
     httplib::Client client_;
 };
@@ -0,0 +1,99 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace {
+
+constexpr double kFirstBucketUs = 100.0;
+constexpr double kBucketsPerOctave = 4.0;
+
+size_t BucketIndex(std::chrono::microseconds latency, size_t buckets) {
+    const auto us = static_cast<double>(latency.count());
+    if (us <= kFirstBucketUs)
+        return 0;
+    const auto index = static_cast<size_t>(std::ceil(std::log2(us / kFirstBucketUs) * kBucketsPerOctave));
+    return std::min(index, buckets - 1);
+}
+
+std::chrono::microseconds BucketUpperBound(size_t index) {
+    const auto us = kFirstBucketUs * std::exp2(static_cast<double>(index) / kBucketsPerOctave);
+    return std::chrono::microseconds(static_cast<int64_t>(us));
+}
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram(uint32_t window)
+    : window_(window) {
+}
+
+void LatencyHistogram::Record(std::chrono::microseconds latency) {
+    buckets_[BucketIndex(latency, kBuckets)].fetch_add(1, std::memory_order_relaxed);
+    if (count_.fetch_add(1, std::memory_order_relaxed) + 1 >= window_)
+        Decay();
+}
+
+uint32_t LatencyHistogram::Count() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+std::chrono::microseconds LatencyHistogram::Percentile(double percentile) const {
+    uint32_t total = 0;
+    for (const auto& bucket : buckets_)
+        total += bucket.load(std::memory_order_relaxed);
+    if (total == 0)
+        return std::chrono::microseconds(0);
+
+    const auto target = static_cast<uint32_t>(std::ceil(total * percentile / 100.0));
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        cumulative += buckets_[i].load(std::memory_order_relaxed);
+        if (cumulative >= target)
+            return BucketUpperBound(i);
+    }
+    return BucketUpperBound(kBuckets - 1);
+}
+
+void LatencyHistogram::Decay() {
+    // Only one thread halves the counts, concurrent records may be slightly off, which is fine for estimates
+    if (decaying_.exchange(true, std::memory_order_acquire))
+        return;
+
+    uint32_t total = 0;
+    for (auto& bucket : buckets_) {
+        const auto halved = bucket.load(std::memory_order_relaxed) / 2;
+        bucket.store(halved, std::memory_order_relaxed);
+        total += halved;
+    }
+    count_.store(total, std::memory_order_relaxed);
+    decaying_.store(false, std::memory_order_release);
+}
+
+
+LatencyTracker::LatencyTracker(size_t max_keys)
+    : max_keys_(max_keys) {
+}
+
+std::shared_ptr<LatencyHistogram> LatencyTracker::Get(const std::string& key) {
+    auto lock = std::lock_guard(guard_);
+    const auto it = index_.find(key);
+    if (it != index_.end()) {
+        entries_.splice(entries_.end(), entries_, it->second);
+        return it->second->histogram;
+    }
+
+    if (entries_.size() >= max_keys_ && !entries_.empty()) {
+        index_.erase(entries_.front().key);
+        entries_.pop_front();
+    }
+    auto histogram = std::make_shared<LatencyHistogram>();
+    entries_.push_back({key, histogram});
+    index_.emplace(key, std::prev(entries_.end()));
+    return histogram;
+}
+
+size_t LatencyTracker::Size() const {
+    auto lock = std::lock_guard(guard_);
+    return entries_.size();
+}
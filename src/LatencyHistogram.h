@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Lock-free latency histogram with quarter-octave buckets from 100us to ~6.5s.
+// Counts are halved once the window is full, so percentiles follow recent traffic
+class LatencyHistogram final {
+public:
+    explicit LatencyHistogram(uint32_t window = 1024);
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram(LatencyHistogram&&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(LatencyHistogram&&) = delete;
+
+    ~LatencyHistogram() = default;
+
+    void Record(std::chrono::microseconds latency);
+    uint32_t Count() const;
+
+    // Upper bound of the bucket holding given percentile (0..100)
+    std::chrono::microseconds Percentile(double percentile) const;
+
+private:
+    static constexpr size_t kBuckets = 64;
+
+    void Decay();
+
+    uint32_t window_;
+    std::array<std::atomic<uint32_t>, kBuckets> buckets_{};
+    std::atomic<uint32_t> count_{0};
+    std::atomic<bool> decaying_{false};
+};
+
+// Histograms by key (origin or upstream), at most max_keys of them: the least recently used one goes when full
+class LatencyTracker final {
+public:
+    explicit LatencyTracker(size_t max_keys = 1024);
+    LatencyTracker(const LatencyTracker&) = delete;
+    LatencyTracker(LatencyTracker&&) = delete;
+    LatencyTracker& operator=(const LatencyTracker&) = delete;
+    LatencyTracker& operator=(LatencyTracker&&) = delete;
+
+    ~LatencyTracker() = default;
+
+    // Created if not tracked yet
+    std::shared_ptr<LatencyHistogram> Get(const std::string& key);
+    size_t Size() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<LatencyHistogram> histogram;
+    };
+
+    size_t max_keys_;
+    mutable std::mutex guard_;
+    std::list<Entry> entries_;  // Least recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Entries of things in progress, e.g. calls, for introspection, by ids unique to the owner. Entries are spread over
+// shards by id, each with its own lock: adding and removing touches one shard, and a snapshot copies shards one at a
+// time, so it never holds up more than one shard's writers and only for the copy of that shard
+template <class Entry>
+class LiveRegistry final {
+public:
+    // Removes the entry when it goes out of scope
+    class Scoped final {
+    public:
+        Scoped(LiveRegistry& registry, uint64_t id, Entry entry)
+            : registry_(registry)
+            , id_(id) {
+            registry_.Add(id_, std::move(entry));
+        }
+        Scoped(const Scoped&) = delete;
+        Scoped(Scoped&&) = delete;
+        Scoped& operator=(const Scoped&) = delete;
+        Scoped& operator=(Scoped&&) = delete;
+
+        ~Scoped() {
+            registry_.Remove(id_);
+        }
+
+    private:
+        LiveRegistry& registry_;
+        uint64_t id_;
+    };
+
+    LiveRegistry() = default;
+    LiveRegistry(const LiveRegistry&) = delete;
+    LiveRegistry(LiveRegistry&&) = delete;
+    LiveRegistry& operator=(const LiveRegistry&) = delete;
+    LiveRegistry& operator=(LiveRegistry&&) = delete;
+
+    ~LiveRegistry() = default;
+
+    void Add(uint64_t id, Entry entry) {
+        auto& shard = ShardOf(id);
+        auto lock = std::lock_guard(shard.guard);
+        shard.entries.insert_or_assign(id, std::move(entry));
+    }
+
+    void Remove(uint64_t id) {
+        auto& shard = ShardOf(id);
+        auto lock = std::lock_guard(shard.guard);
+        shard.entries.erase(id);
+    }
+
+    // Entries by id. Not a point-in-time view: ones added or removed during the call may be missed
+    std::vector<std::pair<uint64_t, Entry>> Snapshot() const {
+        std::vector<std::pair<uint64_t, Entry>> entries;
+        for (const auto& shard : shards_) {
+            auto lock = std::lock_guard(shard.guard);
+            entries.insert(end(entries), begin(shard.entries), end(shard.entries));
+        }
+        return entries;
+    }
+
+private:
+    static constexpr size_t kShards = 16;
+
+    // Own cache line, so writers to neighbouring shards don't contend
+    struct alignas(64) Shard {
+        mutable std::mutex guard;
+        std::unordered_map<uint64_t, Entry> entries;
+    };
+
+    Shard& ShardOf(uint64_t id) {
+        return shards_[id % kShards];
+    }
+
+    std::array<Shard, kShards> shards_;
+};
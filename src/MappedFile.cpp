@@ -0,0 +1,85 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stdexcept>
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path, size_t size)
+    : size_(size) {
+    if (size_ == 0)
+        return;
+
+    // Shared for delete, so the file can be replaced while views of it are in use
+    const auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("MappedFile(): can't open " + path);
+    LARGE_INTEGER file_size{};
+    if (!GetFileSizeEx(file, &file_size) || static_cast<unsigned long long>(file_size.QuadPart) < size_) {
+        CloseHandle(file);
+        throw std::runtime_error("MappedFile(): " + path + " is shorter than expected");
+    }
+    mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping_)
+        throw std::runtime_error("MappedFile(): can't map " + path);
+    data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, size_));
+    if (!data_) {
+        CloseHandle(mapping_);
+        throw std::runtime_error("MappedFile(): can't map " + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path, size_t size)
+    : size_(size) {
+    if (size_ == 0)
+        return;
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("MappedFile(): can't open " + path);
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < size_) {
+        close(fd);
+        throw std::runtime_error("MappedFile(): " + path + " is shorter than expected");
+    }
+    // Mapping keeps the file's data, the descriptor isn't needed
+    auto* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        throw std::runtime_error("MappedFile(): can't map " + path);
+    data_ = static_cast<const char*>(data);
+}
+
+MappedFile::~MappedFile() {
+    if (data_)
+        munmap(const_cast<char*>(data_), size_);
+}
+
+#endif
+
+std::string_view MappedFile::Data() const {
+    return {data_, size_};
+}
+
+size_t MappedFile::Size() const {
+    return size_;
+}
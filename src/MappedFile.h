@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a file's first bytes. Stays valid after the file is renamed over or removed
+class MappedFile final {
+public:
+    // Throws if file can't be opened or is shorter than size
+    MappedFile(const std::string& path, size_t size);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    ~MappedFile();
+
+    std::string_view Data() const;
+    size_t Size() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* mapping_ = nullptr;
+#endif
+};
@@ -1,8 +1,12 @@
 #pragma once
 
+#include "Ascii.h"
+
 #include <algorithm>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
 enum class Method {
     METHOD_GET,
@@ -20,22 +24,48 @@ inline std::string ToUpper(const std::string& str) {
     return upper_str;
 }
 
-inline Method MethodFromString(const std::string& data) {
-    const auto data_upper = ToUpper(data);
-    if (data_upper == "GET")
-        return Method::METHOD_GET;
-    else if (data_upper == "HEAD")
-        return Method::METHOD_HEAD;
-    else if (data_upper == "POST")
-        return Method::METHOD_POST;
-    else if (data_upper == "PUT")
-        return Method::METHOD_PUT;
-    else if (data_upper == "DELETE")
-        return Method::METHOD_DELETE;
-    else if (data_upper == "OPTIONS")
-        return Method::METHOD_OPTIONS;
-    else if (data_upper == "PATCH")
-        return Method::METHOD_PATCH;
-    else
-        throw std::runtime_error("Unhandled method from string conversion");
+// Methods are told apart by length and first letter, so at most one comparison is made
+constexpr std::optional<Method> ParseMethod(std::string_view str) {
+    if (str.empty())
+        return {};
+
+    std::string_view name;
+    Method method{};
+    switch (str.size() * 32 + (ToLowerAscii(str[0]) - 'a')) {
+    case 3 * 32 + ('g' - 'a'): name = "GET"; method = Method::METHOD_GET; break;
+    case 3 * 32 + ('p' - 'a'): name = "PUT"; method = Method::METHOD_PUT; break;
+    case 4 * 32 + ('h' - 'a'): name = "HEAD"; method = Method::METHOD_HEAD; break;
+    case 4 * 32 + ('p' - 'a'): name = "POST"; method = Method::METHOD_POST; break;
+    case 5 * 32 + ('p' - 'a'): name = "PATCH"; method = Method::METHOD_PATCH; break;
+    case 6 * 32 + ('d' - 'a'): name = "DELETE"; method = Method::METHOD_DELETE; break;
+    case 7 * 32 + ('o' - 'a'): name = "OPTIONS"; method = Method::METHOD_OPTIONS; break;
+    default: return {};
+    }
+    if (!EqualsIgnoreCase(str, name))
+        return {};
+    return method;
+}
+
+constexpr std::string_view MethodName(Method method) {
+    switch (method) {
+    case Method::METHOD_GET: return "GET";
+    case Method::METHOD_HEAD: return "HEAD";
+    case Method::METHOD_POST: return "POST";
+    case Method::METHOD_PUT: return "PUT";
+    case Method::METHOD_DELETE: return "DELETE";
+    case Method::METHOD_OPTIONS: return "OPTIONS";
+    case Method::METHOD_PATCH: return "PATCH";
+    }
+    return {};
 }
+
+inline Method MethodFromString(std::string_view data) {
+    if (const auto method = ParseMethod(data))
+        return *method;
+    throw std::runtime_error("Unhandled method from string conversion");
+}
+
+static_assert(ParseMethod("get") == Method::METHOD_GET);
+static_assert(ParseMethod("Options") == Method::METHOD_OPTIONS);
+static_assert(!ParseMethod("GOT"));
+static_assert(MethodName(Method::METHOD_PATCH) == "PATCH");
@@ -0,0 +1,59 @@
+#include "Metrics.h"
+
+#include <sstream>
+
+void WriteMetricHeader(std::ostream& out, const std::string& name, const std::string& help, const char* type) {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+}
+
+std::string EscapeLabel(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (const char c : value) {
+        if (c == '\\' || c == '"')
+            escaped += '\\';
+        if (c == '\n')
+            escaped += "\\n";
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+Counter& MetricsRegistry::AddCounter(const std::string& name, const std::string& help) {
+    auto lock = std::lock_guard(guard_);
+    counters_.emplace_back();
+    counters_.back().name = name;
+    counters_.back().help = help;
+    return counters_.back().metric;
+}
+
+Gauge& MetricsRegistry::AddGauge(const std::string& name, const std::string& help) {
+    auto lock = std::lock_guard(guard_);
+    gauges_.emplace_back();
+    gauges_.back().name = name;
+    gauges_.back().help = help;
+    return gauges_.back().metric;
+}
+
+void MetricsRegistry::AddCollector(Collector collector) {
+    auto lock = std::lock_guard(guard_);
+    collectors_.push_back(std::move(collector));
+}
+
+std::string MetricsRegistry::Render() const {
+    std::ostringstream out;
+    auto lock = std::lock_guard(guard_);
+    for (const auto& counter : counters_) {
+        WriteMetricHeader(out, counter.name, counter.help, "counter");
+        out << counter.name << " " << counter.metric.Value() << "\n";
+    }
+    for (const auto& gauge : gauges_) {
+        WriteMetricHeader(out, gauge.name, gauge.help, "gauge");
+        out << gauge.name << " " << gauge.metric.Value() << "\n";
+    }
+    for (const auto& collector : collectors_)
+        collector(out);
+    return out.str();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Counter final {
+public:
+    void Increment(uint64_t value = 1) {
+        value_.fetch_add(value, std::memory_order_relaxed);
+    }
+    uint64_t Value() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+class Gauge final {
+public:
+    void Set(int64_t value) {
+        value_.store(value, std::memory_order_relaxed);
+    }
+    void Add(int64_t value) {
+        value_.fetch_add(value, std::memory_order_relaxed);
+    }
+    int64_t Value() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+// Metrics exposed in Prometheus text format. Counters and gauges are registered once and updated lock-free;
+// labeled series (per origin etc.) are written by collectors at scrape time
+class MetricsRegistry final {
+public:
+    using Collector = std::function<void(std::ostream&)>;
+
+    MetricsRegistry() = default;
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry(MetricsRegistry&&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(MetricsRegistry&&) = delete;
+
+    ~MetricsRegistry() = default;
+
+    Counter& AddCounter(const std::string& name, const std::string& help);
+    Gauge& AddGauge(const std::string& name, const std::string& help);
+    void AddCollector(Collector collector);
+
+    std::string Render() const;
+
+private:
+    template <class T>
+    struct Entry {
+        std::string name;
+        std::string help;
+        T metric;
+    };
+
+    mutable std::mutex guard_;
+    std::deque<Entry<Counter>> counters_;  // deque keeps references stable
+    std::deque<Entry<Gauge>> gauges_;
+    std::vector<Collector> collectors_;
+};
+
+// Writes "# HELP" and "# TYPE" header lines
+void WriteMetricHeader(std::ostream& out, const std::string& name, const std::string& help, const char* type);
+
+// Escapes label value for "name{label=\"value\"}" form
+std::string EscapeLabel(const std::string& value);
@@ -0,0 +1,86 @@
+#include "Origin.h"
+
+#include "Ascii.h"
+
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+uint16_t DefaultPort(const std::string& scheme) {
+    return scheme == "https" ? 443 : 80;
+}
+
+uint16_t ParsePort(std::string_view str) {
+    if (str.empty() || str.size() > 5 || str.find_first_not_of("0123456789") != std::string_view::npos)
+        throw std::runtime_error("ParseOrigin(): invalid port");
+    uint32_t port = 0;
+    for (const auto c : str)
+        port = port * 10 + (c - '0');
+    if (port == 0 || port > 65535)
+        throw std::runtime_error("ParseOrigin(): port out of range");
+    return static_cast<uint16_t>(port);
+}
+
+// Done on every request, so without locale-aware tolower() and intermediate copies
+std::string ToLowerCopy(std::string_view str) {
+    std::string lower(str);
+    for (auto& c : lower)
+        c = ToLowerAscii(c);
+    return lower;
+}
+
+}  // namespace
+
+Origin ParseOrigin(const std::string& url) {
+    Origin origin;
+
+    const std::string_view view = url;
+    size_t pos = 0;
+    const auto scheme_end = view.find("://");
+    if (scheme_end != std::string_view::npos) {
+        origin.scheme = ToLowerCopy(view.substr(0, scheme_end));
+        pos = scheme_end + 3;
+    } else {
+        origin.scheme = "http";
+    }
+    if (origin.scheme != "http" && origin.scheme != "https")
+        throw std::runtime_error("ParseOrigin(): unsupported scheme");
+
+    const auto authority = view.substr(pos, view.find_first_of("/?#", pos) - pos);
+
+    std::string_view port;
+    if (!authority.empty() && authority.front() == '[') {
+        const auto bracket = authority.find(']');
+        if (bracket == std::string_view::npos)
+            throw std::runtime_error("ParseOrigin(): unterminated IPv6 literal");
+        origin.host = authority.substr(1, bracket - 1);
+        if (bracket + 1 < authority.size()) {
+            if (authority[bracket + 1] != ':')
+                throw std::runtime_error("ParseOrigin(): garbage after IPv6 literal");
+            port = authority.substr(bracket + 2);
+        }
+    } else {
+        const auto colon = authority.find(':');
+        origin.host = ToLowerCopy(authority.substr(0, colon));
+        if (colon != std::string_view::npos)
+            port = authority.substr(colon + 1);
+    }
+
+    if (origin.host.empty())
+        throw std::runtime_error("ParseOrigin(): empty host");
+
+    origin.port = port.empty() ? DefaultPort(origin.scheme) : ParsePort(port);
+    return origin;
+}
+
+std::string Origin::Key() const {
+    const bool ipv6 = host.find(':') != std::string::npos;
+    return scheme + "://" + (ipv6 ? "[" + host + "]" : host) + ":" + std::to_string(port);
+}
+
+bool Origin::IsIpLiteral() const {
+    if (host.find(':') != std::string::npos)
+        return true;
+    return host.find_first_not_of("0123456789.") == std::string::npos;
+}
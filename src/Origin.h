@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Scheme, host and port of an upstream URL, as httplib::Client sees it
+struct Origin {
+    std::string scheme;
+    std::string host;
+    uint16_t port = 0;
+
+    // Canonical "scheme://host:port" form, usable as a map key
+    std::string Key() const;
+    bool IsIpLiteral() const;
+};
+
+// Parses "scheme://host[:port]" (scheme and port are optional, like in httplib::Client)
+Origin ParseOrigin(const std::string& url);
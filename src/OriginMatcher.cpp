@@ -0,0 +1,255 @@
+#include "OriginMatcher.h"
+
+#include "Origin.h"
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+
+constexpr std::string_view kUpstreamPrefix = "upstream://";
+constexpr std::string_view kAnyHost = "*";
+constexpr std::string_view kAnySubdomain = "*.";
+
+struct Target {
+    std::string scheme;
+    std::string host;
+    uint16_t port = 0;
+};
+
+Target ParseTarget(const std::string& url) {
+    if (url.compare(0, kUpstreamPrefix.size(), kUpstreamPrefix) == 0)
+        return {"upstream", url.substr(kUpstreamPrefix.size()), 0};
+
+    auto origin = ParseOrigin(url);
+    // "example.com." is the same host for DNS
+    if (origin.host.size() > 1 && origin.host.back() == '.')
+        origin.host.pop_back();
+    return {std::move(origin.scheme), std::move(origin.host), origin.port};
+}
+
+// Query and fragment aren't part of the path
+std::string_view StripQuery(std::string_view path) {
+    return path.substr(0, path.find_first_of("?#"));
+}
+
+// Calls func for each non-empty segment of the path while it returns true
+template <typename Func>
+void ForEachSegment(std::string_view path, Func func) {
+    while (!path.empty()) {
+        const auto slash = path.find('/');
+        const auto segment = path.substr(0, slash);
+        if (!segment.empty() && !func(segment))
+            return;
+        if (slash == std::string_view::npos)
+            return;
+        path.remove_prefix(slash + 1);
+    }
+}
+
+int HexDigitValue(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool IsUnreserved(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.' ||
+           c == '_' || c == '~';
+}
+
+// Path without query, with escaped unreserved characters decoded and other escapes in upper case (RFC 3986), so
+// "/%61dmin" meets the rule for "/admin". Nothing if it has a malformed escape, or an escaped ".", "/" or "\" that
+// upstream could take for a dot segment or a separator the rules didn't see
+std::optional<std::string> NormalizePath(std::string_view path) {
+    path = StripQuery(path);
+    std::string normalized;
+    normalized.reserve(path.size());
+    for (size_t i = 0; i < path.size(); ++i) {
+        if (path[i] != '%') {
+            normalized += path[i];
+            continue;
+        }
+        if (i + 2 >= path.size())
+            return {};
+        const auto high = HexDigitValue(path[i + 1]);
+        const auto low = HexDigitValue(path[i + 2]);
+        if (high < 0 || low < 0)
+            return {};
+        const auto c = static_cast<char>(high * 16 + low);
+        if (c == '.' || c == '/' || c == '\\')
+            return {};
+        if (IsUnreserved(c)) {
+            normalized += c;
+        } else {
+            constexpr std::string_view kHexDigits = "0123456789ABCDEF";
+            normalized += '%';
+            normalized += kHexDigits[high];
+            normalized += kHexDigits[low];
+        }
+        i += 2;
+    }
+    return normalized;
+}
+
+// Upstream would resolve "/public/../admin" to a path the rules didn't see
+bool HasDotSegment(std::string_view path) {
+    bool found = false;
+    ForEachSegment(StripQuery(path), [&found](std::string_view segment) {
+        found = segment == "." || segment == "..";
+        return !found;
+    });
+    return found;
+}
+
+}  // namespace
+
+OriginMatcher::OriginMatcher(const std::vector<std::string>& allow, const std::vector<std::string>& deny)
+    : nodes_(1) {
+    for (const auto& rule : allow)
+        Add(rule, kAllow);
+    for (const auto& rule : deny)
+        Add(rule, kDeny);
+    has_allow_ = !allow.empty();
+}
+
+bool OriginMatcher::Allows(const std::string& url, const std::string& path) const {
+    if (Empty())
+        return true;
+
+    Target target;
+    try {
+        target = ParseTarget(url);
+    } catch (const std::exception&) {
+        return false;
+    }
+    const auto normalized = NormalizePath(path);
+    if (!normalized || HasDotSegment(*normalized))
+        return false;
+
+    const auto matched = Match(target.scheme, target.port, target.host, *normalized);
+    return !(matched & kDeny) && (!has_allow_ || (matched & kAllow));
+}
+
+bool OriginMatcher::Empty() const {
+    return roots_.empty();
+}
+
+void OriginMatcher::Add(const std::string& rule, uint8_t kind) {
+    const auto scheme_end = rule.find("://");
+    const auto path_start = rule.find('/', scheme_end == std::string::npos ? 0 : scheme_end + 3);
+    const auto path = path_start == std::string::npos ? std::string_view() : std::string_view(rule).substr(path_start);
+    const auto target = ParseTarget(rule.substr(0, path_start));
+    if (target.host.empty())
+        throw std::runtime_error("OriginMatcher(): empty host in rule " + rule);
+
+    std::string_view host = target.host;
+    const bool any_subdomain = host == kAnyHost || host.compare(0, kAnySubdomain.size(), kAnySubdomain) == 0;
+    if (any_subdomain)
+        host.remove_prefix(std::min(host.size(), kAnySubdomain.size()));
+    if (host.find('*') != std::string_view::npos)
+        throw std::runtime_error("OriginMatcher(): wildcard is only allowed as the first label in rule " + rule);
+
+    auto root = std::find_if(begin(roots_), end(roots_), [&target](const auto& r) {
+        return r.scheme == target.scheme && r.port == target.port;
+    });
+    if (root == end(roots_)) {
+        const auto node = AddNode();
+        roots_.push_back({target.scheme, target.port, node});
+        root = prev(end(roots_));
+    }
+
+    auto node = root->node;
+    while (!host.empty()) {
+        const auto dot = host.rfind('.');
+        node = AddChild(node, dot == std::string_view::npos ? host : host.substr(dot + 1));
+        host = dot == std::string_view::npos ? std::string_view() : host.substr(0, dot);
+    }
+
+    auto path_root = any_subdomain ? nodes_[node].subdomains : nodes_[node].path;
+    if (path_root == kNone) {
+        path_root = AddNode();
+        (any_subdomain ? nodes_[node].subdomains : nodes_[node].path) = path_root;
+    }
+    node = path_root;
+
+    const auto normalized = NormalizePath(path);
+    if (!normalized)
+        throw std::runtime_error("OriginMatcher(): malformed or escaped separator in path of rule " + rule);
+    ForEachSegment(*normalized, [this, &node](std::string_view segment) {
+        node = AddChild(node, segment);
+        return true;
+    });
+    nodes_[node].rules |= kind;
+}
+
+uint32_t OriginMatcher::AddNode() {
+    nodes_.emplace_back();
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+uint32_t OriginMatcher::AddChild(uint32_t node, std::string_view label) {
+    if (const auto child = Child(node, label); child != kNone)
+        return child;
+
+    const auto child = AddNode();
+    auto& children = nodes_[node].children;
+    const auto it = std::lower_bound(begin(children), end(children), label,
+                                     [](const auto& c, std::string_view l) { return std::string_view(c.first) < l; });
+    children.emplace(it, std::string(label), child);
+    return child;
+}
+
+uint32_t OriginMatcher::Child(uint32_t node, std::string_view label) const {
+    const auto& children = nodes_[node].children;
+    const auto it = std::lower_bound(begin(children), end(children), label,
+                                     [](const auto& c, std::string_view l) { return std::string_view(c.first) < l; });
+    return it != end(children) && it->first == label ? it->second : kNone;
+}
+
+uint8_t OriginMatcher::MatchPath(uint32_t node, std::string_view path) const {
+    if (node == kNone)
+        return 0;
+
+    auto matched = nodes_[node].rules;
+    ForEachSegment(path, [this, &node, &matched](std::string_view segment) {
+        node = Child(node, segment);
+        if (node == kNone)
+            return false;
+        matched |= nodes_[node].rules;
+        return true;
+    });
+    return matched;
+}
+
+uint8_t OriginMatcher::Match(std::string_view scheme, uint16_t port, std::string_view host,
+                             std::string_view path) const {
+    const auto root = std::find_if(begin(roots_), end(roots_),
+                                   [&](const auto& r) { return r.scheme == scheme && r.port == port; });
+    if (root == end(roots_))
+        return 0;
+
+    uint8_t matched = 0;
+    auto node = root->node;
+    // Host labels right to left, "*." rules of every suffix having at least one label before it apply too
+    while (true) {
+        if (!host.empty())
+            matched |= MatchPath(nodes_[node].subdomains, path);
+        if (host.empty()) {
+            matched |= MatchPath(nodes_[node].path, path);
+            break;
+        }
+
+        const auto dot = host.rfind('.');
+        node = Child(node, dot == std::string_view::npos ? host : host.substr(dot + 1));
+        host = dot == std::string_view::npos ? std::string_view() : host.substr(0, dot);
+        if (node == kNone)
+            break;
+    }
+    return matched;
+}
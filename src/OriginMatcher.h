@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Allow and deny rules for upstream calls, compiled at startup into a trie of reversed host labels with a trie of
+// path segments under each host, so a lookup costs one walk over the url, whatever the number of rules.
+// Rule is "scheme://host[:port][/path]":
+// - host "*" matches any host, "*.example.com" any subdomain of example.com (but not example.com itself)
+// - path matches whole segments: "/api" matches "/api" and "/api/v1", but not "/apis"
+// - "upstream://name" matches upstream group
+// Call is denied if any deny rule matches, or if there are allow rules and none of them matches
+class OriginMatcher final {
+public:
+    OriginMatcher(const std::vector<std::string>& allow, const std::vector<std::string>& deny);
+    OriginMatcher(const OriginMatcher&) = delete;
+    OriginMatcher(OriginMatcher&&) = delete;
+    OriginMatcher& operator=(const OriginMatcher&) = delete;
+    OriginMatcher& operator=(OriginMatcher&&) = delete;
+
+    ~OriginMatcher() = default;
+
+    bool Allows(const std::string& url, const std::string& path) const;
+    bool Empty() const;
+
+private:
+    static constexpr uint8_t kAllow = 1;
+    static constexpr uint8_t kDeny = 2;
+    static constexpr uint32_t kNone = 0;  // Index of no node, nodes_[0] is a placeholder
+
+    struct Node {
+        std::vector<std::pair<std::string, uint32_t>> children;  // Sorted by label or segment
+        uint32_t subdomains = kNone;  // Path root of "*.<this host>" rules
+        uint32_t path = kNone;        // Path root of rules for this host
+        uint8_t rules = 0;            // Set on path nodes where a rule ends
+    };
+
+    struct Root {
+        std::string scheme;
+        uint16_t port = 0;
+        uint32_t node = kNone;
+    };
+
+    void Add(const std::string& rule, uint8_t kind);
+    uint32_t AddNode();
+    uint32_t AddChild(uint32_t node, std::string_view label);
+    uint32_t Child(uint32_t node, std::string_view label) const;
+    uint8_t MatchPath(uint32_t node, std::string_view path) const;
+    uint8_t Match(std::string_view scheme, uint16_t port, std::string_view host, std::string_view path) const;
+
+    std::vector<Node> nodes_;
+    std::vector<Root> roots_;  // One per scheme and port, there are few of them
+    bool has_allow_ = false;
+};
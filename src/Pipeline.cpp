@@ -0,0 +1,304 @@
+#include "Pipeline.h"
+
+#include "ArenaJson.h"
+#include "Ascii.h"
+#include "Origin.h"
+#include "OriginMatcher.h"
+#include "Upstream.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <variant>
+
+namespace {
+
+bool StartsWith(const std::string& str, const std::string& prefix) {
+    return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Origin key and path of a url. Upstream group urls keep "upstream://name" as origin. Throws on malformed url
+std::pair<std::string, std::string> SplitRouteUrl(const std::string& url) {
+    const auto scheme_end = url.find("://");
+    const auto path_start = url.find_first_of("/?#", scheme_end == std::string::npos ? 0 : scheme_end + 3);
+    auto path = path_start == std::string::npos ? std::string() : url.substr(path_start);
+    if (UpstreamName(url))
+        return {url.substr(0, path_start), std::move(path)};
+    return {ParseOrigin(url).Key(), std::move(path)};
+}
+
+// Whole segments only: "/api" matches "/api/v1" and "/api?x", but not "/apix"
+bool PathPrefixMatches(const std::string& path, const std::string& prefix) {
+    if (!StartsWith(path, prefix))
+        return false;
+    return path.size() == prefix.size() || prefix.back() == '/' ||
+           std::string_view("/?#").find(path[prefix.size()]) != std::string_view::npos;
+}
+
+bool ContainsName(const std::vector<std::string>& names, const std::string& name) {
+    return std::any_of(begin(names), end(names), [&name](const auto& n) { return EqualsIgnoreCase(n, name); });
+}
+
+class SetHeaders final : public RequestStage {
+public:
+    explicit SetHeaders(SetHeadersStage config) : config_(std::move(config)) {}
+
+    std::optional<Response> Apply(Request& request) const override {
+        for (const auto& [name, value] : config_.headers)
+            request.MutableHeaderFields().Set(name, value);
+        return {};
+    }
+
+private:
+    SetHeadersStage config_;
+};
+
+class AuthToken final : public RequestStage {
+public:
+    explicit AuthToken(const AuthTokenStage& config) : header_(config.header), token_(config.token) {
+        if (!config.token_env.empty()) {
+            const auto* token = std::getenv(config.token_env.c_str());
+            if (!token)
+                throw std::runtime_error("AuthToken(): environment variable " + config.token_env + " is not set");
+            token_ = token;
+        }
+    }
+
+    std::optional<Response> Apply(Request& request) const override {
+        request.MutableHeaderFields().Set(header_, token_);
+        return {};
+    }
+
+private:
+    std::string header_;
+    std::string token_;
+};
+
+class RewriteUrl final : public RequestStage {
+public:
+    explicit RewriteUrl(RewriteUrlStage config) : config_(std::move(config)) {}
+
+    std::optional<Response> Apply(Request& request) const override {
+        if (!config_.from.empty()) {
+            const auto url = request.Url();
+            if (StartsWith(url, config_.from))
+                request.SetUrl(config_.to + url.substr(config_.from.size()));
+        }
+        if (!config_.path_from.empty()) {
+            const auto path = request.Path();
+            if (StartsWith(path, config_.path_from))
+                request.SetPath(config_.path_to + path.substr(config_.path_from.size()));
+        }
+        return {};
+    }
+
+private:
+    RewriteUrlStage config_;
+};
+
+class OriginFilter final : public RequestStage {
+public:
+    explicit OriginFilter(const OriginFilterStage& config) : matcher_(config.allow, config.deny) {}
+
+    std::optional<Response> Apply(Request& request) const override {
+        if (!matcher_.Allows(request.Url(), request.Path()))
+            return Response{static_cast<int>(ProxyStatus::Denied), "Denied by route"};
+        return {};
+    }
+
+private:
+    OriginMatcher matcher_;
+};
+
+class FilterHeaders final : public ResponseStage {
+public:
+    explicit FilterHeaders(FilterHeadersStage config) : config_(std::move(config)) {}
+
+    void Apply(Response& response) const override {
+        response.headers.RemoveIf([this](const Header& header) {
+            return ContainsName(config_.deny, header.name) ||
+                   (!config_.allow.empty() && !ContainsName(config_.allow, header.name));
+        });
+    }
+
+private:
+    FilterHeadersStage config_;
+};
+
+class TruncateBody final : public ResponseStage {
+public:
+    explicit TruncateBody(const TruncateBodyStage& config) : max_bytes_(config.max_bytes) {}
+
+    void Apply(Response& response) const override {
+        const auto body = response.Body();
+        if (body.size() <= max_bytes_)
+            return;
+        // Cut before a UTF-8 continuation byte would split a character
+        auto size = max_bytes_;
+        while (size > 0 && (static_cast<unsigned char>(body[size]) & 0xC0) == 0x80)
+            --size;
+        // Shared body is cut without copying it
+        if (response.shared_body.owner)
+            response.shared_body.data = body.substr(0, size);
+        else
+            response.body.resize(size);
+    }
+
+private:
+    size_t max_bytes_;
+};
+
+class Project final : public ResponseStage {
+public:
+    explicit Project(const ProjectStage& config) {
+        for (const auto& field : config.fields) {
+            std::vector<std::string> path;
+            size_t start = 0;
+            for (auto dot = field.find('.'); dot != std::string::npos; dot = field.find('.', start)) {
+                path.push_back(field.substr(start, dot - start));
+                start = dot + 1;
+            }
+            path.push_back(field.substr(start));
+            paths_.push_back(std::move(path));
+        }
+    }
+
+    void Apply(Response& response) const override {
+        ArenaScope arena_scope;
+        const auto source = ArenaJson::parse(response.Body(), nullptr, false);
+        // Only Json documents are projected, anything else (including errors) is passed as is
+        if (!source.is_object() && !source.is_array())
+            return;
+
+        ArenaJson target;
+        for (const auto& path : paths_)
+            Copy(source, path, 0, target);
+        response.body = target.is_null() ? "{}" : target.dump();
+        response.shared_body = {};
+    }
+
+private:
+    // Copies value at path[depth..] from source into target, arrays are projected element-wise.
+    // Returns false if there's nothing at that path
+    static bool Copy(const ArenaJson& source, const std::vector<std::string>& path, size_t depth, ArenaJson& target) {
+        if (depth == path.size()) {
+            target = source;
+            return true;
+        }
+
+        if (source.is_array()) {
+            if (!target.is_array())
+                target = ArenaJson::array();
+            bool found = false;
+            for (size_t i = 0; i < source.size(); ++i) {
+                if (target.size() <= i)
+                    target.push_back(nullptr);
+                found = Copy(source[i], path, depth, target[i]) || found;
+            }
+            return found;
+        }
+
+        if (!source.is_object())
+            return false;
+        const auto it = source.find(path[depth]);
+        if (it == source.end())
+            return false;
+
+        const bool existed = target.is_object() && target.contains(path[depth]);
+        if (!Copy(*it, path, depth + 1, target[path[depth]]) && !existed) {
+            target.erase(path[depth]);
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<std::vector<std::string>> paths_;
+};
+
+}  // namespace
+
+Pipeline::Pipeline(const RouteConfig& route) {
+    for (const auto& stage : route.pre) {
+        pre_.push_back(std::visit(
+            [](const auto& config) -> std::unique_ptr<RequestStage> {
+                using T = std::decay_t<decltype(config)>;
+                if constexpr (std::is_same_v<T, SetHeadersStage>)
+                    return std::make_unique<SetHeaders>(config);
+                else if constexpr (std::is_same_v<T, AuthTokenStage>)
+                    return std::make_unique<AuthToken>(config);
+                else if constexpr (std::is_same_v<T, RewriteUrlStage>)
+                    return std::make_unique<RewriteUrl>(config);
+                else
+                    return std::make_unique<OriginFilter>(config);
+            },
+            stage));
+    }
+
+    for (const auto& stage : route.post) {
+        post_.push_back(std::visit(
+            [this](const auto& config) -> std::unique_ptr<ResponseStage> {
+                using T = std::decay_t<decltype(config)>;
+                if constexpr (std::is_same_v<T, FilterHeadersStage>) {
+                    expose_headers_ = true;
+                    return std::make_unique<FilterHeaders>(config);
+                } else if constexpr (std::is_same_v<T, TruncateBodyStage>) {
+                    return std::make_unique<TruncateBody>(config);
+                } else {
+                    return std::make_unique<Project>(config);
+                }
+            },
+            stage));
+    }
+}
+
+std::optional<Response> Pipeline::Before(Request& request) const {
+    for (const auto& stage : pre_) {
+        if (auto response = stage->Apply(request))
+            return response;
+    }
+    return {};
+}
+
+void Pipeline::After(Response& response) const {
+    for (const auto& stage : post_)
+        stage->Apply(response);
+    // Upstream headers reach the client only through an explicit filter
+    if (!expose_headers_)
+        response.headers = {};
+}
+
+RouteTable::RouteTable(const std::vector<RouteConfig>& routes)
+    : default_(RouteConfig{}) {
+    for (const auto& config : routes) {
+        Route route;
+        route.any = config.match.empty();
+        if (!route.any)
+            std::tie(route.origin, route.path) = SplitRouteUrl(config.match);
+        route.pipeline = std::make_unique<Pipeline>(config);
+        routes_.push_back(std::move(route));
+    }
+    std::stable_sort(begin(routes_), end(routes_), [](const Route& lhs, const Route& rhs) {
+        if (lhs.any != rhs.any)
+            return rhs.any;
+        return lhs.path.size() > rhs.path.size();
+    });
+}
+
+const Pipeline& RouteTable::Match(const std::string& url, const std::string& path) const {
+    // Compared by origin rather than by text, so "https://api.example.com" doesn't match a look-alike host such as
+    // "https://api.example.com.attacker.net" and hand it the route's credentials
+    std::optional<std::string> origin;
+    try {
+        origin = SplitRouteUrl(url).first;
+    } catch (const std::exception&) {
+        // Call fails later anyway, only routes for any url apply
+    }
+    for (const auto& route : routes_) {
+        if (route.any || (origin == route.origin && PathPrefixMatches(path, route.path)))
+            return *route.pipeline;
+    }
+    return default_;
+}
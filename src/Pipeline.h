@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Config.h"
+#include "Requests.h"
+#include "Response.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Runs before the call. Returned response is sent instead of making the call
+class RequestStage {
+public:
+    virtual ~RequestStage() = default;
+    virtual std::optional<Response> Apply(Request& request) const = 0;
+};
+
+// Runs on the response before it's written for the client
+class ResponseStage {
+public:
+    virtual ~ResponseStage() = default;
+    virtual void Apply(Response& response) const = 0;
+};
+
+// Stages of one route, built once at startup and run in configured order
+class Pipeline final {
+public:
+    explicit Pipeline(const RouteConfig& route);
+    Pipeline(const Pipeline&) = delete;
+    Pipeline(Pipeline&&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+    Pipeline& operator=(Pipeline&&) = delete;
+
+    ~Pipeline() = default;
+
+    std::optional<Response> Before(Request& request) const;
+    void After(Response& response) const;
+
+private:
+    std::vector<std::unique_ptr<RequestStage>> pre_;
+    std::vector<std::unique_ptr<ResponseStage>> post_;
+    bool expose_headers_ = false;
+};
+
+// Route pipelines by url prefix
+class RouteTable final {
+public:
+    explicit RouteTable(const std::vector<RouteConfig>& routes);
+    RouteTable(const RouteTable&) = delete;
+    RouteTable(RouteTable&&) = delete;
+    RouteTable& operator=(const RouteTable&) = delete;
+    RouteTable& operator=(RouteTable&&) = delete;
+
+    ~RouteTable() = default;
+
+    // Pipeline of the route for request's origin url with the longest prefix of its path, or an empty one
+    const Pipeline& Match(const std::string& url, const std::string& path) const;
+
+private:
+    struct Route {
+        bool any = false;    // Empty match
+        std::string origin;  // Origin::Key(), or "upstream://name"
+        std::string path;
+        std::unique_ptr<Pipeline> pipeline;
+    };
+
+    std::vector<Route> routes_;  // Longest path first, empty matches last
+    Pipeline default_;
+};
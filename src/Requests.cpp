@@ -1,186 +1,524 @@
 #include "Requests.h"
 
+#include "ArenaJson.h"
 #include "HttpClient.h"
 #include "Method.h"
 
-#include <nlohmann/json.hpp>
-
 #include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace {
 
-httplib::Headers ExtractHeaders(const nlohmann::json& json) {
-    httplib::Headers headers;
-    if (json.contains("headers")) {
-        for (const auto& [key, value] : json["headers"].items()) {
-            headers.emplace(key, value);
+// First error met while fields are extracted, later ones are its consequences
+struct DecodeState {
+    DecodeError error = DecodeError::None;
+    std::string_view field;
+
+    void Fail(DecodeError decode_error, std::string_view decode_field = {}) {
+        if (error != DecodeError::None)
+            return;
+        error = decode_error;
+        field = decode_field;
+    }
+
+    bool Failed() const {
+        return error != DecodeError::None;
+    }
+};
+
+// Builds the same DOM as ArenaJson::parse, but through SAX events, so parsing stops as soon as the message breaks a
+// limit: a hostile message costs the part of it read so far, not a full parse
+class LimitedDomBuilder {
+public:
+    LimitedDomBuilder(ArenaJson& root, const DecoderConfig& limits)
+        : root_(root)
+        , limits_(limits) {
+    }
+
+    bool null() {
+        return Add(nullptr);
+    }
+    bool boolean(bool value) {
+        return Add(value);
+    }
+    bool number_integer(ArenaJson::number_integer_t value) {
+        return Add(value);
+    }
+    bool number_unsigned(ArenaJson::number_unsigned_t value) {
+        return Add(value);
+    }
+    bool number_float(ArenaJson::number_float_t value, const ArenaJson::string_t& /*text*/) {
+        return Add(value);
+    }
+    bool string(ArenaJson::string_t& value) {
+        return Add(std::move(value));
+    }
+    bool binary(ArenaJson::binary_t& value) {
+        return Add(ArenaJson::binary(std::move(value)));
+    }
+
+    bool start_object(size_t /*elements*/) {
+        return Open(ArenaJson::value_t::object);
+    }
+    bool key(ArenaJson::string_t& name) {
+        if (counting_headers_ && stack_.size() == 2 && ++headers_ > limits_.max_headers)
+            return Fail(DecodeError::TooManyHeaders);
+        headers_next_ = stack_.size() == 1 && name == "headers";
+        element_ = &(*stack_.back())[std::move(name)];
+        return true;
+    }
+    bool end_object() {
+        return Close();
+    }
+    bool start_array(size_t /*elements*/) {
+        return Open(ArenaJson::value_t::array);
+    }
+    bool end_array() {
+        return Close();
+    }
+
+    template <class Exception>
+    bool parse_error(size_t /*position*/, const std::string& /*last_token*/, const Exception& /*error*/) {
+        return Fail(DecodeError::Syntax);
+    }
+
+    DecodeError Error() const {
+        return error_;
+    }
+
+private:
+    template <class Value>
+    bool Add(Value&& value) {
+        if (stack_.empty())
+            root_ = ArenaJson(std::forward<Value>(value));
+        else if (stack_.back()->is_array())
+            stack_.back()->emplace_back(std::forward<Value>(value));
+        else
+            *element_ = ArenaJson(std::forward<Value>(value));
+        return true;
+    }
+
+    bool Open(ArenaJson::value_t type) {
+        if (stack_.size() >= limits_.max_depth)
+            return Fail(DecodeError::TooDeep);
+        ArenaJson* opened = nullptr;
+        if (stack_.empty()) {
+            root_ = ArenaJson(type);
+            opened = &root_;
+        } else if (stack_.back()->is_array()) {
+            stack_.back()->emplace_back(type);
+            opened = &stack_.back()->back();
+        } else {
+            *element_ = ArenaJson(type);
+            opened = element_;
         }
+        if (stack_.size() == 1)
+            counting_headers_ = headers_next_ && type == ArenaJson::value_t::object;
+        stack_.push_back(opened);
+        return true;
+    }
+
+    bool Close() {
+        stack_.pop_back();
+        return true;
+    }
+
+    bool Fail(DecodeError error) {
+        error_ = error;
+        return false;
+    }
+
+    ArenaJson& root_;
+    const DecoderConfig& limits_;
+    std::vector<ArenaJson*, ArenaAllocator<ArenaJson*>> stack_;  // Open objects and arrays
+    ArenaJson* element_ = nullptr;  // Value of the last key
+    bool headers_next_ = false;     // Last top level key is "headers"
+    bool counting_headers_ = false;
+    size_t headers_ = 0;
+    DecodeError error_ = DecodeError::None;
+};
+
+// Field of an object, or nullptr if it's absent
+ArenaJson* FindField(ArenaJson& json, const char* key) {
+    const auto it = json.find(key);
+    return it == json.end() ? nullptr : &*it;
+}
+
+// Strings are moved out of the DOM, it's dropped right after extraction anyway
+std::optional<std::string> TakeString(ArenaJson& json, std::string_view field, DecodeState& state) {
+    if (!json.is_string()) {
+        state.Fail(DecodeError::WrongType, field);
+        return {};
+    }
+    return std::move(json.get_ref<std::string&>());
+}
+
+std::optional<std::string> TakeRequired(ArenaJson& json, const char* key, DecodeState& state) {
+    auto* value = FindField(json, key);
+    if (!value) {
+        state.Fail(DecodeError::MissingField, key);
+        return {};
+    }
+    return TakeString(*value, key, state);
+}
+
+std::string TakeOptional(ArenaJson& json, const char* key, const char* fallback, DecodeState& state) {
+    auto* value = FindField(json, key);
+    if (!value)
+        return fallback;
+    return TakeString(*value, key, state).value_or(std::string());
+}
+
+HeaderList ExtractHeaders(ArenaJson& json, DecodeState& state) {
+    HeaderList headers;
+    if (auto* fields = FindField(json, "headers")) {
+        if (!fields->is_object()) {
+            state.Fail(DecodeError::WrongType, "headers");
+            return headers;
+        }
+        for (auto& [key, value] : fields->items()) {
+            auto header = TakeString(value, "headers", state);
+            if (!header)
+                return headers;
+            headers.Add(key, std::move(*header));
+        }
+    }
+    // Top level field wins over the header, both carry W3C trace context
+    if (auto* traceparent = FindField(json, "traceparent")) {
+        if (auto value = TakeString(*traceparent, "traceparent", state))
+            headers.Set("traceparent", std::move(*value));
     }
     return headers;
 }
 
-std::optional<Payload> ExtractPayload(const nlohmann::json& json) {
+std::optional<Payload> ExtractPayload(ArenaJson& json, DecodeState& state) {
     std::optional<Payload> payload;
-    if (json.contains("body") && json.contains("content_type")) {
-        payload = {json["body"].get<std::string>(), json["content_type"].get<std::string>()};
+    auto* body = FindField(json, "body");
+    auto* content_type = FindField(json, "content_type");
+    if (body && content_type) {
+        auto body_value = TakeString(*body, "body", state);
+        auto content_type_value = TakeString(*content_type, "content_type", state);
+        if (body_value && content_type_value)
+            payload = {std::move(*body_value), std::move(*content_type_value)};
     }
     return payload;
 }
 
-std::optional<httplib::MultipartFormDataItems> ExtractFormData(const nlohmann::json& json) {
+std::optional<httplib::MultipartFormDataItems> ExtractFormData(ArenaJson& json, DecodeState& state) {
     std::optional<httplib::MultipartFormDataItems> form_data;
-    if (json.contains("form_data")) {
-        form_data = httplib::MultipartFormDataItems{};
-        for (const auto& obj : json["form_data"]) {
-            httplib::MultipartFormData item;
-            item.name = obj.at("name");
-            item.content = obj.at("content");
-            item.filename = obj.value("filename", std::string());
-            item.content_type = obj.at("content_type");
-            form_data->push_back(std::move(item));
+    auto* items = FindField(json, "form_data");
+    if (!items)
+        return form_data;
+    if (!items->is_array()) {
+        state.Fail(DecodeError::WrongType, "form_data");
+        return form_data;
+    }
+
+    form_data = httplib::MultipartFormDataItems{};
+    for (auto& obj : *items) {
+        if (!obj.is_object()) {
+            state.Fail(DecodeError::WrongType, "form_data");
+            return form_data;
         }
+        httplib::MultipartFormData item;
+        item.name = TakeRequired(obj, "name", state).value_or(std::string());
+        item.content = TakeRequired(obj, "content", state).value_or(std::string());
+        item.filename = TakeOptional(obj, "filename", "", state);
+        item.content_type = TakeRequired(obj, "content_type", state).value_or(std::string());
+        form_data->push_back(std::move(item));
     }
     return form_data;
 }
 
-}  // namespace
+std::optional<Method> ExtractMethod(ArenaJson& json, DecodeState& state) {
+    auto* field = FindField(json, "method");
+    if (!field) {
+        state.Fail(DecodeError::MissingField, "method");
+        return std::nullopt;
+    }
+    if (!field->is_string()) {
+        state.Fail(DecodeError::WrongType, "method");
+        return std::nullopt;
+    }
+    const auto method = ParseMethod(field->get_ref<const std::string&>());
+    if (!method)
+        state.Fail(DecodeError::UnknownMethod, "method");
+    return method;
+}
 
-std::unique_ptr<Request> MakeRequest(const std::string& data) {
-    const auto json = nlohmann::json::parse(data);
-    const auto url = json.at("url").get<std::string>();
-    const auto path = json.value("path", "/");
-    const auto method = MethodFromString(json.at("method"));
-    const auto headers = ExtractHeaders(json);
-    const auto payload  =ExtractPayload(json);
-    const auto form_data = ExtractFormData(json);
-
-    if (method == Method::METHOD_GET) {
-        return std::make_unique<GetRequest>(url, path, headers);
-    } else if (method == Method::METHOD_HEAD) {
-        return std::make_unique<HeadRequest>(url, path, headers);
-    } else if (method == Method::METHOD_POST) {
+std::optional<Request> ExtractRequest(ArenaJson& json, DecodeState& state) {
+    auto url = TakeRequired(json, "url", state);
+    auto path = TakeOptional(json, "path", "/", state);
+    const auto method = ExtractMethod(json, state);
+    auto headers = ExtractHeaders(json, state);
+    auto payload = ExtractPayload(json, state);
+    auto form_data = ExtractFormData(json, state);
+    if (state.Failed())
+        return {};
+
+    switch (*method) {
+    case Method::METHOD_GET:
+        return GetRequest(std::move(*url), std::move(path), std::move(headers));
+    case Method::METHOD_HEAD:
+        return HeadRequest(std::move(*url), std::move(path), std::move(headers));
+    case Method::METHOD_POST:
         if (form_data)
-            return std::make_unique<PostRequest>(url, path, headers, *form_data);
+            return PostRequest(std::move(*url), std::move(path), std::move(headers), std::move(*form_data));
         else if (payload)
-            return std::make_unique<PostRequest>(url, path, headers, *payload);
+            return PostRequest(std::move(*url), std::move(path), std::move(headers), std::move(*payload));
         else
-            return std::make_unique<PostRequest>(url, path, headers);
-    } else if (method == Method::METHOD_PUT) {
+            return PostRequest(std::move(*url), std::move(path), std::move(headers));
+    case Method::METHOD_PUT:
         if (form_data)
-            return std::make_unique<PutRequest>(url, path, headers, *form_data);
+            return PutRequest(std::move(*url), std::move(path), std::move(headers), std::move(*form_data));
         else if (payload)
-            return std::make_unique<PutRequest>(url, path, headers, *payload);
-        else
-            throw std::runtime_error("MakeRequest(): PUT method should put something");
-    } else if (method == Method::METHOD_DELETE) {
-        return std::make_unique<DeleteRequest>(url, path, headers, payload);
-    } else if (method == Method::METHOD_OPTIONS) {
-        return std::make_unique<OptionsRequest>(url, path, headers);
-    } else if (method == Method::METHOD_PATCH) {
-        return std::make_unique<PatchRequest>(url, path, headers, payload);
+            return PutRequest(std::move(*url), std::move(path), std::move(headers), std::move(*payload));
+        state.Fail(DecodeError::NoPayload);
+        return {};
+    case Method::METHOD_DELETE:
+        return DeleteRequest(std::move(*url), std::move(path), std::move(headers), std::move(payload));
+    case Method::METHOD_OPTIONS:
+        return OptionsRequest(std::move(*url), std::move(path), std::move(headers));
+    case Method::METHOD_PATCH:
+        return PatchRequest(std::move(*url), std::move(path), std::move(headers), std::move(payload));
+    }
+    state.Fail(DecodeError::UnknownMethod, "method");
+    return {};
+}
+
+std::optional<SubscribeCommand> ExtractSubscribe(ArenaJson& json, DecodeState& state) {
+    auto id = TakeRequired(json, "subscription", state);
+    // Polling only makes sense for reads
+    if (!FindField(json, "method"))
+        json["method"] = "GET";
+    auto request = ExtractRequest(json, state);
+    auto* interval = FindField(json, "interval_ms");
+    if (!interval)
+        state.Fail(DecodeError::MissingField, "interval_ms");
+    else if (!interval->is_number_integer())
+        state.Fail(DecodeError::WrongType, "interval_ms");
+    auto* delta = FindField(json, "delta");
+    if (delta && !delta->is_boolean())
+        state.Fail(DecodeError::WrongType, "delta");
+    if (state.Failed())
+        return {};
+
+    if (request->GetMethod() != Method::METHOD_GET) {
+        state.Fail(DecodeError::NotGet, "method");
+        return std::nullopt;
+    }
+    return SubscribeCommand{std::move(*id), std::move(*request), std::chrono::milliseconds(interval->get<int64_t>()),
+                            delta && delta->get<bool>()};
+}
+
+DecodeResult Decode(std::string_view data, const DecoderConfig& limits, bool commands) {
+    DecodeResult result;
+    // Message DOM is dropped at once after fields are extracted
+    ArenaScope arena_scope;
+    ArenaJson json;
+    LimitedDomBuilder builder(json, limits);
+    DecodeState state;
+    if (!ArenaJson::sax_parse(data.begin(), data.end(), &builder)) {
+        state.Fail(builder.Error());
+    } else if (!json.is_object()) {
+        state.Fail(DecodeError::WrongType);
+    } else if (auto* type = commands ? FindField(json, "type") : nullptr; !type) {
+        if (auto request = ExtractRequest(json, state))
+            result.message = std::move(*request);
+    } else if (!type->is_string()) {
+        state.Fail(DecodeError::WrongType, "type");
+    } else if (type->get_ref<const std::string&>() == "subscribe") {
+        if (auto command = ExtractSubscribe(json, state))
+            result.message = std::move(*command);
+    } else if (type->get_ref<const std::string&>() == "unsubscribe") {
+        if (auto id = TakeRequired(json, "subscription", state))
+            result.message = UnsubscribeCommand{std::move(*id)};
     } else {
-        throw std::runtime_error("MakeRequest(): unhandled method");
+        state.Fail(DecodeError::UnknownType, "type");
     }
+    result.error = state.error;
+    result.field = state.field;
+    return result;
+}
+
+}  // namespace
+
+Request MakeRequest(const std::string& data) {
+    auto result = Decode(data, {}, false);
+    if (!result.message)
+        throw std::runtime_error("MakeRequest(): " + result.ErrorText());
+    return std::get<Request>(std::move(*result.message));
+}
 
-    return nullptr;
+Message MakeMessage(const std::string& data) {
+    auto result = Decode(data, {}, true);
+    if (!result.message)
+        throw std::runtime_error("MakeMessage(): " + result.ErrorText());
+    return std::move(*result.message);
 }
 
+DecodeResult DecodeMessage(std::string_view data, const DecoderConfig& limits) {
+    return Decode(data, limits, true);
+}
 
-Request::Request(std::string url, std::string path, httplib::Headers headers)
+std::string DecodeResult::ErrorText() const {
+    const std::string name(field);
+    switch (error) {
+    case DecodeError::None:
+        return {};
+    case DecodeError::Syntax:
+        return "not a Json document";
+    case DecodeError::TooDeep:
+        return "nesting is too deep";
+    case DecodeError::TooManyHeaders:
+        return "too many headers";
+    case DecodeError::MissingField:
+        return "missing " + name;
+    case DecodeError::WrongType:
+        return name.empty() ? "not a Json object" : "wrong type of " + name;
+    case DecodeError::UnknownMethod:
+        return "unhandled method";
+    case DecodeError::NoPayload:
+        return "PUT method should put something";
+    case DecodeError::UnknownType:
+        return "unknown message type";
+    case DecodeError::NotGet:
+        return "only GET can be subscribed to";
+    }
+    return "unknown error";
+}
+
+
+RequestLine::RequestLine(std::string url, std::string path, HeaderList headers)
     : url_(std::move(url))
     , path_(std::move(path))
     , headers_(std::move(headers)) {
 }
 
-httplib::Headers Request::Headers() const {
+httplib::Headers RequestLine::Headers() const {
+    return headers_.ToHttplib();
+}
+
+const HeaderList& RequestLine::HeaderFields() const {
     return headers_;
 }
 
-std::string Request::Path() const {
+void RequestLine::SetUrl(std::string url) {
+    url_ = std::move(url);
+}
+
+void RequestLine::SetPath(std::string path) {
+    path_ = std::move(path);
+}
+
+HeaderList& RequestLine::MutableHeaderFields() {
+    return headers_;
+}
+
+std::string RequestLine::Path() const {
     return path_.empty() ? "/" : path_;
 }
 
-std::string Request::Url() const {
+std::string RequestLine::Url() const {
     return url_;
 }
 
 
-GetRequest::GetRequest(std::string url, std::string path, httplib::Headers headers)
-    : Request(std::move(url), std::move(path), std::move(headers)) {
+GetRequest::GetRequest(std::string url, std::string path, HeaderList headers)
+    : RequestLine(std::move(url), std::move(path), std::move(headers)) {
 }
 
-Response GetRequest::Accept(HttpClient& http_client) {
-    return http_client.Visit(*this);
+
+HeadRequest::HeadRequest(std::string url, std::string path, HeaderList headers)
+    : RequestLine(std::move(url), std::move(path), std::move(headers)) {
 }
 
 
-HeadRequest::HeadRequest(std::string url, std::string path, httplib::Headers headers)
-    : Request(std::move(url), std::move(path), std::move(headers)) {
+PostRequest::PostRequest(std::string url, std::string path, HeaderList headers)
+    : RequestLine(std::move(url), std::move(path), std::move(headers)) {
 }
 
-Response HeadRequest::Accept(HttpClient& http_client) {
-    return http_client.Visit(*this);
+PostRequest::PostRequest(std::string url, std::string path, HeaderList headers, Payload payload)
+    : RequestLine(std::move(url), std::move(path), std::move(headers))
+    , WithPayload(std::move(payload)) {
 }
 
-
-PostRequest::PostRequest(std::string url, std::string path, httplib::Headers headers)
-    : Request(std::move(url), std::move(path), std::move(headers)) {
+PostRequest::PostRequest(std::string url, std::string path, HeaderList headers, httplib::MultipartFormDataItems form_data)
+    : RequestLine(std::move(url), std::move(path), std::move(headers))
+    , WithMultipartFormData(std::move(form_data)) {
 }
 
-PostRequest::PostRequest(std::string url, std::string path, httplib::Headers headers, Payload payload)
-    : Request(std::move(url), std::move(path), std::move(headers))
+
+PutRequest::PutRequest(std::string url, std::string path, HeaderList headers, Payload payload)
+    : RequestLine(std::move(url), std::move(path), std::move(headers))
     , WithPayload(std::move(payload)) {
 }
 
-PostRequest::PostRequest(std::string url, std::string path, httplib::Headers headers, httplib::MultipartFormDataItems form_data)
-    : Request(std::move(url), std::move(path), std::move(headers))
+PutRequest::PutRequest(std::string url, std::string path, HeaderList headers, httplib::MultipartFormDataItems form_data)
+    : RequestLine(std::move(url), std::move(path), std::move(headers))
     , WithMultipartFormData(std::move(form_data)) {
 }
 
-Response PostRequest::Accept(HttpClient& http_client) {
-    return http_client.Visit(*this);
+
+DeleteRequest::DeleteRequest(std::string url, std::string path, HeaderList headers, std::optional<Payload> payload)
+    : RequestLine(std::move(url), std::move(path), std::move(headers))
+    , WithPayload(std::move(payload)) {
 }
 
 
-PutRequest::PutRequest(std::string url, std::string path, httplib::Headers headers, Payload payload)
-    : Request(std::move(url), std::move(path), std::move(headers))
+OptionsRequest::OptionsRequest(std::string url, std::string path, HeaderList headers)
+    : RequestLine(std::move(url), std::move(path), std::move(headers)) {
+}
+
+
+PatchRequest::PatchRequest(std::string url, std::string path, HeaderList headers, std::optional<Payload> payload)
+    : RequestLine(std::move(url), std::move(path), std::move(headers))
     , WithPayload(std::move(payload)) {
 }
 
-PutRequest::PutRequest(std::string url, std::string path, httplib::Headers headers, httplib::MultipartFormDataItems form_data)
-    : Request(std::move(url), std::move(path), std::move(headers))
-    , WithMultipartFormData(std::move(form_data)) {
+
+Response Request::Accept(HttpClient& http_client) const {
+    return std::visit([&http_client](const auto& request) { return http_client.Visit(request); }, request_);
 }
 
-Response PutRequest::Accept(HttpClient& http_client) {
-    return http_client.Visit(*this);
+Method Request::GetMethod() const {
+    return std::visit([](const auto& request) { return std::decay_t<decltype(request)>::kMethod; }, request_);
 }
 
+std::string Request::Url() const {
+    return Line().Url();
+}
 
-DeleteRequest::DeleteRequest(std::string url, std::string path, httplib::Headers headers, std::optional<Payload> payload)
-    : Request(std::move(url), std::move(path), std::move(headers))
-    , WithPayload(std::move(payload)) {
+std::string Request::Path() const {
+    return Line().Path();
 }
 
-Response DeleteRequest::Accept(HttpClient& http_client) {
-    return http_client.Visit(*this);
+httplib::Headers Request::Headers() const {
+    return Line().Headers();
 }
 
+const HeaderList& Request::HeaderFields() const {
+    return Line().HeaderFields();
+}
 
-OptionsRequest::OptionsRequest(std::string url, std::string path, httplib::Headers headers)
-    : Request(std::move(url), std::move(path), std::move(headers)) {
+void Request::SetUrl(std::string url) {
+    Line().SetUrl(std::move(url));
 }
 
-Response OptionsRequest::Accept(HttpClient& http_client) {
-    return http_client.Visit(*this);
+void Request::SetPath(std::string path) {
+    Line().SetPath(std::move(path));
 }
 
+HeaderList& Request::MutableHeaderFields() {
+    return Line().MutableHeaderFields();
+}
 
-PatchRequest::PatchRequest(std::string url, std::string path, httplib::Headers headers, std::optional<Payload> payload)
-    : Request(std::move(url), std::move(path), std::move(headers))
-    , WithPayload(std::move(payload)) {
+const RequestLine& Request::Line() const {
+    return std::visit([](const auto& request) -> const RequestLine& { return request; }, request_);
 }
 
-Response PatchRequest::Accept(HttpClient& http_client) {
-    return http_client.Visit(*this);
+RequestLine& Request::Line() {
+    return std::visit([](auto& request) -> RequestLine& { return request; }, request_);
 }
@@ -1,42 +1,43 @@
 #pragma once
 
+#include "Config.h"
+#include "HeaderList.h"
+#include "Method.h"
 #include "Response.h"
 
 #include <httplib.h>
 
-#include <memory>
+#include <chrono>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
 
 class HttpClient;
 
-class Request {
+// Fields every request has
+class RequestLine {
 public:
-    Request(std::string url, std::string path, httplib::Headers headers = {});
-    Request(const Request&) = default;
-    Request(Request&&) = default;
-    Request& operator=(const Request&) = default;
-    Request& operator=(Request&&) = default;
-
-    virtual ~Request() = default;
-
-    virtual Response Accept(HttpClient& http_client) = 0;
+    RequestLine(std::string url, std::string path, HeaderList headers = {});
 
     std::string Url() const;
     std::string Path() const;
+    // Headers in httplib form, for the call itself
     httplib::Headers Headers() const;
+    const HeaderList& HeaderFields() const;
+
+    void SetUrl(std::string url);
+    void SetPath(std::string path);
+    HeaderList& MutableHeaderFields();
 
 private:
     std::string url_;
     std::string path_;
-    httplib::Headers headers_;
+    HeaderList headers_;
 };
 
 
-// Request factory
-std::unique_ptr<Request> MakeRequest(const std::string& data);
-
-
 struct Payload {
     std::string body;
     std::string content_type;
@@ -78,47 +79,137 @@ protected:
 
 /////////////////////////////////////////////
 
-class GetRequest final : public Request {
+class GetRequest final : public RequestLine {
 public:
-    GetRequest(std::string url, std::string path, httplib::Headers headers);
-    Response Accept(HttpClient& http_client) override;
+    GetRequest(std::string url, std::string path, HeaderList headers);
+    static constexpr Method kMethod = Method::METHOD_GET;
 };
 
-class HeadRequest final : public Request {
+class HeadRequest final : public RequestLine {
 public:
-    HeadRequest(std::string url, std::string path, httplib::Headers headers);
-    Response Accept(HttpClient& http_client) override;
+    HeadRequest(std::string url, std::string path, HeaderList headers);
+    static constexpr Method kMethod = Method::METHOD_HEAD;
 };
 
-class PostRequest final : public Request, public WithPayload, public WithMultipartFormData {
+class PostRequest final : public RequestLine, public WithPayload, public WithMultipartFormData {
 public:
-    PostRequest(std::string url, std::string path, httplib::Headers headers);
-    PostRequest(std::string url, std::string path, httplib::Headers headers, Payload payload);
-    PostRequest(std::string url, std::string path, httplib::Headers headers, httplib::MultipartFormDataItems form_data);
-    Response Accept(HttpClient& http_client) override;
+    PostRequest(std::string url, std::string path, HeaderList headers);
+    PostRequest(std::string url, std::string path, HeaderList headers, Payload payload);
+    PostRequest(std::string url, std::string path, HeaderList headers, httplib::MultipartFormDataItems form_data);
+    static constexpr Method kMethod = Method::METHOD_POST;
 };
 
-class PutRequest final : public Request, public WithPayload, public WithMultipartFormData {
+class PutRequest final : public RequestLine, public WithPayload, public WithMultipartFormData {
 public:
-    PutRequest(std::string url, std::string path, httplib::Headers headers, Payload payload);
-    PutRequest(std::string url, std::string path, httplib::Headers headers, httplib::MultipartFormDataItems form_data);
-    Response Accept(HttpClient& http_client) override;
+    PutRequest(std::string url, std::string path, HeaderList headers, Payload payload);
+    PutRequest(std::string url, std::string path, HeaderList headers, httplib::MultipartFormDataItems form_data);
+    static constexpr Method kMethod = Method::METHOD_PUT;
 };
 
-class DeleteRequest final : public Request, public WithPayload {
+class DeleteRequest final : public RequestLine, public WithPayload {
 public:
-    DeleteRequest(std::string url, std::string path, httplib::Headers headers, std::optional<Payload> payload);
-    Response Accept(HttpClient& http_client) override;
+    DeleteRequest(std::string url, std::string path, HeaderList headers, std::optional<Payload> payload);
+    static constexpr Method kMethod = Method::METHOD_DELETE;
 };
 
-class OptionsRequest final : public Request {
+class OptionsRequest final : public RequestLine {
 public:
-    OptionsRequest(std::string url, std::string path, httplib::Headers headers);
-    Response Accept(HttpClient& http_client) override;
+    OptionsRequest(std::string url, std::string path, HeaderList headers);
+    static constexpr Method kMethod = Method::METHOD_OPTIONS;
 };
 
-class PatchRequest final : public Request, public WithPayload {
+class PatchRequest final : public RequestLine, public WithPayload {
 public:
-    PatchRequest(std::string url, std::string path, httplib::Headers headers, std::optional<Payload> payload);
-    Response Accept(HttpClient& http_client) override;
+    PatchRequest(std::string url, std::string path, HeaderList headers, std::optional<Payload> payload);
+    static constexpr Method kMethod = Method::METHOD_PATCH;
+};
+
+/////////////////////////////////////////////
+
+// Request of any method, held by value. Per-method behavior is picked at compile time with std::visit
+class Request {
+public:
+    using Variant = std::variant<GetRequest, HeadRequest, PostRequest, PutRequest, DeleteRequest, OptionsRequest,
+                                 PatchRequest>;
+
+    template <class T, class = std::enable_if_t<std::is_constructible_v<Variant, T&&>>>
+    Request(T&& request) : request_(std::forward<T>(request)) {}
+
+    Response Accept(HttpClient& http_client) const;
+    Method GetMethod() const;
+
+    std::string Url() const;
+    std::string Path() const;
+    httplib::Headers Headers() const;
+    const HeaderList& HeaderFields() const;
+
+    // For route stages
+    void SetUrl(std::string url);
+    void SetPath(std::string path);
+    HeaderList& MutableHeaderFields();
+
+    // Concrete request, or nullptr if it has another method
+    template <class T>
+    const T* As() const {
+        return std::get_if<T>(&request_);
+    }
+
+    template <class Visitor>
+    decltype(auto) Visit(Visitor&& visitor) const {
+        return std::visit(std::forward<Visitor>(visitor), request_);
+    }
+
+private:
+    const RequestLine& Line() const;
+    RequestLine& Line();
+
+    Variant request_;
 };
+
+
+// Request factory, throws on malformed data
+Request MakeRequest(const std::string& data);
+
+
+// Asks proxy to poll GET request and push its response whenever it changes
+struct SubscribeCommand {
+    std::string id;  // Chosen by client, tags pushed frames
+    Request request;
+    std::chrono::milliseconds interval;
+    bool delta = false;  // Json bodies are pushed as JSON Patch against the previous one
+};
+
+struct UnsubscribeCommand {
+    std::string id;
+};
+
+using Message = std::variant<Request, SubscribeCommand, UnsubscribeCommand>;
+
+// Request, or subscription command if message has "type" field. Throws on malformed data
+Message MakeMessage(const std::string& data);
+
+
+enum class DecodeError {
+    None,
+    Syntax,
+    TooDeep,
+    TooManyHeaders,
+    MissingField,
+    WrongType,
+    UnknownMethod,
+    NoPayload,    // PUT without body or form data
+    UnknownType,  // Message type other than subscribe or unsubscribe
+    NotGet        // Subscription to a method other than GET
+};
+
+struct DecodeResult {
+    std::optional<Message> message;  // Set if there's no error
+    DecodeError error = DecodeError::None;
+    std::string_view field;  // Field the error is about, if any
+
+    std::string ErrorText() const;
+};
+
+// MakeMessage that reports malformed data instead of throwing, for the hot path: clients choose what's sent, and
+// unwinding an exception per bad message is a cheap way to burn server's CPU
+DecodeResult DecodeMessage(std::string_view data, const DecoderConfig& limits = {});
@@ -0,0 +1,280 @@
+#include "ResolverCache.h"
+
+#include "Ascii.h"
+#include "HappyEyeballs.h"
+
+// httplib pulls in the platform socket headers (and WSAStartup on Windows)
+#include <httplib.h>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+void AddUnique(std::vector<ResolvedAddress>& addresses, ResolvedAddress address) {
+    const auto same_ip = [&address](const ResolvedAddress& a) { return a.ip == address.ip; };
+    if (std::none_of(begin(addresses), end(addresses), same_ip))
+        addresses.push_back(std::move(address));
+}
+
+bool HasBothFamilies(const std::vector<ResolvedAddress>& addresses) {
+    const auto is_v6 = [](const ResolvedAddress& a) { return a.family == ResolvedAddress::Family::V6; };
+    return std::any_of(begin(addresses), end(addresses), is_v6) && !std::all_of(begin(addresses), end(addresses), is_v6);
+}
+
+}  // namespace
+
+Resolution SystemResolverSource::Resolve(const std::string& host) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0)
+        return {};
+
+    Resolution resolution;
+    for (auto* ai = result; ai != nullptr; ai = ai->ai_next) {
+        char buffer[INET6_ADDRSTRLEN] = {};
+        if (ai->ai_family == AF_INET) {
+            const auto* addr = reinterpret_cast<const sockaddr_in*>(ai->ai_addr);
+            if (inet_ntop(AF_INET, &addr->sin_addr, buffer, sizeof(buffer)))
+                AddUnique(resolution.addresses, {ResolvedAddress::Family::V4, buffer});
+        } else if (ai->ai_family == AF_INET6) {
+            const auto* addr = reinterpret_cast<const sockaddr_in6*>(ai->ai_addr);
+            if (inet_ntop(AF_INET6, &addr->sin6_addr, buffer, sizeof(buffer)))
+                AddUnique(resolution.addresses, {ResolvedAddress::Family::V6, buffer});
+        }
+    }
+    freeaddrinfo(result);
+    return resolution;
+}
+
+
+HostsFileSource::HostsFileSource(std::istream& hosts, std::unique_ptr<ResolverSource> fallback)
+    : fallback_(std::move(fallback)) {
+    std::string line;
+    while (std::getline(hosts, line)) {
+        const auto comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+
+        std::istringstream fields(line);
+        std::string ip;
+        if (!(fields >> ip))
+            continue;
+
+        const auto family = ip.find(':') != std::string::npos ? ResolvedAddress::Family::V6 : ResolvedAddress::Family::V4;
+        std::string name;
+        while (fields >> name)
+            AddUnique(table_[LowerAscii(name)], {family, ip});
+    }
+}
+
+std::unique_ptr<HostsFileSource> HostsFileSource::FromFile(const std::string& path,
+                                                           std::unique_ptr<ResolverSource> fallback) {
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("HostsFileSource::FromFile(): can't open " + path);
+    return std::make_unique<HostsFileSource>(file, std::move(fallback));
+}
+
+Resolution HostsFileSource::Resolve(const std::string& host) {
+    const auto it = table_.find(LowerAscii(host));
+    if (it != table_.end())
+        return {it->second, {}};
+    return fallback_ ? fallback_->Resolve(host) : Resolution{};
+}
+
+
+ResolverCache::ResolverCache(std::unique_ptr<ResolverSource> source)
+    : ResolverCache(std::move(source), Options{}) {
+}
+
+ResolverCache::ResolverCache(std::unique_ptr<ResolverSource> source, Options options)
+    : source_(std::move(source))
+    , options_(std::move(options))
+    , refresher_(&ResolverCache::RefreshLoop, this)
+    , racer_(&ResolverCache::RaceLoop, this) {
+}
+
+ResolverCache::~ResolverCache() {
+    {
+        auto lock = std::lock_guard(guard_);
+        stop_ = true;
+    }
+    refresh_cv_.notify_all();
+    race_cv_.notify_all();
+    refresher_.join();
+    racer_.join();
+}
+
+std::optional<std::string> ResolverCache::Lookup(const std::string& host, uint16_t port) {
+    const auto key = LowerAscii(host) + ":" + std::to_string(port);
+
+    RecordPtr record;
+    {
+        auto lock = std::lock_guard(guard_);
+        const auto it = records_.find(key);
+        const auto now = options_.now();
+        if (it != records_.end() && now < it->second->expires_at) {
+            record = it->second;
+            const bool stale = now >= record->refresh_at;
+            if (stale && in_flight_.count(key) == 0 && refresh_pending_.insert(key).second) {
+                refresh_queue_.push_back({key, host, port});
+                refresh_cv_.notify_one();
+            }
+        }
+    }
+
+    if (!record)
+        record = Fetch(key, host, port);
+
+    if (record->addresses.empty())
+        return {};
+    return record->addresses.front().ip;
+}
+
+ResolverCache::RecordPtr ResolverCache::Fetch(const std::string& key, const std::string& host, uint16_t port) {
+    std::promise<RecordPtr> promise;
+    {
+        auto lock = std::unique_lock(guard_);
+        const auto it = in_flight_.find(key);
+        if (it != in_flight_.end()) {
+            auto future = it->second;
+            lock.unlock();
+            return future.get();
+        }
+        in_flight_.emplace(key, promise.get_future().share());
+    }
+
+    RecordPtr record;
+    try {
+        record = ResolveNow(host);
+    } catch (std::exception&) {
+        record = NegativeRecord();
+    }
+
+    Store(key, record);
+    promise.set_value(record);
+
+    // Lookups get RFC 8305 order meanwhile, the caller doesn't wait for a connection it won't use
+    if (options_.happy_eyeballs && HasBothFamilies(record->addresses)) {
+        auto lock = std::lock_guard(guard_);
+        if (race_queue_.size() < options_.max_queued_races) {
+            race_queue_.push_back({key, port, record});
+            race_cv_.notify_one();
+        }
+    }
+    return record;
+}
+
+ResolverCache::RecordPtr ResolverCache::ResolveNow(const std::string& host) {
+    auto resolution = source_->Resolve(host);
+    if (resolution.addresses.empty())
+        return NegativeRecord();
+
+    auto record = std::make_shared<Record>();
+    const auto now = options_.now();
+    const auto ttl = std::clamp(resolution.ttl.value_or(options_.default_ttl), options_.min_ttl, options_.max_ttl);
+    record->addresses = InterleaveFamilies(std::move(resolution.addresses));
+    record->expires_at = now + ttl;
+    record->refresh_at = now + std::chrono::duration_cast<std::chrono::milliseconds>(ttl * options_.refresh_ahead);
+    return record;
+}
+
+ResolverCache::RecordPtr ResolverCache::NegativeRecord() const {
+    auto record = std::make_shared<Record>();
+    record->expires_at = options_.now() + options_.negative_ttl;
+    record->refresh_at = record->expires_at;
+    return record;
+}
+
+void ResolverCache::Store(const std::string& key, RecordPtr& record) {
+    auto lock = std::lock_guard(guard_);
+    in_flight_.erase(key);
+
+    auto& slot = records_[key];
+    // Failed re-resolution doesn't replace a still valid positive record
+    const bool keep_previous = record->addresses.empty() && slot && !slot->addresses.empty() &&
+                               options_.now() < slot->expires_at;
+    if (keep_previous)
+        record = slot;
+    else
+        slot = record;
+
+    if (records_.size() > options_.max_entries) {
+        const auto now = options_.now();
+        for (auto it = records_.begin(); it != records_.end();) {
+            if (it->first != key && now >= it->second->expires_at)
+                it = records_.erase(it);
+            else
+                ++it;
+        }
+        for (auto it = records_.begin(); records_.size() > options_.max_entries && it != records_.end();) {
+            if (it->first != key)
+                it = records_.erase(it);
+            else
+                ++it;
+        }
+    }
+}
+
+void ResolverCache::Race(const RaceTask& task) {
+    const auto winner =
+        RaceConnect(task.record->addresses, task.port, options_.connection_attempt_delay, options_.connect_timeout);
+    if (!winner || *winner == 0)
+        return;
+
+    auto record = std::make_shared<Record>(*task.record);
+    std::rotate(record->addresses.begin(), record->addresses.begin() + *winner,
+                record->addresses.begin() + *winner + 1);
+
+    auto lock = std::lock_guard(guard_);
+    // Record may have been refreshed or evicted meanwhile
+    const auto it = records_.find(task.key);
+    if (it != records_.end() && it->second == task.record)
+        it->second = std::move(record);
+}
+
+void ResolverCache::RefreshLoop() {
+    while (true) {
+        RefreshTask task;
+        {
+            auto lock = std::unique_lock(guard_);
+            refresh_cv_.wait(lock, [this] { return stop_ || !refresh_queue_.empty(); });
+            if (stop_)
+                return;
+            task = std::move(refresh_queue_.front());
+            refresh_queue_.pop_front();
+        }
+
+        Fetch(task.key, task.host, task.port);
+
+        auto lock = std::lock_guard(guard_);
+        refresh_pending_.erase(task.key);
+    }
+}
+
+void ResolverCache::RaceLoop() {
+    while (true) {
+        RaceTask task;
+        {
+            auto lock = std::unique_lock(guard_);
+            race_cv_.wait(lock, [this] { return stop_ || !race_queue_.empty(); });
+            if (stop_)
+                return;
+            task = std::move(race_queue_.front());
+            race_queue_.pop_front();
+        }
+        Race(task);
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct ResolvedAddress {
+    enum class Family { V4, V6 };
+
+    Family family = Family::V4;
+    std::string ip;
+};
+
+struct Resolution {
+    std::vector<ResolvedAddress> addresses;  // Empty means "no such host"
+    std::optional<std::chrono::milliseconds> ttl;  // Record TTL, if the source knows it
+};
+
+// Address lookup backend
+class ResolverSource {
+public:
+    virtual ~ResolverSource() = default;
+    virtual Resolution Resolve(const std::string& host) = 0;
+};
+
+// Blocking getaddrinfo(). TTLs are not exposed by it, so cache default is used
+class SystemResolverSource final : public ResolverSource {
+public:
+    Resolution Resolve(const std::string& host) override;
+};
+
+// Static table in /etc/hosts format, with optional fallback for names not listed
+class HostsFileSource final : public ResolverSource {
+public:
+    explicit HostsFileSource(std::istream& hosts, std::unique_ptr<ResolverSource> fallback = {});
+    static std::unique_ptr<HostsFileSource> FromFile(const std::string& path,
+                                                     std::unique_ptr<ResolverSource> fallback = {});
+
+    Resolution Resolve(const std::string& host) override;
+
+private:
+    std::unordered_map<std::string, std::vector<ResolvedAddress>> table_;
+    std::unique_ptr<ResolverSource> fallback_;
+};
+
+// Resolver cache shared by all upstream connections.
+// Records live for their TTL (clamped), failures are cached for negative_ttl. Once a record is older than
+// refresh_ahead * TTL it is still served, while a background thread re-resolves it. When a host has both
+// IPv4 and IPv6 addresses, the new record is served in RFC 8305 order right away, and a second background thread
+// races connections to them Happy Eyeballs style and moves the winner first. Races never hold up refreshes; beyond
+// max_queued_races pending ones, records just keep RFC 8305 order.
+class ResolverCache final {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::chrono::milliseconds default_ttl{std::chrono::seconds(60)};
+        std::chrono::milliseconds min_ttl{std::chrono::seconds(1)};
+        std::chrono::milliseconds max_ttl{std::chrono::hours(1)};
+        std::chrono::milliseconds negative_ttl{std::chrono::seconds(5)};
+        double refresh_ahead = 0.8;
+        size_t max_entries = 1024;
+        bool happy_eyeballs = true;
+        std::chrono::milliseconds connection_attempt_delay{250};
+        std::chrono::milliseconds connect_timeout{std::chrono::seconds(3)};
+        size_t max_queued_races = 16;
+        std::function<Clock::time_point()> now = Clock::now;
+    };
+
+    explicit ResolverCache(std::unique_ptr<ResolverSource> source);
+    ResolverCache(std::unique_ptr<ResolverSource> source, Options options);
+    ResolverCache(const ResolverCache&) = delete;
+    ResolverCache(ResolverCache&&) = delete;
+    ResolverCache& operator=(const ResolverCache&) = delete;
+    ResolverCache& operator=(ResolverCache&&) = delete;
+
+    ~ResolverCache();
+
+    // Preferred address for host:port, or nothing if host doesn't resolve.
+    // Blocks only on a cold or expired record, for the resolution alone; concurrent lookups of the same key share one
+    std::optional<std::string> Lookup(const std::string& host, uint16_t port);
+
+private:
+    struct Record {
+        std::vector<ResolvedAddress> addresses;
+        Clock::time_point refresh_at;
+        Clock::time_point expires_at;
+    };
+    using RecordPtr = std::shared_ptr<const Record>;
+
+    struct RefreshTask {
+        std::string key;
+        std::string host;
+        uint16_t port = 0;
+    };
+
+    struct RaceTask {
+        std::string key;
+        uint16_t port = 0;
+        RecordPtr record;  // Reordered only if still the cached one when the race ends
+    };
+
+    RecordPtr Fetch(const std::string& key, const std::string& host, uint16_t port);
+    RecordPtr ResolveNow(const std::string& host);
+    RecordPtr NegativeRecord() const;
+    void Store(const std::string& key, RecordPtr& record);
+    void Race(const RaceTask& task);
+    void RefreshLoop();
+    void RaceLoop();
+
+    std::unique_ptr<ResolverSource> source_;
+    Options options_;
+
+    std::mutex guard_;
+    std::unordered_map<std::string, RecordPtr> records_;
+    std::unordered_map<std::string, std::shared_future<RecordPtr>> in_flight_;
+    std::unordered_set<std::string> refresh_pending_;
+    std::deque<RefreshTask> refresh_queue_;
+    std::condition_variable refresh_cv_;
+    std::deque<RaceTask> race_queue_;
+    std::condition_variable race_cv_;
+    bool stop_ = false;
+    std::thread refresher_;
+    std::thread racer_;
+};
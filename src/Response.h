@@ -1,8 +1,49 @@
 #pragma once
 
+#include "HeaderList.h"
+
+#include <memory>
 #include <string>
+#include <string_view>
+
+// Body that lives outside the response, e.g. in a mapped cache file, so it isn't copied to the heap
+struct SharedBody {
+    std::shared_ptr<const void> owner;  // Keeps data valid, null if there is no shared body
+    std::string_view data;
+};
 
 struct Response {
     int status = 0;
     std::string body;
+    HeaderList headers = {};  // Sent to client only if route has filter_headers stage
+    SharedBody shared_body = {};  // Used instead of body if set
+
+    std::string_view Body() const {
+        return shared_body.owner ? shared_body.data : std::string_view(body);
+    }
+
+    // Body to change, shared one is copied first
+    std::string& MutableBody() {
+        if (shared_body.owner) {
+            body.assign(shared_body.data);
+            shared_body = {};
+        }
+        return body;
+    }
 };
+
+// Statuses set by proxy itself, above any HTTP status and httplib::Error value
+enum class ProxyStatus {
+    CircuitOpen = 1000,   // Upstream origin is failing, call wasn't attempted
+    Backpressure = 1001,  // Client doesn't keep up with its responses, request wasn't accepted
+    Denied = 1002,        // Origin isn't allowed by access rules or route
+};
+
+inline bool IsProxyStatus(int status) {
+    return status >= static_cast<int>(ProxyStatus::CircuitOpen);
+}
+
+// Transport errors are reported as httplib::Error values, which are all below any HTTP status
+inline bool IsUpstreamFailure(int status) {
+    return status < 100 || status >= 500;
+}
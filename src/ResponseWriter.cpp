@@ -0,0 +1,154 @@
+#include "ResponseWriter.h"
+
+#include <stdexcept>
+#include <string_view>
+
+constexpr size_t kMaxRetainedResponseBytes = 1024 * 1024;
+
+namespace {
+
+// Length of UTF-8 sequence starting at data[pos], or 0 if it's malformed (overlong, surrogate, out of range)
+size_t Utf8SequenceLength(std::string_view data, size_t pos) {
+    const auto byte = [&data](size_t i) { return static_cast<unsigned char>(data[i]); };
+    const auto is_continuation = [&](size_t i) { return i < data.size() && (byte(i) & 0xC0) == 0x80; };
+
+    const auto lead = byte(pos);
+    if (lead < 0x80)
+        return 1;
+    if (lead >= 0xC2 && lead <= 0xDF)
+        return is_continuation(pos + 1) ? 2 : 0;
+    if (lead >= 0xE0 && lead <= 0xEF) {
+        if (!is_continuation(pos + 1) || !is_continuation(pos + 2))
+            return 0;
+        const auto second = byte(pos + 1);
+        if ((lead == 0xE0 && second < 0xA0) || (lead == 0xED && second > 0x9F))
+            return 0;
+        return 3;
+    }
+    if (lead >= 0xF0 && lead <= 0xF4) {
+        if (!is_continuation(pos + 1) || !is_continuation(pos + 2) || !is_continuation(pos + 3))
+            return 0;
+        const auto second = byte(pos + 1);
+        if ((lead == 0xF0 && second < 0x90) || (lead == 0xF4 && second > 0x8F))
+            return 0;
+        return 4;
+    }
+    return 0;
+}
+
+// Same escaping as nlohmann::json::dump()
+void AppendEscaped(std::string& out, std::string_view str) {
+    constexpr char kHex[] = "0123456789abcdef";
+    size_t pos = 0;
+    while (pos < str.size()) {
+        const auto c = static_cast<unsigned char>(str[pos]);
+        if (c >= 0x80) {
+            const auto length = Utf8SequenceLength(str, pos);
+            if (length == 0)
+                throw std::runtime_error("WriteResponseJson(): invalid UTF-8 byte at index " + std::to_string(pos));
+            out.append(str, pos, length);
+            pos += length;
+            continue;
+        }
+
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                out += "\\u00";
+                out += kHex[c >> 4];
+                out += kHex[c & 0x0F];
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+        ++pos;
+    }
+}
+
+std::string& ResetBuffer(size_t expected_size) {
+    thread_local std::string buffer;
+    // Capacity is kept between messages, unless some huge response grew it
+    if (buffer.capacity() > kMaxRetainedResponseBytes)
+        std::string().swap(buffer);
+    buffer.clear();
+    buffer.reserve(expected_size);
+    return buffer;
+}
+
+void AppendHeaders(std::string& out, const HeaderList& headers) {
+    out += R"("headers":{)";
+    bool first = true;
+    for (size_t i = 0; i < headers.Size(); ++i) {
+        const auto& name = headers[i].name;
+        const auto seen = [&](size_t j) { return EqualsIgnoreCase(headers[j].name, name); };
+        bool repeated = false;
+        for (size_t j = 0; j < i && !repeated; ++j)
+            repeated = seen(j);
+        if (repeated)
+            continue;
+
+        if (!first)
+            out += ',';
+        first = false;
+        out += '"';
+        AppendEscaped(out, name);
+        out += R"(":")";
+        AppendEscaped(out, headers[i].value);
+        for (size_t j = i + 1; j < headers.Size(); ++j) {
+            if (seen(j)) {
+                out += ", ";
+                AppendEscaped(out, headers[j].value);
+            }
+        }
+        out += '"';
+    }
+    out += "},";
+}
+
+void AppendTiming(std::string& out, const Trace& trace) {
+    out += R"(,"timing":{"trace_id":")";
+    out += trace.TraceId();
+    out += '"';
+    for (size_t stage = 0; stage < kTraceStageCount; ++stage) {
+        const auto elapsed = trace.Elapsed(static_cast<TraceStage>(stage));
+        if (!elapsed)
+            continue;
+        out += ",\"";
+        out += kTraceStageNames[stage];
+        out += R"(":)";
+        out += std::to_string(elapsed->count());
+    }
+    out += '}';
+}
+
+const std::string& Write(int status, std::string_view body, const HeaderList* headers, const Trace* timing) {
+    auto& buffer = ResetBuffer(body.size() + 32);
+    buffer += R"({"body":")";
+    AppendEscaped(buffer, body);
+    buffer += R"(",)";
+    if (headers && !headers->Empty())
+        AppendHeaders(buffer, *headers);
+    buffer += R"("status":)";
+    buffer += std::to_string(status);
+    if (timing)
+        AppendTiming(buffer, *timing);
+    buffer += '}';
+    return buffer;
+}
+
+}  // namespace
+
+const std::string& WriteResponseJson(int status, const std::string& body) {
+    return Write(status, body, nullptr, nullptr);
+}
+
+const std::string& WriteResponseJson(const Response& response, const Trace* timing) {
+    return Write(response.status, response.Body(), &response.headers, timing);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Response.h"
+#include "Trace.h"
+
+#include <string>
+
+// Serializes response as {"body":"...","status":N} into the thread's output buffer, which is reused by the next
+// message on the same thread. Returned reference is valid until the next call on this thread.
+// Throws if body isn't valid UTF-8, as Json strings can't carry it
+const std::string& WriteResponseJson(int status, const std::string& body);
+
+// Same, with "headers" object between body and status if response has any. Repeated headers are joined with ", ".
+// With timing, "timing" object follows status: trace id and microseconds from receipt to each stage reached so far
+const std::string& WriteResponseJson(const Response& response, const Trace* timing = nullptr);
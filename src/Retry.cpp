@@ -0,0 +1,109 @@
+#include "Retry.h"
+
+#include <httplib.h>
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+constexpr int64_t kBudgetWindowRequests = 1000;
+
+std::minstd_rand& BackoffRandom() {
+    thread_local std::minstd_rand random(std::random_device{}());
+    return random;
+}
+
+}  // namespace
+
+bool IsRetryableStatus(int status) {
+    const auto error = static_cast<httplib::Error>(status);
+    return error == httplib::Error::Connection || error == httplib::Error::ConnectionTimeout ||
+           error == httplib::Error::Read;
+}
+
+std::chrono::milliseconds BackoffDelay(int attempt, std::chrono::milliseconds base_backoff,
+                                       std::chrono::milliseconds max_backoff) {
+    const auto exponent = std::min(attempt, 30);
+    const auto cap = std::min(max_backoff.count(), base_backoff.count() << exponent);
+    if (cap <= 0)
+        return std::chrono::milliseconds(0);
+    std::uniform_int_distribution<int64_t> distribution(0, cap);
+    return std::chrono::milliseconds(distribution(BackoffRandom()));
+}
+
+
+RetryBudget::RetryBudget(const RetryConfig& config, std::function<Clock::time_point()> now)
+    : deposit_(static_cast<int64_t>(config.budget_ratio * kTokenScale))
+    , max_balance_(std::max(kTokenScale, deposit_ * kBudgetWindowRequests))
+    , min_per_second_(config.budget_min_per_second)
+    , now_(std::move(now)) {
+}
+
+void RetryBudget::Deposit() {
+    auto balance = balance_.load(std::memory_order_relaxed);
+    while (balance < max_balance_ &&
+           !balance_.compare_exchange_weak(balance, std::min(max_balance_, balance + deposit_),
+                                           std::memory_order_relaxed)) {
+    }
+}
+
+bool RetryBudget::TryWithdraw() {
+    const auto second = std::chrono::duration_cast<std::chrono::seconds>(now_().time_since_epoch()).count();
+    auto current = current_second_.load(std::memory_order_relaxed);
+    if (current != second && current_second_.compare_exchange_strong(current, second, std::memory_order_relaxed))
+        used_in_second_.store(0, std::memory_order_relaxed);
+    if (used_in_second_.fetch_add(1, std::memory_order_relaxed) < min_per_second_)
+        return true;
+
+    auto balance = balance_.load(std::memory_order_relaxed);
+    while (balance >= kTokenScale) {
+        if (balance_.compare_exchange_weak(balance, balance - kTokenScale, std::memory_order_relaxed))
+            return true;
+    }
+    return false;
+}
+
+
+HedgeExecutor::HedgeExecutor(size_t threads) {
+    threads_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+        threads_.emplace_back(&HedgeExecutor::Run, this);
+}
+
+HedgeExecutor::~HedgeExecutor() {
+    {
+        auto lock = std::lock_guard(guard_);
+        stop_ = true;
+    }
+    tasks_cv_.notify_all();
+    for (auto& thread : threads_)
+        thread.join();
+}
+
+bool HedgeExecutor::TryPost(std::function<void()> task) {
+    {
+        auto lock = std::lock_guard(guard_);
+        if (busy_ + tasks_.size() >= threads_.size())
+            return false;
+        tasks_.push_back(std::move(task));
+    }
+    tasks_cv_.notify_one();
+    return true;
+}
+
+void HedgeExecutor::Run() {
+    auto lock = std::unique_lock(guard_);
+    while (true) {
+        tasks_cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+        if (stop_)
+            return;
+        auto task = std::move(tasks_.front());
+        tasks_.pop_front();
+        ++busy_;
+        lock.unlock();
+        task();
+        lock.lock();
+        --busy_;
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Config.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Transport errors worth another attempt: connection could not be established or response was cut off
+bool IsRetryableStatus(int status);
+
+// Full-jitter exponential backoff: random delay in [0, min(max_backoff, base_backoff * 2^attempt)]
+std::chrono::milliseconds BackoffDelay(int attempt, std::chrono::milliseconds base_backoff,
+                                       std::chrono::milliseconds max_backoff);
+
+// Global cap on extra upstream calls (retries and hedges), so failures can't multiply the load on a sick upstream.
+// Each request deposits budget_ratio of a token, each retry withdraws a whole one. On top of that,
+// budget_min_per_second retries per second are always allowed, so low traffic still gets retried
+class RetryBudget final {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RetryBudget(const RetryConfig& config, std::function<Clock::time_point()> now = Clock::now);
+    RetryBudget(const RetryBudget&) = delete;
+    RetryBudget(RetryBudget&&) = delete;
+    RetryBudget& operator=(const RetryBudget&) = delete;
+    RetryBudget& operator=(RetryBudget&&) = delete;
+
+    ~RetryBudget() = default;
+
+    void Deposit();
+    bool TryWithdraw();
+
+private:
+    static constexpr int64_t kTokenScale = 1000;
+
+    int64_t deposit_;
+    int64_t max_balance_;
+    int min_per_second_;
+    std::function<Clock::time_point()> now_;
+
+    std::atomic<int64_t> balance_{0};
+    std::atomic<int64_t> current_second_{0};
+    std::atomic<int> used_in_second_{0};
+};
+
+// Fixed set of threads for hedged calls. A task is refused when every thread already has one, so slow upstreams
+// can't make hedges pile up: the request just waits for its first call
+class HedgeExecutor final {
+public:
+    explicit HedgeExecutor(size_t threads);
+    HedgeExecutor(const HedgeExecutor&) = delete;
+    HedgeExecutor(HedgeExecutor&&) = delete;
+    HedgeExecutor& operator=(const HedgeExecutor&) = delete;
+    HedgeExecutor& operator=(HedgeExecutor&&) = delete;
+
+    ~HedgeExecutor();
+
+    // False if all threads are busy
+    bool TryPost(std::function<void()> task);
+
+private:
+    void Run();
+
+    std::mutex guard_;
+    std::condition_variable tasks_cv_;
+    std::deque<std::function<void()>> tasks_;
+    size_t busy_ = 0;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+};
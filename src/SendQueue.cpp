@@ -0,0 +1,85 @@
+#include "SendQueue.h"
+
+SendQueue::SendQueue(const SendQueueConfig& config)
+    : config_(config) {
+}
+
+std::optional<uint64_t> SendQueue::Reserve(size_t request_bytes) {
+    if (paused_ || in_flight_ >= config_.max_in_flight)
+        return {};
+
+    slots_.push_back({request_bytes, {}, Clock::now()});
+    pending_bytes_ += request_bytes;
+    ++in_flight_;
+    UpdatePaused();
+    return first_sequence_ + slots_.size() - 1;
+}
+
+void SendQueue::Complete(uint64_t sequence, std::string frame) {
+    auto& slot = slots_.at(sequence - first_sequence_);
+    // Request is done, from now on its response is what's held
+    pending_bytes_ = pending_bytes_ - slot.bytes + frame.size();
+    slot.bytes = frame.size();
+    slot.frame = std::move(frame);
+    --in_flight_;
+    UpdatePaused();
+}
+
+uint64_t SendQueue::Append(std::string frame) {
+    pending_bytes_ += frame.size();
+    slots_.push_back({frame.size(), std::move(frame), Clock::now()});
+    UpdatePaused();
+    return first_sequence_ + slots_.size() - 1;
+}
+
+std::optional<uint64_t> SendQueue::AppendRejection(std::string frame) {
+    if (rejections_ >= config_.max_queued_rejections)
+        return {};
+    ++rejections_;
+    pending_bytes_ += frame.size();
+    slots_.push_back({frame.size(), std::move(frame), Clock::now(), true});
+    UpdatePaused();
+    return first_sequence_ + slots_.size() - 1;
+}
+
+std::vector<std::string> SendQueue::TakeReady() {
+    std::vector<std::string> ready;
+    while (!slots_.empty() && slots_.front().frame) {
+        pending_bytes_ -= slots_.front().bytes;
+        if (slots_.front().rejection)
+            --rejections_;
+        ready.push_back(std::move(*slots_.front().frame));
+        slots_.pop_front();
+        ++first_sequence_;
+    }
+    UpdatePaused();
+    return ready;
+}
+
+size_t SendQueue::PendingBytes() const {
+    return pending_bytes_;
+}
+
+size_t SendQueue::InFlight() const {
+    return in_flight_;
+}
+
+bool SendQueue::IsPaused() const {
+    return paused_;
+}
+
+std::optional<SendQueue::Clock::time_point> SendQueue::OldestInFlight() const {
+    // Slots are in request order, the first one without a response was reserved first
+    for (const auto& slot : slots_) {
+        if (!slot.frame)
+            return slot.reserved;
+    }
+    return {};
+}
+
+void SendQueue::UpdatePaused() {
+    if (pending_bytes_ >= config_.high_watermark_bytes)
+        paused_ = true;
+    else if (pending_bytes_ <= config_.low_watermark_bytes)
+        paused_ = false;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Config.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Outbound queue of one client. Every accepted request takes a slot, responses are released in request order,
+// so a slow response holds back (and then flushes together with) the ones after it.
+// Bytes of requests in flight and of responses not yet handed to the socket are counted: above high watermark
+// the client is paused and new requests are rejected, until the count drops below low watermark. Frames handed
+// over are the socket's, the queue doesn't see whether the client reads them. Rejections waiting for earlier responses
+// are capped as well, a client that keeps sending while rejected is better closed.
+// Not thread-safe, owner serializes the calls
+class SendQueue final {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit SendQueue(const SendQueueConfig& config);
+    SendQueue(const SendQueue&) = delete;
+    SendQueue(SendQueue&&) = delete;
+    SendQueue& operator=(const SendQueue&) = delete;
+    SendQueue& operator=(SendQueue&&) = delete;
+
+    ~SendQueue() = default;
+
+    // Sequence number of the response slot, or nothing if the request should be rejected
+    std::optional<uint64_t> Reserve(size_t request_bytes);
+    void Complete(uint64_t sequence, std::string frame);
+    // Slot with a frame ready right away, e.g. pushed update. Never refused, caller checks IsPaused()
+    uint64_t Append(std::string frame);
+    // Slot answering request Reserve() turned down, or nothing if max_queued_rejections are waiting already
+    std::optional<uint64_t> AppendRejection(std::string frame);
+    // Completed responses that are next in order, all at once
+    std::vector<std::string> TakeReady();
+
+    size_t PendingBytes() const;
+    size_t InFlight() const;
+    bool IsPaused() const;
+    // When the longest running request was reserved, if any is in flight
+    std::optional<Clock::time_point> OldestInFlight() const;
+
+private:
+    struct Slot {
+        size_t bytes = 0;
+        std::optional<std::string> frame;
+        Clock::time_point reserved;
+        bool rejection = false;
+    };
+
+    void UpdatePaused();
+
+    SendQueueConfig config_;
+
+    std::deque<Slot> slots_;
+    uint64_t first_sequence_ = 0;  // Of slots_.front()
+    size_t pending_bytes_ = 0;
+    size_t in_flight_ = 0;
+    size_t rejections_ = 0;
+    bool paused_ = false;
+};
@@ -0,0 +1,344 @@
+#include "Session.h"
+
+#include "Ascii.h"
+#include "Origin.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+
+constexpr size_t kMaxCookieBytes = 4096;
+// Longer expiry is cut to it, as browsers do
+constexpr std::chrono::seconds kMaxCookieAge = std::chrono::hours(24 * 400);
+
+namespace {
+
+std::string_view TrimSpaces(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+        str.remove_prefix(1);
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+        str.remove_suffix(1);
+    return str;
+}
+
+// Splits "name=value" off the front of "name=value; next=..."
+std::pair<std::string_view, std::string_view> NextAttribute(std::string_view& rest) {
+    const auto semicolon = rest.find(';');
+    const auto attribute = rest.substr(0, semicolon);
+    rest.remove_prefix(semicolon == std::string_view::npos ? rest.size() : semicolon + 1);
+    const auto equals = attribute.find('=');
+    if (equals == std::string_view::npos)
+        return {TrimSpaces(attribute), {}};
+    return {TrimSpaces(attribute.substr(0, equals)), TrimSpaces(attribute.substr(equals + 1))};
+}
+
+std::string RequestPath(const std::string& path) {
+    const auto query = path.find('?');
+    const auto request_path = path.substr(0, query);
+    return request_path.empty() || request_path.front() != '/' ? "/" : request_path;
+}
+
+// Directory of the request path, RFC 6265 5.1.4
+std::string DefaultCookiePath(const std::string& path) {
+    const auto request_path = RequestPath(path);
+    const auto last_slash = request_path.rfind('/');
+    return last_slash == 0 ? "/" : request_path.substr(0, last_slash);
+}
+
+bool DomainMatches(const std::string& host, const std::string& domain) {
+    if (host == domain)
+        return true;
+    return host.size() > domain.size() && host.compare(host.size() - domain.size(), domain.size(), domain) == 0 &&
+           host[host.size() - domain.size() - 1] == '.';
+}
+
+bool PathMatches(const std::string& request_path, const std::string& cookie_path) {
+    if (request_path.compare(0, cookie_path.size(), cookie_path) != 0)
+        return false;
+    return request_path.size() == cookie_path.size() || cookie_path.back() == '/' ||
+           request_path[cookie_path.size()] == '/';
+}
+
+// Value of leading digits if there are min_digits to max_digits of them
+std::optional<int> LeadingNumber(std::string_view token, size_t min_digits, size_t max_digits) {
+    size_t digits = 0;
+    int value = 0;
+    while (digits < token.size() && std::isdigit(static_cast<unsigned char>(token[digits]))) {
+        value = value * 10 + (token[digits] - '0');
+        if (++digits > max_digits)
+            return {};
+    }
+    if (digits < min_digits)
+        return {};
+    return value;
+}
+
+// Seconds since midnight from hh:mm:ss
+std::optional<int> TimeOfDay(std::string_view token) {
+    const auto first = token.find(':');
+    const auto last = token.rfind(':');
+    if (first == std::string_view::npos || first == last)
+        return {};
+    const auto hour = LeadingNumber(token.substr(0, first), 1, 2);
+    const auto minute = LeadingNumber(token.substr(first + 1, last - first - 1), 1, 2);
+    const auto second = LeadingNumber(token.substr(last + 1), 1, 2);
+    if (!hour || !minute || !second || *hour > 23 || *minute > 59 || *second > 59)
+        return {};
+    return *hour * 3600 + *minute * 60 + *second;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+int64_t DaysFromCivil(int64_t year, int64_t month, int64_t day) {
+    year -= month <= 2 ? 1 : 0;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t year_of_era = year - era * 400;
+    const int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+// Expires attribute as seconds since Unix epoch, parsed leniently as RFC 6265 5.1.1 asks
+std::optional<int64_t> ParseCookieDate(std::string_view text) {
+    static constexpr std::array<std::string_view, 12> kMonths = {"jan", "feb", "mar", "apr", "may", "jun",
+                                                                 "jul", "aug", "sep", "oct", "nov", "dec"};
+    std::optional<int> time, day, month, year;
+    const auto is_token_char = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == ':'; };
+    while (!text.empty()) {
+        while (!text.empty() && !is_token_char(text.front()))
+            text.remove_prefix(1);
+        size_t size = 0;
+        while (size < text.size() && is_token_char(text[size]))
+            ++size;
+        const auto token = text.substr(0, size);
+        text.remove_prefix(size);
+        if (token.empty())
+            break;
+
+        if (!time) {
+            time = TimeOfDay(token);
+            if (time)
+                continue;
+        }
+        if (!day) {
+            day = LeadingNumber(token, 1, 2);
+            if (day)
+                continue;
+        }
+        if (!month && token.size() >= 3) {
+            const auto name = LowerAscii(token.substr(0, 3));
+            const auto it = std::find(begin(kMonths), end(kMonths), name);
+            if (it != end(kMonths)) {
+                month = static_cast<int>(it - begin(kMonths)) + 1;
+                continue;
+            }
+        }
+        if (!year)
+            year = LeadingNumber(token, 2, 4);
+    }
+
+    if (!time || !day || !month || !year)
+        return {};
+    const int64_t full_year = *year >= 70 && *year <= 99 ? *year + 1900 : *year <= 69 ? *year + 2000 : *year;
+    if (*day < 1 || *day > 31 || full_year < 1601)
+        return {};
+    return DaysFromCivil(full_year, *month, *day) * 86400 + *time;
+}
+
+}  // namespace
+
+Session::Session(const SessionConfig& config, std::function<Clock::time_point()> now)
+    : config_(config)
+    , now_(std::move(now)) {
+}
+
+std::string Session::CookieHeader(const std::string& url, const std::string& path) {
+    const auto origin = ParseOrigin(url);
+    const auto host = LowerAscii(origin.host);
+    const auto request_path = RequestPath(path);
+    const bool secure_channel = origin.scheme != "http";
+
+    auto lock = std::lock_guard(guard_);
+    RemoveExpired(now_());
+    std::vector<const Cookie*> matching;
+    for (const auto& cookie : cookies_) {
+        const bool domain_matches = cookie.host_only ? host == cookie.domain : DomainMatches(host, cookie.domain);
+        if (domain_matches && PathMatches(request_path, cookie.path) && (!cookie.secure || secure_channel))
+            matching.push_back(&cookie);
+    }
+    // More specific paths first, then older cookies first
+    std::stable_sort(begin(matching), end(matching),
+                     [](const Cookie* lhs, const Cookie* rhs) { return lhs->path.size() > rhs->path.size(); });
+
+    std::string header;
+    for (const auto* cookie : matching) {
+        if (!header.empty())
+            header += "; ";
+        header += cookie->name;
+        header += '=';
+        header += cookie->value;
+    }
+    return header;
+}
+
+void Session::StoreCookies(const std::string& url, const std::string& path, const HeaderList& headers) {
+    const auto origin = ParseOrigin(url);
+    const auto host = LowerAscii(origin.host);
+    const auto now = now_();
+    const auto now_seconds = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+
+    auto lock = std::lock_guard(guard_);
+    for (size_t i = 0; i < headers.Size(); ++i) {
+        if (headers[i].id != HeaderId::SetCookie)
+            continue;
+        std::string_view rest = headers[i].value;
+        // Cookie without "=" is ignored, RFC 6265 5.2
+        if (rest.substr(0, rest.find(';')).find('=') == std::string_view::npos)
+            continue;
+        const auto [name, value] = NextAttribute(rest);
+        if (name.empty() || name.size() + value.size() > kMaxCookieBytes)
+            continue;
+
+        Cookie cookie;
+        cookie.name = std::string(name);
+        cookie.value = std::string(value);
+        cookie.domain = host;
+        cookie.path = DefaultCookiePath(path);
+        std::optional<int64_t> max_age;
+        std::optional<int64_t> expires;
+        bool foreign_domain = false;
+        while (!rest.empty()) {
+            const auto [attribute, attribute_value] = NextAttribute(rest);
+            if (EqualsIgnoreCase(attribute, "Max-Age")) {
+                const bool negative = !attribute_value.empty() && attribute_value.front() == '-';
+                if (const auto seconds = LeadingNumber(attribute_value.substr(negative ? 1 : 0), 1, 9))
+                    max_age = negative ? -*seconds : *seconds;
+            } else if (EqualsIgnoreCase(attribute, "Expires")) {
+                expires = ParseCookieDate(attribute_value);
+            } else if (EqualsIgnoreCase(attribute, "Domain")) {
+                auto domain = LowerAscii(attribute_value);
+                if (!domain.empty() && domain.front() == '.')
+                    domain.erase(0, 1);
+                if (domain.empty())
+                    continue;
+                // Upstream can't set cookies for hosts outside its own domain
+                if (origin.IsIpLiteral() ? domain != host : !DomainMatches(host, domain))
+                    foreign_domain = true;
+                // Nor for a whole top-level domain: one without an inner dot leaves the cookie with the host
+                const bool single_label = domain.find('.') == std::string::npos;
+                cookie.domain = single_label ? host : std::move(domain);
+                cookie.host_only = single_label;
+            } else if (EqualsIgnoreCase(attribute, "Path")) {
+                if (!attribute_value.empty() && attribute_value.front() == '/')
+                    cookie.path = std::string(attribute_value);
+            } else if (EqualsIgnoreCase(attribute, "Secure")) {
+                cookie.secure = true;
+            }
+        }
+        if (foreign_domain)
+            continue;
+
+        // Max-Age wins over Expires. Expiry in the past deletes the cookie
+        const auto expiry = max_age ? std::optional<int64_t>(now_seconds + *max_age) : expires;
+        if (expiry) {
+            cookie.expires = *expiry <= now_seconds
+                                 ? now
+                                 : now + std::min(std::chrono::seconds(*expiry - now_seconds), kMaxCookieAge);
+        }
+
+        const auto same = std::find_if(begin(cookies_), end(cookies_), [&cookie](const Cookie& kept) {
+            return kept.name == cookie.name && kept.domain == cookie.domain && kept.path == cookie.path;
+        });
+        if (same != end(cookies_)) {
+            cookie_bytes_ -= same->name.size() + same->value.size();
+            cookies_.erase(same);
+        }
+        if (cookie.expires && *cookie.expires <= now)
+            continue;
+        cookie_bytes_ += cookie.name.size() + cookie.value.size();
+        cookies_.push_back(std::move(cookie));
+    }
+    RemoveExpired(now);
+    Evict();
+}
+
+std::optional<ConnectionPool::Connection> Session::TakeConnection(const std::string& origin) {
+    auto lock = std::lock_guard(guard_);
+    const auto it = std::find_if(begin(pinned_), end(pinned_),
+                                 [&origin](const PinnedConnection& pinned) { return pinned.first == origin; });
+    if (it == end(pinned_))
+        return {};
+    auto connection = std::move(it->second);
+    pinned_.erase(it);
+    return connection;
+}
+
+std::optional<Session::PinnedConnection> Session::PinConnection(const std::string& origin,
+                                                                ConnectionPool::Connection connection) {
+    auto lock = std::lock_guard(guard_);
+    // Concurrent call pinned one meanwhile, the session keeps that
+    const auto pinned = std::any_of(begin(pinned_), end(pinned_),
+                                    [&origin](const PinnedConnection& pinned) { return pinned.first == origin; });
+    if (closed_ || pinned || config_.max_pinned == 0)
+        return PinnedConnection{origin, std::move(connection)};
+
+    pinned_.emplace_back(origin, std::move(connection));
+    if (pinned_.size() <= config_.max_pinned)
+        return {};
+    auto evicted = std::move(pinned_.front());
+    pinned_.pop_front();
+    return evicted;
+}
+
+std::optional<std::string> Session::Backend(const std::string& upstream) const {
+    auto lock = std::lock_guard(guard_);
+    const auto it = backends_.find(upstream);
+    if (it == end(backends_))
+        return {};
+    return it->second;
+}
+
+void Session::SetBackend(const std::string& upstream, std::string url) {
+    auto lock = std::lock_guard(guard_);
+    backends_[upstream] = std::move(url);
+}
+
+std::vector<Session::PinnedConnection> Session::Close() {
+    auto lock = std::lock_guard(guard_);
+    closed_ = true;
+    std::vector<PinnedConnection> connections;
+    for (auto& pinned : pinned_)
+        connections.push_back(std::move(pinned));
+    pinned_.clear();
+    cookies_.clear();
+    cookie_bytes_ = 0;
+    backends_.clear();
+    return connections;
+}
+
+size_t Session::Cookies() const {
+    auto lock = std::lock_guard(guard_);
+    return cookies_.size();
+}
+
+size_t Session::PinnedConnections() const {
+    auto lock = std::lock_guard(guard_);
+    return pinned_.size();
+}
+
+void Session::RemoveExpired(Clock::time_point now) {
+    for (auto it = begin(cookies_); it != end(cookies_);) {
+        if (it->expires && *it->expires <= now) {
+            cookie_bytes_ -= it->name.size() + it->value.size();
+            it = cookies_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Session::Evict() {
+    while (!cookies_.empty() && (cookies_.size() > config_.max_cookies || cookie_bytes_ > config_.max_cookie_bytes)) {
+        cookie_bytes_ -= cookies_.front().name.size() + cookies_.front().value.size();
+        cookies_.pop_front();
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Config.h"
+#include "ConnectionPool.h"
+#include "HeaderList.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// State a client asked to keep across its requests: cookies set by upstreams, sent back with later requests, and
+// keep-alive connections pinned to origins, along with the backend picked from each upstream group, so
+// server-side session affinity holds. Oldest cookies and connections give way to new ones above SessionConfig limits
+class Session final {
+public:
+    // Cookie expiry is wall time
+    using Clock = std::chrono::system_clock;
+    using PinnedConnection = std::pair<std::string, ConnectionPool::Connection>;  // Origin::Key() and connection
+
+    explicit Session(const SessionConfig& config, std::function<Clock::time_point()> now = Clock::now);
+    Session(const Session&) = delete;
+    Session(Session&&) = delete;
+    Session& operator=(const Session&) = delete;
+    Session& operator=(Session&&) = delete;
+
+    ~Session() = default;
+
+    // Cookie header value for a request, empty if no cookie applies
+    std::string CookieHeader(const std::string& url, const std::string& path);
+    // Keeps cookies from Set-Cookie headers of the response to a request
+    void StoreCookies(const std::string& url, const std::string& path, const HeaderList& headers);
+
+    // Connection pinned to origin by an earlier call, taken out while a call runs
+    std::optional<ConnectionPool::Connection> TakeConnection(const std::string& origin);
+    // Pins connection after a completed call. Returns the connection that doesn't fit, if any, for the pool
+    std::optional<PinnedConnection> PinConnection(const std::string& origin, ConnectionPool::Connection connection);
+
+    // Backend url picked for the session from upstream group
+    std::optional<std::string> Backend(const std::string& upstream) const;
+    void SetBackend(const std::string& upstream, std::string url);
+
+    // Pinned connections, for the pool. Connections of calls still running aren't pinned afterwards
+    std::vector<PinnedConnection> Close();
+
+    size_t Cookies() const;
+    size_t PinnedConnections() const;
+
+private:
+    struct Cookie {
+        std::string name;
+        std::string value;
+        std::string domain;  // Lowercase
+        std::string path;
+        bool host_only = true;
+        bool secure = false;
+        std::optional<Clock::time_point> expires;  // Until session ends if not set
+    };
+
+    void RemoveExpired(Clock::time_point now);
+    void Evict();
+
+    SessionConfig config_;
+    std::function<Clock::time_point()> now_;
+
+    mutable std::mutex guard_;
+    std::list<Cookie> cookies_;  // Oldest first
+    size_t cookie_bytes_ = 0;
+    std::list<PinnedConnection> pinned_;  // Least recently used first
+    std::unordered_map<std::string, std::string> backends_;
+    bool closed_ = false;
+};
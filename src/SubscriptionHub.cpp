@@ -0,0 +1,307 @@
+#include "SubscriptionHub.h"
+
+#include "ResponseWriter.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// Requests that differ only in header order or name case share a poll
+std::string PollKey(const Request& request, std::chrono::milliseconds interval) {
+    std::vector<std::string> headers;
+    const auto& fields = request.HeaderFields();
+    for (size_t i = 0; i < fields.Size(); ++i) {
+        auto header = fields[i].name;
+        for (auto& c : header)
+            c = ToLowerAscii(c);
+        headers.push_back(header + ':' + fields[i].value);
+    }
+    std::sort(begin(headers), end(headers));
+
+    auto key = request.Url() + '\n' + request.Path() + '\n' + std::to_string(interval.count());
+    for (const auto& header : headers)
+        key += '\n' + header;
+    return key;
+}
+
+uint64_t ContentHash(const Response& response) {
+    return std::hash<std::string_view>{}(response.Body()) * 31 + static_cast<uint64_t>(response.status);
+}
+
+// Frames up to the subscription id, which is all that differs between subscribers
+std::string FullFramePrefix(const Response& response) {
+    std::string frame = WriteResponseJson(response);
+    frame.pop_back();
+    return frame + R"(,"subscription":)";
+}
+
+std::string PatchFramePrefix(const Response& previous, const Response& current) {
+    const auto from = nlohmann::json::parse(previous.Body(), nullptr, false);
+    const auto to = nlohmann::json::parse(current.Body(), nullptr, false);
+    if (from.is_discarded() || to.is_discarded())
+        return {};
+    auto frame = nlohmann::json{{"patch", nlohmann::json::diff(from, to)}, {"status", current.status}}.dump();
+    frame.pop_back();
+    return frame + R"(,"subscription":)";
+}
+
+}  // namespace
+
+SubscriptionHub::SubscriptionHub(const SubscriptionConfig& config, Post post)
+    : config_(config)
+    , post_(std::move(post)) {
+    scheduler_ = std::thread(&SubscriptionHub::ScheduleLoop, this);
+}
+
+SubscriptionHub::~SubscriptionHub() {
+    {
+        auto lock = std::lock_guard(guard_);
+        stop_ = true;
+    }
+    wake_cv_.notify_all();
+    if (scheduler_.joinable())
+        scheduler_.join();
+}
+
+void SubscriptionHub::Subscribe(uint64_t client, const std::string& id, const Request& request,
+                                std::chrono::milliseconds interval, bool delta, Fetch fetch, Push push) {
+    if (interval < config_.min_interval)
+        throw std::runtime_error("Subscribe(): interval should be at least " +
+                                 std::to_string(config_.min_interval.count()) + " ms");
+    const auto poll_key = PollKey(request, interval);
+
+    auto lock = std::unique_lock(guard_);
+    SubscriberKey key{client, id};
+    RemoveSubscriber(key);
+    const auto count = per_client_.find(client);
+    if (count != end(per_client_) && count->second >= config_.max_per_client)
+        throw std::runtime_error("Subscribe(): client has too many subscriptions");
+
+    auto poll = polls_.find(poll_key);
+    if (poll == end(polls_)) {
+        if (polls_.size() >= config_.max_polls)
+            throw std::runtime_error("Subscribe(): too many polls");
+        Poll new_poll{request, interval, std::move(fetch), Clock::now(), false, {}, 0, {}, 0, {}, false, false,
+                      next_serial_++};
+        poll = polls_.emplace(poll_key, std::move(new_poll)).first;
+        wake_cv_.notify_one();
+    }
+    poll->second.subscribers.push_back({key, next_serial_++, delta, std::move(push), {}});
+    subscriptions_.emplace(std::move(key), poll_key);
+    ++per_client_[client];
+
+    // Joined a poll that has a response already
+    if (poll->second.last)
+        Deliver(lock, poll_key);
+}
+
+bool SubscriptionHub::Unsubscribe(uint64_t client, const std::string& id) {
+    auto lock = std::lock_guard(guard_);
+    const SubscriberKey key{client, id};
+    if (subscriptions_.count(key) == 0)
+        return false;
+    RemoveSubscriber(key);
+    return true;
+}
+
+void SubscriptionHub::UnsubscribeAll(uint64_t client) {
+    auto lock = std::lock_guard(guard_);
+    std::vector<SubscriberKey> keys;
+    for (auto it = subscriptions_.lower_bound({client, {}}); it != end(subscriptions_) && it->first.first == client;
+         ++it)
+        keys.push_back(it->first);
+    for (const auto& key : keys)
+        RemoveSubscriber(key);
+}
+
+size_t SubscriptionHub::Polls() const {
+    auto lock = std::lock_guard(guard_);
+    return polls_.size();
+}
+
+size_t SubscriptionHub::Subscribers() const {
+    auto lock = std::lock_guard(guard_);
+    return subscriptions_.size();
+}
+
+uint64_t SubscriptionHub::Fetches() const {
+    return fetches_.load(std::memory_order_relaxed);
+}
+
+uint64_t SubscriptionHub::Pushes() const {
+    return pushes_.load(std::memory_order_relaxed);
+}
+
+void SubscriptionHub::ScheduleLoop() {
+    auto lock = std::unique_lock(guard_);
+    while (!stop_) {
+        const auto now = Clock::now();
+        auto next_due = Clock::time_point::max();
+        std::vector<std::string> due;
+        for (auto& [poll_key, poll] : polls_) {
+            // Poll still running is picked up again when it's done, so slow upstream isn't called in parallel
+            if (poll.in_flight)
+                continue;
+            if (poll.next_due <= now) {
+                poll.in_flight = true;
+                poll.next_due = now + poll.interval;
+                due.push_back(poll_key);
+            } else {
+                next_due = std::min(next_due, poll.next_due);
+            }
+        }
+
+        if (!due.empty()) {
+            lock.unlock();
+            for (auto& poll_key : due)
+                post_([this, poll_key = std::move(poll_key)] { RunPoll(poll_key); });
+            lock.lock();
+            continue;
+        }
+        if (next_due == Clock::time_point::max())
+            wake_cv_.wait(lock);
+        else
+            wake_cv_.wait_until(lock, next_due);
+    }
+}
+
+void SubscriptionHub::RunPoll(const std::string& poll_key) {
+    std::optional<Request> request;
+    Fetch fetch;
+    {
+        auto lock = std::lock_guard(guard_);
+        const auto poll = polls_.find(poll_key);
+        if (poll == end(polls_))
+            return;
+        request = poll->second.request;
+        fetch = poll->second.fetch;
+    }
+
+    std::optional<Response> response;
+    try {
+        response = fetch(*request);
+    } catch (const std::exception&) {
+    }
+    fetches_.fetch_add(1, std::memory_order_relaxed);
+
+    auto lock = std::unique_lock(guard_);
+    const auto it = polls_.find(poll_key);
+    if (it == end(polls_))
+        return;  // Everyone left meanwhile
+    auto& poll = it->second;
+    poll.in_flight = false;
+    wake_cv_.notify_one();
+
+    // Failed call isn't news, subscribers keep the last response
+    if (!response || response->status < 100)
+        return;
+    const auto hash = ContentHash(*response);
+    if (!poll.last || hash != poll.last_hash) {
+        poll.previous = std::move(poll.last);
+        poll.previous_hash = poll.last_hash;
+        poll.last = std::make_shared<const Response>(std::move(*response));
+        poll.last_hash = hash;
+    }
+    // Same response goes to those who missed it
+    Deliver(lock, poll_key);
+}
+
+void SubscriptionHub::Deliver(std::unique_lock<std::mutex>& lock, const std::string& poll_key) {
+    // One delivery per poll at a time, so a subscriber can't get an older response after a newer one. Frames are
+    // built and pushed without the lock, so a slow client or a big patch holds up only this poll
+    auto poll = polls_.find(poll_key);
+    if (poll->second.delivering) {
+        poll->second.redeliver = true;
+        return;
+    }
+    poll->second.delivering = true;
+    const auto poll_serial = poll->second.serial;
+    const auto find_poll = [this, &poll_key, poll_serial] {
+        const auto it = polls_.find(poll_key);
+        return it != end(polls_) && it->second.serial == poll_serial ? it : end(polls_);
+    };
+
+    while (true) {
+        poll->second.redeliver = false;
+        const auto last = poll->second.last;
+        const auto last_hash = poll->second.last_hash;
+        const auto previous = poll->second.previous;
+        const auto previous_hash = poll->second.previous_hash;
+        std::vector<Subscriber> pending;
+        for (const auto& subscriber : poll->second.subscribers) {
+            if (subscriber.delivered != last_hash)
+                pending.push_back(subscriber);
+        }
+        lock.unlock();
+
+        std::string full;
+        std::string patch;
+        bool patch_made = false;
+        std::vector<uint64_t> sent;
+        std::vector<SubscriberKey> gone;
+        try {
+            for (const auto& subscriber : pending) {
+                if (full.empty())
+                    full = FullFramePrefix(*last);
+                const bool can_patch = subscriber.delta && previous && subscriber.delivered == previous_hash;
+                if (can_patch && !patch_made) {
+                    patch = PatchFramePrefix(*previous, *last);
+                    patch_made = true;
+                }
+                const auto& prefix = can_patch && !patch.empty() && patch.size() < full.size() ? patch : full;
+                const auto result = subscriber.push(prefix + nlohmann::json(subscriber.key.second).dump() + '}');
+                if (result == PushResult::Sent) {
+                    sent.push_back(subscriber.serial);
+                    pushes_.fetch_add(1, std::memory_order_relaxed);
+                } else if (result == PushResult::Gone) {
+                    gone.push_back(subscriber.key);
+                }
+            }
+        } catch (const std::exception&) {
+            // Body that can't be put in a frame (not UTF-8) isn't pushed
+        }
+
+        lock.lock();
+        poll = find_poll();
+        if (poll != end(polls_)) {
+            // Subscribers are appended with growing serials and removed in place, so both lists are sorted by them
+            for (auto& subscriber : poll->second.subscribers) {
+                if (std::binary_search(begin(sent), end(sent), subscriber.serial))
+                    subscriber.delivered = last_hash;
+            }
+        }
+        // Subscription that outlived its client, e.g. made while it was closing
+        for (const auto& key : gone)
+            RemoveSubscriber(key);
+
+        poll = find_poll();
+        if (poll == end(polls_))
+            return;
+        if (!poll->second.redeliver) {
+            poll->second.delivering = false;
+            return;
+        }
+    }
+}
+
+void SubscriptionHub::RemoveSubscriber(const SubscriberKey& key) {
+    const auto subscription = subscriptions_.find(key);
+    if (subscription == end(subscriptions_))
+        return;
+
+    const auto poll = polls_.find(subscription->second);
+    if (poll != end(polls_)) {
+        auto& subscribers = poll->second.subscribers;
+        subscribers.erase(std::remove_if(begin(subscribers), end(subscribers),
+                                         [&key](const Subscriber& subscriber) { return subscriber.key == key; }),
+                          end(subscribers));
+        if (subscribers.empty())
+            polls_.erase(poll);
+    }
+    subscriptions_.erase(subscription);
+    if (--per_client_[key.first] == 0)
+        per_client_.erase(key.first);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Config.h"
+#include "Requests.h"
+#include "Response.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class PushResult : uint8_t {
+    Sent,
+    Busy,  // Client is behind, it gets full body next time
+    Gone   // Client closed, its subscriptions are dropped
+};
+
+// Polls subscribed GET requests and pushes responses to subscribers when they change.
+// Subscriptions with the same request (after route stages) and interval share one poll, so thousands of clients
+// watching an endpoint cost one upstream call per interval. Frames are
+// {"body":...,"status":N,"subscription":"id"}, or {"patch":[...],"status":N,"subscription":"id"} for delta
+// subscribers that have the previous Json body
+class SubscriptionHub final {
+public:
+    using Fetch = std::function<Response(const Request&)>;
+    using Post = std::function<void(std::function<void()>)>;
+    using Push = std::function<PushResult(const std::string& frame)>;
+
+    // Upstream calls are handed to post, so a slow one doesn't hold up the schedule
+    SubscriptionHub(const SubscriptionConfig& config, Post post);
+    SubscriptionHub(const SubscriptionHub&) = delete;
+    SubscriptionHub(SubscriptionHub&&) = delete;
+    SubscriptionHub& operator=(const SubscriptionHub&) = delete;
+    SubscriptionHub& operator=(SubscriptionHub&&) = delete;
+
+    ~SubscriptionHub();
+
+    // Replaces client's subscription with the same id. New poll uses fetch, a shared one keeps its own.
+    // Last known response is pushed at once. Throws if interval or limits don't allow it.
+    // Clients are told apart by ids that are never reused
+    void Subscribe(uint64_t client, const std::string& id, const Request& request, std::chrono::milliseconds interval,
+                   bool delta, Fetch fetch, Push push);
+    bool Unsubscribe(uint64_t client, const std::string& id);
+    void UnsubscribeAll(uint64_t client);
+
+    size_t Polls() const;
+    size_t Subscribers() const;
+    uint64_t Fetches() const;
+    uint64_t Pushes() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using SubscriberKey = std::pair<uint64_t, std::string>;
+
+    struct Subscriber {
+        SubscriberKey key;
+        uint64_t serial;  // Tells a subscription apart from the one it replaced
+        bool delta;
+        Push push;
+        std::optional<uint64_t> delivered;  // Hash of the response client has
+    };
+
+    struct Poll {
+        Request request;
+        std::chrono::milliseconds interval;
+        Fetch fetch;
+        Clock::time_point next_due;
+        bool in_flight = false;
+        std::shared_ptr<const Response> last;
+        uint64_t last_hash = 0;
+        std::shared_ptr<const Response> previous;  // Delta subscribers that have it get a patch
+        uint64_t previous_hash = 0;
+        std::vector<Subscriber> subscribers;
+        bool delivering = false;  // Frames are being pushed outside the lock
+        bool redeliver = false;   // Response or subscribers changed meanwhile, delivery goes over them again
+        uint64_t serial = 0;      // Tells a poll apart from a later one with the same key
+    };
+
+    void ScheduleLoop();
+    void RunPoll(const std::string& poll_key);
+    // Pushes the last response to subscribers that don't have it, with the lock released meanwhile.
+    // Poll may be gone afterwards, if its last subscribers were
+    void Deliver(std::unique_lock<std::mutex>& lock, const std::string& poll_key);
+    void RemoveSubscriber(const SubscriberKey& key);
+
+    SubscriptionConfig config_;
+    Post post_;
+
+    mutable std::mutex guard_;
+    std::condition_variable wake_cv_;
+    std::unordered_map<std::string, Poll> polls_;
+    std::map<SubscriberKey, std::string> subscriptions_;  // Poll key of every subscriber
+    std::unordered_map<uint64_t, size_t> per_client_;
+    uint64_t next_serial_ = 0;
+    bool stop_ = false;
+    std::atomic<uint64_t> fetches_{0};
+    std::atomic<uint64_t> pushes_{0};
+    std::thread scheduler_;
+};
@@ -0,0 +1,154 @@
+#include "Trace.h"
+
+#include <random>
+
+namespace {
+
+thread_local Trace* g_current_trace = nullptr;
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+std::string RandomHex(size_t digits) {
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+    std::string hex;
+    hex.reserve(digits);
+    while (hex.size() < digits) {
+        auto bits = generator();
+        for (int i = 0; i < 16 && hex.size() < digits; ++i, bits >>= 4)
+            hex.push_back(kHexDigits[bits & 0xF]);
+    }
+    // All-zero ids are invalid
+    if (hex.find_first_not_of('0') == std::string::npos)
+        hex.back() = '1';
+    return hex;
+}
+
+bool IsLowerHex(std::string_view str) {
+    return str.find_first_not_of(kHexDigits) == std::string_view::npos;
+}
+
+bool IsZero(std::string_view str) {
+    return str.find_first_not_of('0') == std::string_view::npos;
+}
+
+int HexValue(char c) {
+    return c <= '9' ? c - '0' : c - 'a' + 10;
+}
+
+}  // namespace
+
+std::optional<TraceParent> ParseTraceparent(std::string_view str) {
+    // Version 00 layout; later versions may append fields after it
+    constexpr size_t kSize = 55;
+    if (str.size() < kSize || (str.size() > kSize && str[kSize] != '-'))
+        return {};
+    if (str[2] != '-' || str[35] != '-' || str[52] != '-')
+        return {};
+
+    const auto version = str.substr(0, 2);
+    const auto trace_id = str.substr(3, 32);
+    const auto span_id = str.substr(36, 16);
+    const auto flags = str.substr(53, 2);
+    if (!IsLowerHex(version) || !IsLowerHex(trace_id) || !IsLowerHex(span_id) || !IsLowerHex(flags))
+        return {};
+    if (version == "ff" || (version == "00" && str.size() != kSize) || IsZero(trace_id) || IsZero(span_id))
+        return {};
+
+    return TraceParent{std::string(trace_id), std::string(span_id),
+                       static_cast<uint8_t>(HexValue(flags[0]) * 16 + HexValue(flags[1]))};
+}
+
+std::string NewSpanId() {
+    return RandomHex(16);
+}
+
+Trace::Trace()
+    : started_(Clock::now())
+    , started_wall_(std::chrono::system_clock::now())
+    , trace_id_(RandomHex(32))
+    , span_id_(NewSpanId()) {
+    for (auto& mark : marks_)
+        mark.store(-1, std::memory_order_relaxed);
+    marks_[static_cast<size_t>(TraceStage::Received)].store(0, std::memory_order_relaxed);
+}
+
+void Trace::Adopt(std::string_view traceparent) {
+    const auto parent = ParseTraceparent(traceparent);
+    if (!parent)
+        return;
+    trace_id_ = parent->trace_id;
+    parent_span_id_ = parent->span_id;
+    flags_ = parent->flags;
+}
+
+void Trace::Describe(std::string method, std::string url) {
+    method_ = std::move(method);
+    url_ = std::move(url);
+}
+
+void Trace::SetStatus(int status) {
+    status_ = status;
+}
+
+void Trace::Mark(TraceStage stage) {
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started_);
+    // Retried or hedged calls mark their stages again, the last attempt is kept
+    marks_[static_cast<size_t>(stage)].store(elapsed.count(), std::memory_order_relaxed);
+}
+
+std::optional<std::chrono::microseconds> Trace::Elapsed(TraceStage stage) const {
+    const auto mark = marks_[static_cast<size_t>(stage)].load(std::memory_order_relaxed);
+    if (mark < 0)
+        return {};
+    return std::chrono::microseconds(mark);
+}
+
+std::string Trace::Traceparent() const {
+    return std::string("00-") + trace_id_ + "-" + span_id_ + "-" + kHexDigits[flags_ >> 4] + kHexDigits[flags_ & 0xF];
+}
+
+const std::string& Trace::TraceId() const {
+    return trace_id_;
+}
+
+const std::string& Trace::SpanId() const {
+    return span_id_;
+}
+
+const std::string& Trace::ParentSpanId() const {
+    return parent_span_id_;
+}
+
+std::chrono::system_clock::time_point Trace::StartTime() const {
+    return started_wall_;
+}
+
+const std::string& Trace::MethodName() const {
+    return method_;
+}
+
+const std::string& Trace::Url() const {
+    return url_;
+}
+
+int Trace::Status() const {
+    return status_;
+}
+
+Trace* Trace::Current() {
+    return g_current_trace;
+}
+
+void Trace::MarkCurrent(TraceStage stage) {
+    if (g_current_trace)
+        g_current_trace->Mark(stage);
+}
+
+TraceScope::TraceScope(Trace* trace)
+    : previous_(g_current_trace) {
+    g_current_trace = trace;
+}
+
+TraceScope::~TraceScope() {
+    g_current_trace = previous_;
+}
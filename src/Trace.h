@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Points a message passes on its way through the proxy, in order
+enum class TraceStage : uint8_t {
+    Received,   // Frame came from the client
+    Queued,     // Worker picked it up, after waiting in dispatch queue
+    Parsed,
+    Connected,  // Host resolved and connection taken from pool or created (httplib connects new ones lazily)
+    FirstByte,  // First chunk of response body, known for GET only
+    Complete,   // Upstream call, with retries and hedges, returned
+    Sent,       // Response frame handed to the socket
+};
+
+constexpr size_t kTraceStageCount = 7;
+constexpr std::array<const char*, kTraceStageCount> kTraceStageNames = {
+    "received", "queued", "parsed", "connected", "first_byte", "complete", "sent"};
+
+// W3C trace context of the caller
+struct TraceParent {
+    std::string trace_id;  // 32 lowercase hex digits
+    std::string span_id;   // 16 lowercase hex digits
+    uint8_t flags = 0;
+};
+
+// "00-<trace id>-<parent id>-<flags>", nothing if it isn't valid
+std::optional<TraceParent> ParseTraceparent(std::string_view str);
+
+// Random 16 hex digit span id
+std::string NewSpanId();
+
+// Timestamps of one message's stages, and the span it makes in a distributed trace.
+// Stages may be marked from several threads (hedged calls), the rest is set before the trace is shared
+class Trace final {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Marks Received, with a new trace id
+    Trace();
+    Trace(const Trace&) = delete;
+    Trace(Trace&&) = delete;
+    Trace& operator=(const Trace&) = delete;
+    Trace& operator=(Trace&&) = delete;
+
+    ~Trace() = default;
+
+    // Joins caller's trace if traceparent is valid, otherwise the generated one is kept
+    void Adopt(std::string_view traceparent);
+    void Describe(std::string method, std::string url);
+    void SetStatus(int status);
+
+    void Mark(TraceStage stage);
+    // Time from Received to stage, if it was reached
+    std::optional<std::chrono::microseconds> Elapsed(TraceStage stage) const;
+
+    // Context to pass upstream, with this proxy's span as the parent
+    std::string Traceparent() const;
+    const std::string& TraceId() const;
+    const std::string& SpanId() const;
+    const std::string& ParentSpanId() const;  // Empty if trace was started here
+    std::chrono::system_clock::time_point StartTime() const;
+    const std::string& MethodName() const;
+    const std::string& Url() const;
+    int Status() const;
+
+    // Trace of the message this thread is working on, or nullptr
+    static Trace* Current();
+    // Marks stage of the current trace, if there is one
+    static void MarkCurrent(TraceStage stage);
+
+private:
+    Clock::time_point started_;
+    std::chrono::system_clock::time_point started_wall_;
+    std::array<std::atomic<int64_t>, kTraceStageCount> marks_;  // Microseconds since started_, -1 if not reached
+
+    std::string trace_id_;
+    std::string span_id_;
+    std::string parent_span_id_;
+    uint8_t flags_ = 1;  // Sampled
+
+    std::string method_;
+    std::string url_;
+    int status_ = 0;
+};
+
+// Makes trace current on this thread for the scope, so code below the worker can mark stages
+class TraceScope final {
+public:
+    explicit TraceScope(Trace* trace);
+    TraceScope(const TraceScope&) = delete;
+    TraceScope(TraceScope&&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+    TraceScope& operator=(TraceScope&&) = delete;
+
+    ~TraceScope();
+
+private:
+    Trace* previous_;
+};
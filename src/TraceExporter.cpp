@@ -0,0 +1,178 @@
+#include "TraceExporter.h"
+
+#include <nlohmann/json.hpp>
+
+#include <stdexcept>
+
+constexpr size_t kExportBatchSize = 512;
+
+namespace {
+
+// Span kinds of OTLP
+constexpr int kSpanKindInternal = 1;
+constexpr int kSpanKindServer = 2;
+
+size_t PathStart(const std::string& url) {
+    const auto scheme_end = url.find("://");
+    return url.find('/', scheme_end == std::string::npos ? 0 : scheme_end + 3);
+}
+
+std::string UnixNanos(std::chrono::system_clock::time_point start, std::chrono::microseconds offset) {
+    const auto at = start + offset;
+    return std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(at.time_since_epoch()).count());
+}
+
+nlohmann::json Attribute(const char* key, const std::string& value) {
+    return {{"key", key}, {"value", {{"stringValue", value}}}};
+}
+
+nlohmann::json Attribute(const char* key, int64_t value) {
+    // OTLP/JSON encodes 64-bit integers as strings
+    return {{"key", key}, {"value", {{"intValue", std::to_string(value)}}}};
+}
+
+void AppendSpans(const Trace& trace, nlohmann::json& spans) {
+    std::chrono::microseconds end{0};
+    for (size_t stage = 0; stage < kTraceStageCount; ++stage) {
+        if (const auto elapsed = trace.Elapsed(static_cast<TraceStage>(stage)))
+            end = std::max(end, *elapsed);
+    }
+
+    nlohmann::json request_span = {
+        {"traceId", trace.TraceId()},
+        {"spanId", trace.SpanId()},
+        {"name", "proxy " + trace.MethodName()},
+        {"kind", kSpanKindServer},
+        {"startTimeUnixNano", UnixNanos(trace.StartTime(), std::chrono::microseconds(0))},
+        {"endTimeUnixNano", UnixNanos(trace.StartTime(), end)},
+        {"attributes",
+         {Attribute("http.request.method", trace.MethodName()), Attribute("url.full", trace.Url()),
+          Attribute("http.response.status_code", trace.Status())}},
+    };
+    if (!trace.ParentSpanId().empty())
+        request_span["parentSpanId"] = trace.ParentSpanId();
+    spans.push_back(std::move(request_span));
+
+    std::chrono::microseconds previous{0};
+    for (size_t stage = 1; stage < kTraceStageCount; ++stage) {
+        const auto elapsed = trace.Elapsed(static_cast<TraceStage>(stage));
+        if (!elapsed)
+            continue;
+        spans.push_back({
+            {"traceId", trace.TraceId()},
+            {"spanId", NewSpanId()},
+            {"parentSpanId", trace.SpanId()},
+            {"name", kTraceStageNames[stage]},
+            {"kind", kSpanKindInternal},
+            {"startTimeUnixNano", UnixNanos(trace.StartTime(), std::min(previous, *elapsed))},
+            {"endTimeUnixNano", UnixNanos(trace.StartTime(), *elapsed)},
+        });
+        previous = *elapsed;
+    }
+}
+
+}  // namespace
+
+FileSpanSink::FileSpanSink(const std::string& path)
+    : file_(path, std::ios::app) {
+    if (!file_)
+        throw std::runtime_error("FileSpanSink(): can't open " + path);
+}
+
+void FileSpanSink::Write(const std::string& batch) {
+    file_ << batch << '\n';
+    file_.flush();
+}
+
+OtlpSpanSink::OtlpSpanSink(const std::string& endpoint)
+    : client_(endpoint.substr(0, PathStart(endpoint)))
+    , path_(PathStart(endpoint) == std::string::npos ? "/v1/traces" : endpoint.substr(PathStart(endpoint))) {
+}
+
+void OtlpSpanSink::Write(const std::string& batch) {
+    // Collector being down shouldn't affect traffic, the batch is lost
+    client_.Post(path_, {}, batch, "application/json");
+}
+
+std::unique_ptr<SpanSink> MakeSpanSink(const TracingConfig& config) {
+    switch (config.exporter) {
+    case TraceExporterType::None:
+        return nullptr;
+    case TraceExporterType::File:
+        return std::make_unique<FileSpanSink>(config.file);
+    case TraceExporterType::Otlp:
+        return std::make_unique<OtlpSpanSink>(config.otlp_endpoint);
+    }
+    return nullptr;
+}
+
+std::string SerializeSpans(const std::vector<std::shared_ptr<const Trace>>& traces, const std::string& service_name) {
+    auto spans = nlohmann::json::array();
+    for (const auto& trace : traces)
+        AppendSpans(*trace, spans);
+
+    const nlohmann::json request = {
+        {"resourceSpans",
+         {{
+             {"resource", {{"attributes", {Attribute("service.name", service_name)}}}},
+             {"scopeSpans", {{{"scope", {{"name", "websockproxy"}}}, {"spans", std::move(spans)}}}},
+         }}},
+    };
+    return request.dump();
+}
+
+TraceExporter::TraceExporter(std::unique_ptr<SpanSink> sink, const TracingConfig& config)
+    : sink_(std::move(sink))
+    , service_name_(config.service_name)
+    , max_queued_(config.max_queued)
+    , flush_interval_(config.flush_interval) {
+    exporter_ = std::thread(&TraceExporter::ExportLoop, this);
+}
+
+TraceExporter::~TraceExporter() {
+    {
+        auto lock = std::lock_guard(guard_);
+        stop_ = true;
+    }
+    queued_cv_.notify_all();
+    if (exporter_.joinable())
+        exporter_.join();
+}
+
+void TraceExporter::Export(std::shared_ptr<const Trace> trace) {
+    auto lock = std::lock_guard(guard_);
+    if (queued_.size() >= max_queued_) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    queued_.push_back(std::move(trace));
+    if (queued_.size() >= kExportBatchSize)
+        queued_cv_.notify_one();
+}
+
+uint64_t TraceExporter::Dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+void TraceExporter::ExportLoop() {
+    while (true) {
+        std::vector<std::shared_ptr<const Trace>> batch;
+        bool stop = false;
+        {
+            auto lock = std::unique_lock(guard_);
+            queued_cv_.wait_for(lock, flush_interval_, [this] { return stop_ || queued_.size() >= kExportBatchSize; });
+            batch.swap(queued_);
+            stop = stop_;
+        }
+
+        if (!batch.empty() && sink_) {
+            try {
+                sink_->Write(SerializeSpans(batch, service_name_));
+            } catch (const std::exception&) {
+                dropped_.fetch_add(batch.size(), std::memory_order_relaxed);
+            }
+        }
+        if (stop)
+            return;
+    }
+}
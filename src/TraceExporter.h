@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Config.h"
+#include "Trace.h"
+
+#include <httplib.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Destination of span batches, each an OTLP/JSON ExportTraceServiceRequest
+class SpanSink {
+public:
+    virtual ~SpanSink() = default;
+    virtual void Write(const std::string& batch) = 0;
+};
+
+// Appends batches to a file, one per line, like the OpenTelemetry collector's file exporter does
+class FileSpanSink final : public SpanSink {
+public:
+    explicit FileSpanSink(const std::string& path);
+
+    void Write(const std::string& batch) override;
+
+private:
+    std::ofstream file_;
+};
+
+// Posts batches to OTLP/HTTP collector, e.g. http://127.0.0.1:4318/v1/traces
+class OtlpSpanSink final : public SpanSink {
+public:
+    explicit OtlpSpanSink(const std::string& endpoint);
+
+    void Write(const std::string& batch) override;
+
+private:
+    httplib::Client client_;
+    std::string path_;
+};
+
+// Sink for the configured exporter, or nullptr if traces aren't exported
+std::unique_ptr<SpanSink> MakeSpanSink(const TracingConfig& config);
+
+// Spans of one trace: the proxy's span for the whole message, with a child span for every stage
+// that ends at it, starting at the stage reached before
+std::string SerializeSpans(const std::vector<std::shared_ptr<const Trace>>& traces, const std::string& service_name);
+
+// Hands finished traces to the sink in batches, from a background thread. Export() doesn't block,
+// traces above max_queued are dropped
+class TraceExporter final {
+public:
+    TraceExporter(std::unique_ptr<SpanSink> sink, const TracingConfig& config);
+    TraceExporter(const TraceExporter&) = delete;
+    TraceExporter(TraceExporter&&) = delete;
+    TraceExporter& operator=(const TraceExporter&) = delete;
+    TraceExporter& operator=(TraceExporter&&) = delete;
+
+    // Writes what's queued
+    ~TraceExporter();
+
+    void Export(std::shared_ptr<const Trace> trace);
+    uint64_t Dropped() const;
+
+private:
+    void ExportLoop();
+
+    std::unique_ptr<SpanSink> sink_;
+    std::string service_name_;
+    size_t max_queued_;
+    std::chrono::milliseconds flush_interval_;
+
+    std::mutex guard_;
+    std::condition_variable queued_cv_;
+    std::vector<std::shared_ptr<const Trace>> queued_;
+    bool stop_ = false;
+    std::atomic<uint64_t> dropped_{0};
+    std::thread exporter_;
+};
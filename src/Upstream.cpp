@@ -0,0 +1,260 @@
+#include "Upstream.h"
+
+#include <httplib.h>
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+constexpr char kUpstreamScheme[] = "upstream://";
+
+std::minstd_rand& Random() {
+    thread_local std::minstd_rand random(std::random_device{}());
+    return random;
+}
+
+}  // namespace
+
+std::optional<std::string> UpstreamName(const std::string& url) {
+    const std::string scheme = kUpstreamScheme;
+    if (url.compare(0, scheme.size(), scheme) != 0)
+        return {};
+    return url.substr(scheme.size());
+}
+
+
+Backend::Backend(std::string url)
+    : url_(std::move(url)) {
+}
+
+const std::string& Backend::Url() const {
+    return url_;
+}
+
+int Backend::Outstanding() const {
+    return outstanding_.load(std::memory_order_relaxed);
+}
+
+bool Backend::IsHealthy() const {
+    return healthy_.load(std::memory_order_relaxed);
+}
+
+bool Backend::IsEjected(Clock::time_point now) const {
+    return now.time_since_epoch().count() < ejected_until_.load(std::memory_order_relaxed);
+}
+
+
+UpstreamLease::UpstreamLease(UpstreamGroup& group, Backend& backend)
+    : group_(&group)
+    , backend_(&backend) {
+    backend_->outstanding_.fetch_add(1, std::memory_order_relaxed);
+}
+
+UpstreamLease::UpstreamLease(UpstreamLease&& other) noexcept
+    : group_(other.group_)
+    , backend_(other.backend_) {
+    other.backend_ = nullptr;
+}
+
+UpstreamLease::~UpstreamLease() {
+    if (backend_)
+        backend_->outstanding_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+const std::string& UpstreamLease::Url() const {
+    return backend_->Url();
+}
+
+void UpstreamLease::Complete(const Response& response) {
+    group_->ReportOutcome(*backend_, IsUpstreamFailure(response.status));
+}
+
+
+UpstreamGroup::UpstreamGroup(UpstreamConfig config, std::function<Clock::time_point()> now)
+    : config_(std::move(config))
+    , now_(std::move(now)) {
+    for (const auto& url : config_.backends)
+        backends_.push_back(std::make_unique<Backend>(url));
+}
+
+const UpstreamConfig& UpstreamGroup::Config() const {
+    return config_;
+}
+
+const std::vector<std::unique_ptr<Backend>>& UpstreamGroup::Backends() const {
+    return backends_;
+}
+
+std::optional<UpstreamLease> UpstreamGroup::Pick() {
+    const auto now = now_();
+    auto* backend = config_.policy == BalancePolicy::PowerOfTwoChoices ? PickOfTwoChoices(now)
+                                                                        : PickLeastOutstanding(now);
+    if (!backend)
+        return {};
+    return UpstreamLease(*this, *backend);
+}
+
+std::optional<UpstreamLease> UpstreamGroup::PickPreferred(const std::string& url) {
+    const auto now = now_();
+    for (auto& backend : backends_) {
+        if (backend->Url() == url && IsAvailable(*backend, now))
+            return UpstreamLease(*this, *backend);
+    }
+    return Pick();
+}
+
+bool UpstreamGroup::IsAvailable(const Backend& backend, Clock::time_point now) const {
+    return backend.IsHealthy() && !backend.IsEjected(now);
+}
+
+Backend* UpstreamGroup::PickLeastOutstanding(Clock::time_point now) {
+    // Start from random position, so equally loaded backends share the traffic
+    const auto start = Random()() % backends_.size();
+    Backend* best = nullptr;
+    for (size_t i = 0; i < backends_.size(); ++i) {
+        auto& backend = *backends_[(start + i) % backends_.size()];
+        if (IsAvailable(backend, now) && (!best || backend.Outstanding() < best->Outstanding()))
+            best = &backend;
+    }
+    return best;
+}
+
+Backend* UpstreamGroup::PickOfTwoChoices(Clock::time_point now) {
+    if (backends_.size() < 2)
+        return PickLeastOutstanding(now);
+
+    const auto first = Random()() % backends_.size();
+    auto second = Random()() % (backends_.size() - 1);
+    if (second >= first)
+        ++second;
+
+    auto* a = backends_[first].get();
+    auto* b = backends_[second].get();
+    const bool a_available = IsAvailable(*a, now);
+    const bool b_available = IsAvailable(*b, now);
+    if (a_available && b_available)
+        return a->Outstanding() <= b->Outstanding() ? a : b;
+    if (a_available)
+        return a;
+    if (b_available)
+        return b;
+
+    // Both choices are out of rotation, look for any available one
+    return PickLeastOutstanding(now);
+}
+
+void UpstreamGroup::ReportOutcome(Backend& backend, bool failure) {
+    if (!failure) {
+        backend.consecutive_failures_.store(0, std::memory_order_relaxed);
+        backend.ejection_count_.store(0, std::memory_order_relaxed);
+        return;
+    }
+
+    const auto failures = backend.consecutive_failures_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (failures >= config_.outlier_detection.consecutive_failures)
+        Eject(backend);
+}
+
+void UpstreamGroup::Eject(Backend& backend) {
+    const auto now = now_();
+    if (backend.IsEjected(now))
+        return;
+
+    size_t ejected = 0;
+    for (const auto& b : backends_)
+        ejected += b->IsEjected(now) ? 1 : 0;
+    // Like in Envoy, at least one backend can be ejected regardless of the percentage
+    const auto max_ejected =
+        std::max<size_t>(1, backends_.size() * config_.outlier_detection.max_ejection_percent / 100);
+    if (ejected + 1 > max_ejected)
+        return;
+
+    // Ejection time grows with each consecutive ejection
+    const auto count = backend.ejection_count_.fetch_add(1, std::memory_order_relaxed) + 1;
+    const auto duration = std::min(config_.outlier_detection.base_ejection * count,
+                                   config_.outlier_detection.max_ejection);
+    const auto until = now + std::chrono::duration_cast<Clock::duration>(duration);
+    backend.ejected_until_.store(until.time_since_epoch().count(), std::memory_order_relaxed);
+    backend.consecutive_failures_.store(0, std::memory_order_relaxed);
+}
+
+void UpstreamGroup::CheckHealth() {
+    if (!config_.health_check)
+        return;
+
+    const auto& check = *config_.health_check;
+    for (auto& backend : backends_) {
+        httplib::Client client(backend->Url());
+        client.set_connection_timeout(check.timeout);
+        client.set_read_timeout(check.timeout);
+        const auto result = client.Get(check.path);
+        const bool success = result.error() == httplib::Error::Success && result->status >= 200 && result->status < 300;
+
+        if (success) {
+            backend->check_failures_ = 0;
+            if (++backend->check_successes_ >= check.healthy_threshold)
+                backend->healthy_.store(true, std::memory_order_relaxed);
+        } else {
+            backend->check_successes_ = 0;
+            if (++backend->check_failures_ >= check.unhealthy_threshold)
+                backend->healthy_.store(false, std::memory_order_relaxed);
+        }
+    }
+}
+
+
+UpstreamRegistry::UpstreamRegistry(const std::vector<UpstreamConfig>& upstreams) {
+    bool has_health_checks = false;
+    for (const auto& upstream : upstreams) {
+        has_health_checks |= upstream.health_check.has_value();
+        groups_.emplace(upstream.name, std::make_unique<UpstreamGroup>(upstream));
+    }
+    if (has_health_checks)
+        health_checker_ = std::thread(&UpstreamRegistry::HealthCheckLoop, this);
+}
+
+UpstreamRegistry::~UpstreamRegistry() {
+    {
+        auto lock = std::lock_guard(guard_);
+        stop_ = true;
+    }
+    stop_cv_.notify_all();
+    if (health_checker_.joinable())
+        health_checker_.join();
+}
+
+UpstreamGroup* UpstreamRegistry::Find(const std::string& name) {
+    const auto it = groups_.find(name);
+    return it == groups_.end() ? nullptr : it->second.get();
+}
+
+void UpstreamRegistry::HealthCheckLoop() {
+    using Clock = UpstreamGroup::Clock;
+
+    std::unordered_map<UpstreamGroup*, Clock::time_point> next_check;
+    for (auto& [name, group] : groups_) {
+        if (group->Config().health_check)
+            next_check[group.get()] = Clock::now();
+    }
+
+    while (true) {
+        auto wake_at = Clock::time_point::max();
+        for (const auto& [group, at] : next_check)
+            wake_at = std::min(wake_at, at);
+
+        {
+            auto lock = std::unique_lock(guard_);
+            if (stop_cv_.wait_until(lock, wake_at, [this] { return stop_; }))
+                return;
+        }
+
+        const auto now = Clock::now();
+        for (auto& [group, at] : next_check) {
+            if (now < at)
+                continue;
+            group->CheckHealth();
+            at = Clock::now() + group->Config().health_check->interval;
+        }
+    }
+}
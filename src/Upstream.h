@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Config.h"
+#include "Response.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Requests with "url": "upstream://<name>" are balanced across backends of named upstream group
+std::optional<std::string> UpstreamName(const std::string& url);
+
+class Backend final {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Backend(std::string url);
+    Backend(const Backend&) = delete;
+    Backend(Backend&&) = delete;
+    Backend& operator=(const Backend&) = delete;
+    Backend& operator=(Backend&&) = delete;
+
+    ~Backend() = default;
+
+    const std::string& Url() const;
+    int Outstanding() const;
+    bool IsHealthy() const;
+    bool IsEjected(Clock::time_point now) const;
+
+private:
+    friend class UpstreamGroup;
+    friend class UpstreamLease;
+
+    std::string url_;
+    std::atomic<int> outstanding_{0};
+    std::atomic<int> consecutive_failures_{0};
+    std::atomic<int> ejection_count_{0};
+    std::atomic<Clock::rep> ejected_until_{0};
+    std::atomic<bool> healthy_{true};
+
+    // Active health check state, touched by health checker thread only
+    int check_successes_ = 0;
+    int check_failures_ = 0;
+};
+
+class UpstreamGroup;
+
+// Outstanding request on a picked backend, released on destruction
+class UpstreamLease final {
+public:
+    UpstreamLease(UpstreamGroup& group, Backend& backend);
+    UpstreamLease(const UpstreamLease&) = delete;
+    UpstreamLease(UpstreamLease&& other) noexcept;
+    UpstreamLease& operator=(const UpstreamLease&) = delete;
+    UpstreamLease& operator=(UpstreamLease&&) = delete;
+
+    ~UpstreamLease();
+
+    const std::string& Url() const;
+
+    // Feeds passive outlier detection with the result of the call
+    void Complete(const Response& response);
+
+private:
+    UpstreamGroup* group_;
+    Backend* backend_;
+};
+
+class UpstreamGroup final {
+public:
+    using Clock = Backend::Clock;
+
+    explicit UpstreamGroup(UpstreamConfig config, std::function<Clock::time_point()> now = Clock::now);
+    UpstreamGroup(const UpstreamGroup&) = delete;
+    UpstreamGroup(UpstreamGroup&&) = delete;
+    UpstreamGroup& operator=(const UpstreamGroup&) = delete;
+    UpstreamGroup& operator=(UpstreamGroup&&) = delete;
+
+    ~UpstreamGroup() = default;
+
+    const UpstreamConfig& Config() const;
+    const std::vector<std::unique_ptr<Backend>>& Backends() const;
+
+    // Picks backend by configured policy among healthy and not ejected ones
+    std::optional<UpstreamLease> Pick();
+    // Backend with this url while it's available, so a session keeps talking to the same one, otherwise as Pick()
+    std::optional<UpstreamLease> PickPreferred(const std::string& url);
+
+    // Passive outlier detection: ejects backend after consecutive failures
+    void ReportOutcome(Backend& backend, bool failure);
+
+    // One blocking round of active health checks
+    void CheckHealth();
+
+private:
+    bool IsAvailable(const Backend& backend, Clock::time_point now) const;
+    Backend* PickLeastOutstanding(Clock::time_point now);
+    Backend* PickOfTwoChoices(Clock::time_point now);
+    void Eject(Backend& backend);
+
+    UpstreamConfig config_;
+    std::vector<std::unique_ptr<Backend>> backends_;
+    std::function<Clock::time_point()> now_;
+};
+
+// All configured upstream groups, with active health checker thread
+class UpstreamRegistry final {
+public:
+    explicit UpstreamRegistry(const std::vector<UpstreamConfig>& upstreams);
+    UpstreamRegistry(const UpstreamRegistry&) = delete;
+    UpstreamRegistry(UpstreamRegistry&&) = delete;
+    UpstreamRegistry& operator=(const UpstreamRegistry&) = delete;
+    UpstreamRegistry& operator=(UpstreamRegistry&&) = delete;
+
+    ~UpstreamRegistry();
+
+    UpstreamGroup* Find(const std::string& name);
+
+private:
+    void HealthCheckLoop();
+
+    std::unordered_map<std::string, std::unique_ptr<UpstreamGroup>> groups_;
+    std::mutex guard_;
+    std::condition_variable stop_cv_;
+    bool stop_ = false;
+    std::thread health_checker_;
+};
@@ -1,26 +1,77 @@
 #include "WsServer.h"
 
-#include "HttpClient.h"
 #include "Payload.h"
 #include "Requests.h"
-
-#include <nlohmann/json.hpp>
+#include "ResponseWriter.h"
 
 constexpr size_t kMaxCapacity = 16;
 constexpr size_t kMaxPayloadSizeBytes = 65535;
+constexpr size_t kDispatchThreads = 32;
 
 namespace {
 
-std::string MakeResponseJson(int status, const std::string& body) {
-    nlohmann::json json;
-    json["status"] = status;
-    json["body"] = body;
-    return json.dump();
+// Userdata holds a heap-allocated shared_ptr, so workers can keep the client alive after Crow closes it
+std::shared_ptr<ClientConnection> ClientOf(crow::websocket::connection& conn) {
+    const auto* client = static_cast<std::shared_ptr<ClientConnection>*>(conn.userdata());
+    return client ? *client : nullptr;
+}
+
+// Joins caller's trace and passes it on, with this proxy's span as the parent
+void StartSpan(Trace& trace, Request& request) {
+    trace.Mark(TraceStage::Parsed);
+    if (const auto* traceparent = request.HeaderFields().Find(HeaderId::Traceparent))
+        trace.Adopt(traceparent->value);
+    trace.Describe(std::string(MethodName(request.GetMethod())), request.Url());
+    request.MutableHeaderFields().Set("traceparent", trace.Traceparent());
 }
 
 }  // namespace
 
-WsServer::WsServer(const std::string& address, uint16_t port) {
+WsServer::WsServer(const std::string& address, uint16_t port, const Config& config)
+    : send_queue_config_(config.send_queue)
+    , send_queue_metrics_{
+          metrics_.AddGauge("websockproxy_send_queue_bytes", "Bytes of requests and responses queued for clients"),
+          metrics_.AddGauge("websockproxy_send_queue_paused_clients", "Clients above high watermark"),
+          metrics_.AddCounter("websockproxy_send_queue_rejected_total", "Requests rejected because client fell behind")}
+    , decoder_config_(config.decoder)
+    , decode_errors_(metrics_.AddCounter("websockproxy_decode_errors_total", "Messages refused as malformed"))
+    , session_config_(config.sessions)
+    , sessions_(metrics_.AddGauge("websockproxy_sessions", "Clients with a session"))
+    , dispatcher_(config, metrics_)
+    , access_(config.access.allow, config.access.deny)
+    , routes_(config.routes)
+    , tracing_(config.tracing.enabled)
+    , timing_(config.tracing.enabled && config.tracing.timing)
+    , admin_config_(config.admin)
+    , dispatch_pool_(kDispatchThreads)
+    , subscriptions_(config.subscriptions,
+                     [this](std::function<void()> poll) { asio::post(dispatch_pool_, std::move(poll)); }) {
+    if (tracing_) {
+        if (auto sink = MakeSpanSink(config.tracing)) {
+            tracer_ = std::make_unique<TraceExporter>(std::move(sink), config.tracing);
+            metrics_.AddCollector([this](std::ostream& out) {
+                WriteMetricHeader(out, "websockproxy_traces_dropped_total", "Traces not exported", "counter");
+                out << "websockproxy_traces_dropped_total " << tracer_->Dropped() << "\n";
+            });
+        }
+    }
+
+    metrics_.AddCollector([this](std::ostream& out) {
+        WriteMetricHeader(out, "websockproxy_subscription_polls", "Distinct requests polled for subscribers", "gauge");
+        out << "websockproxy_subscription_polls " << subscriptions_.Polls() << "\n";
+        WriteMetricHeader(out, "websockproxy_subscribers", "Subscriptions of all clients", "gauge");
+        out << "websockproxy_subscribers " << subscriptions_.Subscribers() << "\n";
+        WriteMetricHeader(out, "websockproxy_subscription_fetches_total", "Upstream calls made by polls", "counter");
+        out << "websockproxy_subscription_fetches_total " << subscriptions_.Fetches() << "\n";
+        WriteMetricHeader(out, "websockproxy_subscription_pushes_total", "Changed responses pushed to subscribers",
+                          "counter");
+        out << "websockproxy_subscription_pushes_total " << subscriptions_.Pushes() << "\n";
+    });
+    metrics_.AddGauge("websockproxy_send_queue_high_watermark_bytes", "Per-client high watermark")
+        .Set(static_cast<int64_t>(send_queue_config_.high_watermark_bytes));
+    metrics_.AddGauge("websockproxy_send_queue_low_watermark_bytes", "Per-client low watermark")
+        .Set(static_cast<int64_t>(send_queue_config_.low_watermark_bytes));
+
     using namespace std::placeholders;
     CROW_WEBSOCKET_ROUTE(app_, "/")
         .max_payload(kMaxPayloadSizeBytes)
@@ -30,8 +81,31 @@ WsServer::WsServer(const std::string& address, uint16_t port) {
         .onmessage(std::bind(&WsServer::MessageHandler, this, _1, _2, _3))
         .onerror(std::bind(&WsServer::ErrorHandler, this, _1, _2));
 
+    CROW_ROUTE(app_, "/metrics")([this] {
+        auto response = crow::response(metrics_.Render());
+        response.set_header("Content-Type", "text/plain; version=0.0.4");
+        return response;
+    });
+
+    // Ready once it listens and every known upstream could be connected to, so traffic isn't sent to a cold proxy or
+    // one that can't reach its upstreams
+    CROW_ROUTE(app_, "/ready")([this] {
+        if (!started_.load(std::memory_order_acquire) || !dispatcher_.IsWarm())
+            return crow::response(503, "warming up");
+        return crow::response(200, "ready");
+    });
+
+    if (admin_config_.enabled) {
+        CROW_ROUTE(app_, "/admin/state")([this] {
+            auto response = crow::response(AdminState());
+            response.set_header("Content-Type", "application/json");
+            return response;
+        });
+    }
+
     run_future_ = app_.bindaddr(address).port(port).multithreaded().run_async();
     app_.wait_for_server_start();
+    started_.store(true, std::memory_order_release);
 }
 
 WsServer::~WsServer() {
@@ -40,12 +114,13 @@ WsServer::~WsServer() {
             app_.stop();
             run_future_.wait();
         }
+        dispatch_pool_.join();
     } catch (std::exception& e) {
         CROW_LOG_INFO << "~WsServer(): exception: " << e.what();
     }
 }
 
-bool WsServer::AcceptHandler(const crow::request& /*req*/, void** /*userdata*/) {
+bool WsServer::AcceptHandler(const crow::request& req, void** userdata) {
     auto lock = std::lock_guard(capacity_guard_);
     if (capacity_ >= kMaxCapacity) {
         CROW_LOG_INFO << "AcceptHandler(): Can't accept connection, capacity exceeded";
@@ -54,14 +129,40 @@ bool WsServer::AcceptHandler(const crow::request& /*req*/, void** /*userdata*/)
 
     ++capacity_;
     CROW_LOG_INFO << "AcceptHandler(): Accept connection, capacity: " << capacity_;
+    // Only for accepted connections, Crow hands userdata to the open handler right away
+    const char* session = req.url_params.get("session");
+    if (session_config_.enabled && session && std::string(session) == "1")
+        *userdata = new Session(session_config_);
     return true;
 }
 
-void WsServer::OpenHandler(crow::websocket::connection& /*conn*/) {
+void WsServer::OpenHandler(crow::websocket::connection& conn) {
     CROW_LOG_DEBUG << "OpenHandler() called";
+    auto session = std::unique_ptr<Session>(static_cast<Session*>(conn.userdata()));
+    if (session)
+        sessions_.Add(1);
+    auto client = std::make_shared<ClientConnection>(++next_id_, conn, send_queue_config_, send_queue_metrics_,
+                                                     std::move(session));
+    clients_.Add(client->Id(), client);
+    conn.userdata(new std::shared_ptr<ClientConnection>(std::move(client)));
 }
 
-void WsServer::CloseHandler(crow::websocket::connection& /*conn*/) {
+void WsServer::CloseHandler(crow::websocket::connection& conn) {
+    if (auto* client = static_cast<std::shared_ptr<ClientConnection>*>(conn.userdata())) {
+        // Closed first, so a subscribe still queued for a worker can't register after the client's subscriptions
+        // are dropped
+        (*client)->Close();
+        subscriptions_.UnsubscribeAll((*client)->Id());
+        clients_.Remove((*client)->Id());
+        // Workers still holding the client finish their calls, their connections go to the pool too
+        if (auto* session = (*client)->GetSession()) {
+            dispatcher_.EndSession(*session);
+            sessions_.Add(-1);
+        }
+        delete client;
+        conn.userdata(nullptr);
+    }
+
     auto lock = std::lock_guard(capacity_guard_);
     --capacity_;
     CROW_LOG_INFO << "CloseHandler(): current capacity: " << capacity_;
@@ -69,20 +170,142 @@ void WsServer::CloseHandler(crow::websocket::connection& /*conn*/) {
 
 void WsServer::MessageHandler(crow::websocket::connection& conn, const std::string& data, bool is_binary) {
     CROW_LOG_INFO << "MessageHandler(): message received: " << (is_binary ? "<blob>" : data);
+    auto trace = tracing_ ? std::make_shared<Trace>() : nullptr;
+    const auto received = std::chrono::steady_clock::now();
 
-    try {
-        const auto request = MakeRequest(data);
-        auto http_client = HttpClient(request->Url());
-        const auto [status, body] = request->Accept(http_client);
-        const auto response = MakeResponseJson(status, body);
-        conn.send_text(response);
-    } catch (std::exception& e) {
-        const std::string err_msg = "MessageHandler(): payload processing failed: " + std::string(e.what());
-        CROW_LOG_INFO << err_msg;
-        conn.send_text(err_msg);
+    auto client = ClientOf(conn);
+    if (!client)
+        return;
+
+    const auto sequence = client->BeginRequest(data.size());
+    if (!sequence) {
+        // Still answered in order, after the responses to earlier requests
+        CROW_LOG_INFO << "MessageHandler(): client fell behind, request rejected";
+        const auto frame = WriteResponseJson(static_cast<int>(ProxyStatus::Backpressure), "Too many pending responses");
+        if (!client->Reject(frame)) {
+            // Rejections would pile up without limit otherwise, behind a single slow request
+            CROW_LOG_WARNING << "MessageHandler(): client keeps sending while rejected, closing";
+            conn.close("Too many rejected requests");
+        }
+        return;
     }
+
+    // Upstream calls block, so they run on the pool and Crow's threads keep serving other clients
+    asio::post(dispatch_pool_, [this, client = std::move(client), sequence = *sequence, data, trace = std::move(trace),
+                                received]() mutable {
+        // Dispatcher and client mark the stages below the worker through the scope
+        TraceScope trace_scope(trace.get());
+        Trace::MarkCurrent(TraceStage::Queued);
+        std::string frame;
+        // Malformed messages are reported without an exception, clients may send them at will
+        auto decoded = DecodeMessage(data, decoder_config_);
+        if (!decoded.message) {
+            decode_errors_.Increment();
+            frame = "MessageHandler(): payload processing failed: " + decoded.ErrorText();
+            CROW_LOG_INFO << frame;
+        } else {
+            try {
+                auto& message = *decoded.message;
+                if (auto* request = std::get_if<Request>(&message)) {
+                    std::optional<LiveRegistry<ClientRequest>::Scoped> in_flight;
+                    if (admin_config_.enabled)
+                        in_flight.emplace(requests_, ++next_id_,
+                                          ClientRequest{client->Id(), request->GetMethod(), request->Url(),
+                                                        request->Path(), received});
+                    frame = HandleRequest(*request, client->GetSession(), trace.get());
+                } else {
+                    trace.reset();  // Only requests are traced
+                    if (auto* subscribe = std::get_if<SubscribeCommand>(&message))
+                        frame = HandleSubscribe(client, *subscribe);
+                    else
+                        frame = HandleUnsubscribe(*client, std::get<UnsubscribeCommand>(message));
+                }
+            } catch (std::exception& e) {
+                frame = "MessageHandler(): payload processing failed: " + std::string(e.what());
+                CROW_LOG_INFO << frame;
+            }
+        }
+
+        ClientConnection::OnSent on_sent;
+        if (trace) {
+            on_sent = [this, trace](bool sent) {
+                if (sent)
+                    trace->Mark(TraceStage::Sent);
+                if (tracer_)
+                    tracer_->Export(trace);
+            };
+        }
+        client->Respond(sequence, std::move(frame), std::move(on_sent));
+    });
+}
+
+std::string WsServer::HandleRequest(Request& request, Session* session, Trace* trace) {
+    if (trace)
+        StartSpan(*trace, request);
+    // Url is checked as the client sent it, route stages are trusted to change it
+    if (!access_.Allows(request.Url(), request.Path())) {
+        if (trace)
+            trace->SetStatus(static_cast<int>(ProxyStatus::Denied));
+        return WriteResponseJson(static_cast<int>(ProxyStatus::Denied), "Origin not allowed");
+    }
+
+    const auto& pipeline = routes_.Match(request.Url(), request.Path());
+    auto rejection = pipeline.Before(request);
+    auto response = rejection ? std::move(*rejection) : dispatcher_.Dispatch(request, session);
+    Trace::MarkCurrent(TraceStage::Complete);
+    pipeline.After(response);
+    if (trace)
+        trace->SetStatus(response.status);
+    return WriteResponseJson(response, timing_ ? trace : nullptr);
+}
+
+std::string WsServer::HandleSubscribe(const std::shared_ptr<ClientConnection>& client, SubscribeCommand& command) {
+    auto& request = command.request;
+    if (!access_.Allows(request.Url(), request.Path()))
+        return WriteResponseJson(static_cast<int>(ProxyStatus::Denied), "Origin not allowed");
+
+    // Request stages run once, response stages on every polled response
+    const auto& pipeline = routes_.Match(request.Url(), request.Path());
+    if (auto rejection = pipeline.Before(request))
+        return WriteResponseJson(*rejection);
+    auto fetch = [this, &pipeline](const Request& polled) {
+        auto response = dispatcher_.Dispatch(polled);
+        pipeline.After(response);
+        return response;
+    };
+    auto push = [weak_client = std::weak_ptr<ClientConnection>(client)](const std::string& frame) {
+        const auto client = weak_client.lock();
+        return client ? client->Push(frame) : PushResult::Gone;
+    };
+    const bool open = client->IfOpen([&] {
+        subscriptions_.Subscribe(client->Id(), command.id, request, command.interval, command.delta, std::move(fetch),
+                                 std::move(push));
+    });
+    if (!open)
+        throw std::runtime_error("HandleSubscribe(): client is closed");
+    return WriteResponseJson(200, "Subscribed");
+}
+
+std::string WsServer::HandleUnsubscribe(ClientConnection& client, const UnsubscribeCommand& command) {
+    if (!subscriptions_.Unsubscribe(client.Id(), command.id))
+        return WriteResponseJson(404, "No such subscription");
+    return WriteResponseJson(200, "Unsubscribed");
 }
 
 void WsServer::ErrorHandler(crow::websocket::connection& /*conn*/, const std::string& error_message) {
     CROW_LOG_ERROR << "ErrorHandler(): error message: " << error_message;
 }
+
+std::string WsServer::AdminState() const {
+    // Each registry shard and each client is locked on its own, for as long as it takes to copy its entries
+    AdminReport report;
+    for (const auto& [id, weak_client] : clients_.Snapshot()) {
+        if (const auto client = weak_client.lock())
+            report.connections.push_back(client->Stats());
+    }
+    for (auto& [id, request] : requests_.Snapshot())
+        report.requests.push_back(std::move(request));
+    report.pool = dispatcher_.PoolOccupancy();
+    report.upstream_calls = dispatcher_.UpstreamCalls();
+    return WriteAdminReport(std::move(report), std::chrono::steady_clock::now(), admin_config_.slowest);
+}
@@ -1,14 +1,28 @@
 #pragma once
 
+#include "ClientConnection.h"
+#include "Config.h"
+#include "Dispatcher.h"
+#include "LiveRegistry.h"
+#include "Metrics.h"
+#include "OriginMatcher.h"
+#include "Pipeline.h"
+#include "Requests.h"
+#include "SubscriptionHub.h"
+#include "TraceExporter.h"
+
+#include <asio.hpp>
 #include <crow.h>
 
+#include <atomic>
 #include <future>
+#include <memory>
 #include <mutex>
 #include <string>
 
 class WsServer final {
 public:
-    WsServer(const std::string& address, uint16_t port);
+    WsServer(const std::string& address, uint16_t port, const Config& config);
     WsServer(const WsServer&) = delete;
     WsServer(WsServer&&) = delete;
     WsServer& operator=(const WsServer&) = delete;
@@ -23,8 +37,35 @@ private:
     void MessageHandler(crow::websocket::connection& conn, const std::string& data, bool is_binary);
     void ErrorHandler(crow::websocket::connection& conn, const std::string& error_message);
 
+    // Frame to respond with
+    std::string HandleRequest(Request& request, Session* session, Trace* trace);
+    std::string HandleSubscribe(const std::shared_ptr<ClientConnection>& client, SubscribeCommand& command);
+    std::string HandleUnsubscribe(ClientConnection& client, const UnsubscribeCommand& command);
+    // Json for the admin route
+    std::string AdminState() const;
+
+    MetricsRegistry metrics_;
+    SendQueueConfig send_queue_config_;
+    SendQueueMetrics send_queue_metrics_;
+    DecoderConfig decoder_config_;
+    Counter& decode_errors_;
+    SessionConfig session_config_;
+    Gauge& sessions_;
+    Dispatcher dispatcher_;
+    OriginMatcher access_;
+    RouteTable routes_;
+    bool tracing_;
+    bool timing_;
+    std::unique_ptr<TraceExporter> tracer_;  // Null if traces aren't exported
+    AdminConfig admin_config_;
+    std::atomic<uint64_t> next_id_{0};  // Of clients and of requests
+    LiveRegistry<std::weak_ptr<ClientConnection>> clients_;
+    LiveRegistry<ClientRequest> requests_;  // Tracked only if admin route is enabled
     std::future<void> run_future_;  // Crow async holder
+    std::atomic<bool> started_{false};
     crow::SimpleApp app_;
     std::mutex capacity_guard_;
     size_t capacity_ = 0;
+    asio::thread_pool dispatch_pool_;  // Joined before anything it uses is destroyed
+    SubscriptionHub subscriptions_;  // Stops posting polls before the pool goes
 };
@@ -1,3 +1,4 @@
+#include "Config.h"
 #include "WsServer.h"
 
 #include <iostream>
@@ -7,7 +8,17 @@ const std::string kBindAddress = "127.0.0.1";
 constexpr uint16_t kPort = 18080;
 
 int main(int argc, char* argv[]) {
-    WsServer server(kBindAddress, kPort);
+    Config config;
+    if (argc > 1) {
+        try {
+            config = LoadConfig(argv[1]);
+        } catch (std::exception& e) {
+            std::cout << "Config loading failed: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    WsServer server(kBindAddress, kPort, config);
 
     std::cout << "Server started" << std::endl;
     while (true) {
@@ -0,0 +1,187 @@
+#include "CircuitBreaker.h"
+#include "Config.h"
+#include "Metrics.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+CircuitBreakerConfig SmallWindowConfig() {
+    CircuitBreakerConfig config;
+    config.window = std::chrono::milliseconds(1000);
+    config.buckets = 10;
+    config.min_calls = 4;
+    config.failure_rate = 0.5;
+    config.slow_call = std::chrono::milliseconds(100);
+    config.slow_call_rate = 0.5;
+    config.open_duration = std::chrono::milliseconds(500);
+    config.half_open_calls = 2;
+    return config;
+}
+
+constexpr auto kFast = std::chrono::microseconds(1000);
+
+}  // namespace
+
+////////////////////////////////////////////////
+// CircuitBreaker
+
+class CircuitBreakerTest : public ::testing::Test {
+protected:
+    CircuitBreaker::Clock::time_point now = CircuitBreaker::Clock::time_point{} + std::chrono::hours(1);
+    CircuitBreaker breaker{SmallWindowConfig(), [this] { return now; }};
+};
+
+TEST_F(CircuitBreakerTest, OpensOnFailureRate) {
+    breaker.Record(false, kFast);
+    breaker.Record(true, kFast);
+    breaker.Record(false, kFast);
+    EXPECT_EQ(breaker.State(), CircuitState::Closed);  // Below min_calls
+    breaker.Record(true, kFast);
+    EXPECT_EQ(breaker.State(), CircuitState::Open);
+    EXPECT_EQ(breaker.Opened(), 1u);
+
+    EXPECT_FALSE(breaker.Allow());
+    EXPECT_EQ(breaker.Rejected(), 1u);
+}
+
+TEST_F(CircuitBreakerTest, OpensOnSlowCalls) {
+    for (int i = 0; i < 4; ++i)
+        breaker.Record(false, std::chrono::milliseconds(200));
+    EXPECT_EQ(breaker.State(), CircuitState::Open);
+}
+
+TEST_F(CircuitBreakerTest, OldFailuresLeaveWindow) {
+    breaker.Record(true, kFast);
+    breaker.Record(true, kFast);
+    now += std::chrono::milliseconds(1500);
+    breaker.Record(false, kFast);
+    breaker.Record(false, kFast);
+    breaker.Record(false, kFast);
+    breaker.Record(true, kFast);
+    EXPECT_EQ(breaker.State(), CircuitState::Closed);
+}
+
+TEST_F(CircuitBreakerTest, HalfOpenProbesClose) {
+    for (int i = 0; i < 4; ++i)
+        breaker.Record(true, kFast);
+    ASSERT_EQ(breaker.State(), CircuitState::Open);
+
+    now += std::chrono::milliseconds(500);
+    EXPECT_TRUE(breaker.Allow());
+    EXPECT_EQ(breaker.State(), CircuitState::HalfOpen);
+    EXPECT_TRUE(breaker.Allow());
+    EXPECT_FALSE(breaker.Allow());  // Only half_open_calls probes
+
+    breaker.Record(false, kFast);
+    breaker.Record(false, kFast);
+    EXPECT_EQ(breaker.State(), CircuitState::Closed);
+    EXPECT_TRUE(breaker.Allow());
+
+    // Window was reset, single failure doesn't trip
+    breaker.Record(true, kFast);
+    EXPECT_EQ(breaker.State(), CircuitState::Closed);
+}
+
+TEST_F(CircuitBreakerTest, HalfOpenFailureReopens) {
+    for (int i = 0; i < 4; ++i)
+        breaker.Record(true, kFast);
+    now += std::chrono::milliseconds(500);
+    ASSERT_TRUE(breaker.Allow());
+    breaker.Record(true, kFast);
+    EXPECT_EQ(breaker.State(), CircuitState::Open);
+    EXPECT_EQ(breaker.Opened(), 2u);
+    EXPECT_FALSE(breaker.Allow());
+}
+
+TEST_F(CircuitBreakerTest, AbandonedProbeIsReturned) {
+    for (int i = 0; i < 4; ++i)
+        breaker.Record(true, kFast);
+    now += std::chrono::milliseconds(500);
+    ASSERT_TRUE(breaker.Allow());
+    ASSERT_TRUE(breaker.Allow());
+    breaker.Abandon();
+    EXPECT_TRUE(breaker.Allow());
+}
+
+TEST_F(CircuitBreakerTest, Idle) {
+    EXPECT_TRUE(breaker.IsIdle());
+    breaker.Record(false, kFast);
+    EXPECT_FALSE(breaker.IsIdle());
+    now += std::chrono::milliseconds(1000);
+    EXPECT_TRUE(breaker.IsIdle());
+
+    for (int i = 0; i < 4; ++i)
+        breaker.Record(true, kFast);
+    now += std::chrono::milliseconds(2000);
+    EXPECT_FALSE(breaker.IsIdle());  // Open
+}
+
+////////////////////////////////////////////////
+// CircuitBreakerRegistry
+
+TEST(CircuitBreakerRegistryTest, KnownOrigins) {
+    CircuitBreakerRegistry registry(SmallWindowConfig(), {"http://a:80", "http://b:80"}, 0);
+    std::shared_ptr<CircuitBreaker> holder;
+    auto* a = registry.Find("http://a:80", holder);
+    ASSERT_TRUE(a);
+    EXPECT_FALSE(holder);  // Lives as long as registry
+    EXPECT_EQ(registry.Find("http://a:80", holder), a);
+    EXPECT_NE(registry.Find("http://b:80", holder), a);
+    EXPECT_FALSE(registry.Find("http://c:80", holder));
+    EXPECT_EQ(registry.Stats().size(), 2u);
+}
+
+TEST(CircuitBreakerRegistryTest, OpenCircuitsAreKept) {
+    auto now = CircuitBreaker::Clock::time_point{} + std::chrono::hours(1);
+    CircuitBreakerRegistry registry(SmallWindowConfig(), {}, 2, [&now] { return now; });
+
+    std::shared_ptr<CircuitBreaker> holder;
+    auto* failing = registry.Find("http://failing:80", holder);
+    ASSERT_TRUE(failing);
+    EXPECT_TRUE(holder);
+    for (int i = 0; i < 4; ++i)
+        failing->Record(true, kFast);
+    ASSERT_EQ(failing->State(), CircuitState::Open);
+    auto* busy = registry.Find("http://busy:80", holder);
+    ASSERT_TRUE(busy);
+    busy->Record(false, kFast);
+
+    // Full, nothing idle: new origin goes without a breaker
+    EXPECT_FALSE(registry.Find("http://new:80", holder));
+
+    // Busy one goes idle and makes room, open one stays
+    now += std::chrono::milliseconds(1000);
+    EXPECT_TRUE(registry.Find("http://new:80", holder));
+    EXPECT_EQ(registry.Find("http://failing:80", holder), failing);
+    EXPECT_EQ(failing->State(), CircuitState::Open);
+    EXPECT_EQ(registry.Stats().size(), 2u);
+}
+
+TEST(CircuitBreakerConfigTest, Parse) {
+    const auto config = ParseConfig(R"({"circuit_breaker": {"enabled": true, "min_calls": 7, "open_ms": 100}})");
+    EXPECT_TRUE(config.circuit_breaker.enabled);
+    EXPECT_FALSE(ParseConfig("{}").circuit_breaker.enabled);
+    EXPECT_EQ(config.circuit_breaker.min_calls, 7u);
+    EXPECT_EQ(config.circuit_breaker.open_duration, std::chrono::milliseconds(100));
+
+    EXPECT_THROW(ParseConfig(R"({"circuit_breaker": {"failure_rate": 0}})"), std::exception);
+    EXPECT_THROW(ParseConfig(R"({"circuit_breaker": {"buckets": 0}})"), std::exception);
+}
+
+////////////////////////////////////////////////
+// Metrics
+
+TEST(MetricsTest, Render) {
+    MetricsRegistry metrics;
+    auto& counter = metrics.AddCounter("test_total", "Test counter");
+    auto& gauge = metrics.AddGauge("test_value", "Test gauge");
+    metrics.AddCollector([](std::ostream& out) { out << "test_labeled{origin=\"" << EscapeLabel("a\"b") << "\"} 1\n"; });
+
+    counter.Increment(3);
+    gauge.Set(-2);
+    const auto text = metrics.Render();
+    EXPECT_NE(text.find("# TYPE test_total counter\ntest_total 3\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE test_value gauge\ntest_value -2\n"), std::string::npos);
+    EXPECT_NE(text.find("test_labeled{origin=\"a\\\"b\"} 1\n"), std::string::npos);
+}
@@ -0,0 +1,242 @@
+#include "Origin.h"
+#include "ResolverCache.h"
+
+#include <gtest/gtest.h>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <sstream>
+#include <thread>
+
+////////////////////////////////////////////////
+// Origin
+
+struct OriginTestParam {
+    std::string url;
+    Origin expected;
+};
+
+const std::vector<OriginTestParam> kOriginTestParams = {
+    {"http://httpbin.org", {"http", "httpbin.org", 80}},
+    {"https://httpbin.org", {"https", "httpbin.org", 443}},
+    {"httpbin.org", {"http", "httpbin.org", 80}},
+    {"http://HTTPBIN.org:8080", {"http", "httpbin.org", 8080}},
+    {"http://127.0.0.1:18080/path", {"http", "127.0.0.1", 18080}},
+    {"http://[::1]:8080", {"http", "::1", 8080}},
+};
+
+class OriginTestFixture : public ::testing::TestWithParam<OriginTestParam> {};
+
+TEST_P(OriginTestFixture, ParseOrigin) {
+    const auto origin = ParseOrigin(GetParam().url);
+    EXPECT_EQ(origin.scheme, GetParam().expected.scheme);
+    EXPECT_EQ(origin.host, GetParam().expected.host);
+    EXPECT_EQ(origin.port, GetParam().expected.port);
+}
+
+INSTANTIATE_TEST_CASE_P(OriginTest, OriginTestFixture, ::testing::ValuesIn(kOriginTestParams));
+
+TEST(OriginTest, InvalidOrigin) {
+    EXPECT_THROW(ParseOrigin(""), std::exception);
+    EXPECT_THROW(ParseOrigin("ftp://httpbin.org"), std::exception);
+    EXPECT_THROW(ParseOrigin("http://httpbin.org:99999"), std::exception);
+    EXPECT_THROW(ParseOrigin("http://[::1"), std::exception);
+}
+
+TEST(OriginTest, IpLiteral) {
+    EXPECT_TRUE(ParseOrigin("http://127.0.0.1").IsIpLiteral());
+    EXPECT_TRUE(ParseOrigin("http://[::1]").IsIpLiteral());
+    EXPECT_FALSE(ParseOrigin("http://httpbin.org").IsIpLiteral());
+}
+
+////////////////////////////////////////////////
+// ResolverCache
+
+namespace {
+
+class StubSource final : public ResolverSource {
+public:
+    Resolution Resolve(const std::string& host) override {
+        ++calls;
+        const auto it = table.find(host);
+        return it == table.end() ? Resolution{} : it->second;
+    }
+
+    std::map<std::string, Resolution> table;
+    std::atomic<int> calls = 0;
+};
+
+struct FakeClock {
+    ResolverCache::Clock::time_point now = ResolverCache::Clock::time_point{} + std::chrono::hours(1);
+};
+
+ResolverCache::Options MakeOptions(FakeClock& clock) {
+    ResolverCache::Options options;
+    options.happy_eyeballs = false;
+    options.now = [&clock] { return clock.now; };
+    return options;
+}
+
+}  // namespace
+
+TEST(ResolverCacheTest, CachesWithinTtl) {
+    FakeClock clock;
+    auto source = std::make_unique<StubSource>();
+    auto& stub = *source;
+    stub.table["a.test"] = {{{ResolvedAddress::Family::V4, "10.0.0.1"}}, std::chrono::seconds(10)};
+    ResolverCache cache(std::move(source), MakeOptions(clock));
+
+    EXPECT_EQ(cache.Lookup("a.test", 80), "10.0.0.1");
+    EXPECT_EQ(cache.Lookup("A.TEST", 80), "10.0.0.1");
+    EXPECT_EQ(stub.calls, 1);
+
+    clock.now += std::chrono::seconds(11);
+    EXPECT_EQ(cache.Lookup("a.test", 80), "10.0.0.1");
+    EXPECT_EQ(stub.calls, 2);
+}
+
+TEST(ResolverCacheTest, NegativeCaching) {
+    FakeClock clock;
+    auto source = std::make_unique<StubSource>();
+    auto& stub = *source;
+    auto options = MakeOptions(clock);
+    options.negative_ttl = std::chrono::seconds(5);
+    ResolverCache cache(std::move(source), options);
+
+    EXPECT_FALSE(cache.Lookup("missing.test", 80));
+    EXPECT_FALSE(cache.Lookup("missing.test", 80));
+    EXPECT_EQ(stub.calls, 1);
+
+    clock.now += std::chrono::seconds(6);
+    EXPECT_FALSE(cache.Lookup("missing.test", 80));
+    EXPECT_EQ(stub.calls, 2);
+}
+
+TEST(ResolverCacheTest, RefreshesAheadOfExpiry) {
+    FakeClock clock;
+    auto source = std::make_unique<StubSource>();
+    auto& stub = *source;
+    stub.table["a.test"] = {{{ResolvedAddress::Family::V4, "10.0.0.1"}}, std::chrono::seconds(10)};
+    auto options = MakeOptions(clock);
+    options.refresh_ahead = 0.5;
+    ResolverCache cache(std::move(source), options);
+
+    EXPECT_EQ(cache.Lookup("a.test", 80), "10.0.0.1");
+    stub.table["a.test"] = {{{ResolvedAddress::Family::V4, "10.0.0.2"}}, std::chrono::seconds(10)};
+
+    // Stale but valid record is served while refresh runs in background
+    clock.now += std::chrono::seconds(6);
+    EXPECT_EQ(cache.Lookup("a.test", 80), "10.0.0.1");
+
+    for (int i = 0; i < 200 && cache.Lookup("a.test", 80) != "10.0.0.2"; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_EQ(cache.Lookup("a.test", 80), "10.0.0.2");
+    EXPECT_EQ(stub.calls, 2);
+}
+
+TEST(ResolverCacheTest, TtlIsClamped) {
+    FakeClock clock;
+    auto source = std::make_unique<StubSource>();
+    auto& stub = *source;
+    stub.table["a.test"] = {{{ResolvedAddress::Family::V4, "10.0.0.1"}}, std::chrono::milliseconds(1)};
+    auto options = MakeOptions(clock);
+    options.min_ttl = std::chrono::seconds(2);
+    ResolverCache cache(std::move(source), options);
+
+    cache.Lookup("a.test", 80);
+    clock.now += std::chrono::seconds(1);
+    cache.Lookup("a.test", 80);
+    EXPECT_EQ(stub.calls, 1);
+}
+
+#ifndef _WIN32
+TEST(ResolverCacheTest, RacesInBackground) {
+    // Listens on IPv4 loopback only, so IPv6 attempt is refused
+    const auto listener = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(listener, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    ASSERT_EQ(bind(listener, reinterpret_cast<sockaddr*>(&addr), length), 0);
+    ASSERT_EQ(listen(listener, 4), 0);
+    ASSERT_EQ(getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &length), 0);
+    const auto port = ntohs(addr.sin_port);
+
+    FakeClock clock;
+    auto source = std::make_unique<StubSource>();
+    source->table["a.test"] = {{{ResolvedAddress::Family::V4, "127.0.0.1"}, {ResolvedAddress::Family::V6, "::1"}}, {}};
+    auto options = MakeOptions(clock);
+    options.happy_eyeballs = true;
+    ResolverCache cache(std::move(source), options);
+
+    // Cold lookup doesn't wait for the race
+    EXPECT_EQ(cache.Lookup("a.test", port), "::1");
+    for (int i = 0; i < 200 && cache.Lookup("a.test", port) != "127.0.0.1"; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_EQ(cache.Lookup("a.test", port), "127.0.0.1");
+    close(listener);
+}
+
+TEST(ResolverCacheTest, RefreshNotHeldUpByRace) {
+    FakeClock clock;
+    auto source = std::make_unique<StubSource>();
+    auto& stub = *source;
+    // Documentation prefixes, connections to them hang until connect_timeout where they are routed at all
+    stub.table["slow.test"] = {
+        {{ResolvedAddress::Family::V4, "192.0.2.1"}, {ResolvedAddress::Family::V6, "2001:db8::1"}}, {}};
+    stub.table["a.test"] = {{{ResolvedAddress::Family::V4, "10.0.0.1"}}, std::chrono::seconds(10)};
+    auto options = MakeOptions(clock);
+    options.happy_eyeballs = true;
+    options.refresh_ahead = 0.5;
+    options.connect_timeout = std::chrono::seconds(2);
+    ResolverCache cache(std::move(source), options);
+
+    EXPECT_EQ(cache.Lookup("a.test", 80), "10.0.0.1");
+    EXPECT_TRUE(cache.Lookup("slow.test", 80));
+    stub.table["a.test"] = {{{ResolvedAddress::Family::V4, "10.0.0.2"}}, std::chrono::seconds(10)};
+
+    clock.now += std::chrono::seconds(6);
+    EXPECT_EQ(cache.Lookup("a.test", 80), "10.0.0.1");
+    for (int i = 0; i < 100 && cache.Lookup("a.test", 80) != "10.0.0.2"; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_EQ(cache.Lookup("a.test", 80), "10.0.0.2");
+}
+#endif
+
+TEST(ResolverCacheTest, HostsFileSource) {
+    std::istringstream hosts(
+        "# comment\n"
+        "127.0.0.1   localhost local.test\n"
+        "::1         localhost  # trailing comment\n"
+        "\n"
+        "10.1.2.3    Orders.Internal\n");
+    HostsFileSource source(hosts);
+
+    const auto localhost = source.Resolve("localhost");
+    ASSERT_EQ(localhost.addresses.size(), 2u);
+    EXPECT_EQ(localhost.addresses[0].ip, "127.0.0.1");
+    EXPECT_EQ(localhost.addresses[1].ip, "::1");
+    EXPECT_EQ(localhost.addresses[1].family, ResolvedAddress::Family::V6);
+
+    ASSERT_EQ(source.Resolve("orders.internal").addresses.size(), 1u);
+    EXPECT_EQ(source.Resolve("orders.internal").addresses[0].ip, "10.1.2.3");
+    EXPECT_TRUE(source.Resolve("missing.test").addresses.empty());
+}
+
+TEST(ResolverCacheTest, HostsFileFallback) {
+    std::istringstream hosts("10.1.2.3 orders.internal\n");
+    auto fallback = std::make_unique<StubSource>();
+    fallback->table["a.test"] = {{{ResolvedAddress::Family::V4, "10.0.0.1"}}, {}};
+    ResolverCache cache(std::make_unique<HostsFileSource>(hosts, std::move(fallback)));
+
+    EXPECT_EQ(cache.Lookup("orders.internal", 80), "10.1.2.3");
+    EXPECT_EQ(cache.Lookup("a.test", 80), "10.0.0.1");
+    EXPECT_FALSE(cache.Lookup("missing.test", 80));
+}
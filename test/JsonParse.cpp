@@ -1,3 +1,4 @@
+#include "Config.h"
 #include "Requests.h"
 
 #include <gtest/gtest.h>
@@ -47,6 +48,9 @@ class InvalidJsonTestFixture : public ::testing::TestWithParam<std::string> {};
 
 TEST_P(InvalidJsonTestFixture, InvalidJson) {
     EXPECT_THROW(MakeRequest(GetParam()), std::exception);
+    const auto decoded = DecodeMessage(GetParam());
+    EXPECT_FALSE(decoded.message);
+    EXPECT_NE(decoded.error, DecodeError::None);
 }
 
 INSTANTIATE_TEST_CASE_P(InvalidJson, InvalidJsonTestFixture, ::testing::ValuesIn(kInvalidJsonTestParams));
@@ -74,6 +78,63 @@ class ValidJsonTestFixture : public ::testing::TestWithParam<std::string> {};
 
 TEST_P(ValidJsonTestFixture, ValidJson) {
     EXPECT_NO_THROW(MakeRequest(GetParam()));
+    EXPECT_TRUE(DecodeMessage(GetParam()).message);
 }
 
 INSTANTIATE_TEST_CASE_P(ValidJson, ValidJsonTestFixture, ::testing::ValuesIn(kJsonValidTypesTestParams));
+
+
+TEST(DecodeMessageTest, Errors) {
+    const auto missing = DecodeMessage(R"({"path": "/", "method": "HEAD"})");
+    EXPECT_EQ(missing.error, DecodeError::MissingField);
+    EXPECT_EQ(missing.field, "url");
+    EXPECT_EQ(missing.ErrorText(), "missing url");
+
+    const auto wrong_type = DecodeMessage(R"({"url": "http://httpbin.org", "method": "GET", "headers": ["Accept"]})");
+    EXPECT_EQ(wrong_type.error, DecodeError::WrongType);
+    EXPECT_EQ(wrong_type.ErrorText(), "wrong type of headers");
+
+    EXPECT_EQ(DecodeMessage("[1, 2]").error, DecodeError::WrongType);
+    EXPECT_EQ(DecodeMessage(R"({"url": )").error, DecodeError::Syntax);
+    EXPECT_EQ(DecodeMessage(R"({"url": "http://httpbin.org", "method": "FETCH"})").error, DecodeError::UnknownMethod);
+    EXPECT_EQ(DecodeMessage(R"({"url": "http://httpbin.org", "method": "PUT"})").error, DecodeError::NoPayload);
+    EXPECT_EQ(DecodeMessage(R"({"type": "publish"})").error, DecodeError::UnknownType);
+    EXPECT_EQ(DecodeMessage(R"({"type": "subscribe", "subscription": "s", "url": "http://httpbin.org",
+        "method": "POST", "interval_ms": 1000})").error, DecodeError::NotGet);
+    EXPECT_EQ(DecodeMessage(R"({"type": "subscribe", "subscription": "s", "url": "http://httpbin.org",
+        "interval_ms": "1000"})").error, DecodeError::WrongType);
+
+    // Same text as the throwing API
+    try {
+        MakeRequest(R"({"url": "http://httpbin.org", "method": "PUT"})");
+        FAIL();
+    } catch (const std::exception& e) {
+        EXPECT_STREQ(e.what(), "MakeRequest(): PUT method should put something");
+    }
+}
+
+TEST(DecodeMessageTest, Limits) {
+    DecoderConfig limits;
+    limits.max_depth = 4;
+    limits.max_headers = 2;
+
+    const std::string deep = std::string(10000, '[') + std::string(10000, ']');
+    EXPECT_EQ(DecodeMessage(deep, limits).error, DecodeError::TooDeep);
+    // Brackets in strings aren't nesting
+    const auto bracketed = DecodeMessage(R"({"url": "http://httpbin.org", "path": "/[[[[[[\"]]", "method": "GET"})",
+                                         limits);
+    ASSERT_TRUE(bracketed.message);
+    EXPECT_EQ(std::get<Request>(*bracketed.message).Path(), R"(/[[[[[["]])");
+
+    EXPECT_TRUE(DecodeMessage(R"({"url": "http://httpbin.org", "method": "GET", "headers": {"A": "1", "B": "2"}})",
+                              limits).message);
+    EXPECT_EQ(DecodeMessage(R"({"url": "http://httpbin.org", "method": "GET",
+        "headers": {"A": "1", "B": "2", "C": "3"}})", limits).error, DecodeError::TooManyHeaders);
+}
+
+TEST(DecodeMessageTest, ParseConfig) {
+    const auto config = ParseConfig(R"({"decoder": {"max_depth": 16, "max_headers": 64}})");
+    EXPECT_EQ(config.decoder.max_depth, 16u);
+    EXPECT_EQ(config.decoder.max_headers, 64u);
+    EXPECT_THROW(ParseConfig(R"({"decoder": {"max_depth": 2}})"), std::exception);
+}
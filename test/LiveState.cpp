@@ -0,0 +1,129 @@
+#include "AdminReport.h"
+#include "Config.h"
+#include "LiveRegistry.h"
+
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////
+// Config
+
+TEST(ConfigTest, ParseAdmin) {
+    const auto config = ParseConfig(R"({"admin": {"enabled": true, "slowest": 3}})");
+    EXPECT_TRUE(config.admin.enabled);
+    EXPECT_EQ(config.admin.slowest, 3u);
+    EXPECT_FALSE(ParseConfig("{}").admin.enabled);
+}
+
+////////////////////////////////////////////////
+// LiveRegistry
+
+TEST(LiveRegistryTest, AddRemove) {
+    LiveRegistry<std::string> registry;
+    registry.Add(1, "first");
+    registry.Add(2, "second");
+    {
+        LiveRegistry<std::string>::Scoped scoped(registry, 3, "third");
+        EXPECT_EQ(registry.Snapshot().size(), 3u);
+    }
+    registry.Remove(1);
+
+    const auto entries = registry.Snapshot();
+    ASSERT_EQ(entries.size(), 1u);
+    EXPECT_EQ(entries[0].first, 2u);
+    EXPECT_EQ(entries[0].second, "second");
+}
+
+TEST(LiveRegistryTest, SnapshotsWhileWriting) {
+    LiveRegistry<int> registry;
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> next_id{0};
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 4; ++i) {
+        writers.emplace_back([&] {
+            while (!stop) {
+                const auto id = ++next_id;
+                LiveRegistry<int>::Scoped scoped(registry, id, static_cast<int>(id));
+            }
+        });
+    }
+    for (int i = 0; i < 1000; ++i) {
+        for (const auto& [id, value] : registry.Snapshot())
+            EXPECT_EQ(static_cast<int>(id), value);
+    }
+    stop = true;
+    for (auto& writer : writers)
+        writer.join();
+    EXPECT_TRUE(registry.Snapshot().empty());
+}
+
+////////////////////////////////////////////////
+// AdminReport
+
+TEST(AdminReportTest, Write) {
+    const auto now = std::chrono::steady_clock::now();
+    const auto ago = [now](int ms) { return now - std::chrono::milliseconds(ms); };
+
+    AdminReport report;
+    ClientStats busy;
+    busy.id = 7;
+    busy.remote_ip = "10.0.0.1";
+    busy.opened = ago(5000);
+    busy.in_flight = 2;
+    busy.queued_bytes = 300;
+    busy.oldest_request = ago(1500);
+    busy.session = true;
+    ClientStats idle;
+    idle.id = 3;
+    idle.opened = ago(100);
+    report.connections = {busy, idle};
+
+    report.requests = {
+        {7, Method::METHOD_GET, "http://a.example.com", "/fast", ago(10)},
+        {7, Method::METHOD_POST, "http://a.example.com", "/slow", ago(1500)},
+        {7, Method::METHOD_GET, "http://a.example.com", "/\xff", ago(20)},
+    };
+    report.pool = {{"http://a.example.com:80", 2, 1}};
+    report.upstream_calls = {{"http://a.example.com:80", Method::METHOD_POST, "/slow", ago(1400)}};
+
+    const auto json = nlohmann::json::parse(WriteAdminReport(report, now, 2));
+
+    const auto& connections = json["connections"];
+    ASSERT_EQ(connections.size(), 2u);
+    EXPECT_EQ(connections[0]["id"], 3);
+    EXPECT_FALSE(connections[0].contains("oldest_request_ms"));
+    EXPECT_EQ(connections[1]["id"], 7);
+    EXPECT_EQ(connections[1]["remote_ip"], "10.0.0.1");
+    EXPECT_EQ(connections[1]["age_ms"], 5000);
+    EXPECT_EQ(connections[1]["in_flight"], 2);
+    EXPECT_EQ(connections[1]["queued_bytes"], 300);
+    EXPECT_EQ(connections[1]["oldest_request_ms"], 1500);
+    EXPECT_EQ(connections[1]["session"], true);
+
+    EXPECT_EQ(json["requests_in_flight"], 3);
+    const auto& requests = json["slowest_requests"];
+    ASSERT_EQ(requests.size(), 2u);
+    EXPECT_EQ(requests[0]["path"], "/slow");
+    EXPECT_EQ(requests[0]["method"], "POST");
+    EXPECT_EQ(requests[0]["age_ms"], 1500);
+    EXPECT_EQ(requests[1]["path"], "/\xEF\xBF\xBD");  // Replacement character
+
+    ASSERT_EQ(json["pool"].size(), 1u);
+    EXPECT_EQ(json["pool"][0]["idle"], 2);
+    EXPECT_EQ(json["pool"][0]["in_use"], 1);
+
+    EXPECT_EQ(json["upstream_calls_in_flight"], 1);
+    EXPECT_EQ(json["slowest_upstream_calls"][0]["origin"], "http://a.example.com:80");
+    EXPECT_EQ(json["slowest_upstream_calls"][0]["age_ms"], 1400);
+}
+
+TEST(AdminReportTest, Empty) {
+    const auto json = nlohmann::json::parse(WriteAdminReport({}, std::chrono::steady_clock::now(), 10));
+    EXPECT_TRUE(json["connections"].empty());
+    EXPECT_TRUE(json["slowest_requests"].empty());
+    EXPECT_EQ(json["requests_in_flight"], 0);
+}
@@ -0,0 +1,100 @@
+#include "Arena.h"
+#include "ResponseWriter.h"
+
+#include <nlohmann/json.hpp>
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <vector>
+
+////////////////////////////////////////////////
+// Arena
+
+TEST(ArenaTest, AllocatesOnlyInScope) {
+    EXPECT_EQ(Arena::Current(), nullptr);
+    {
+        ArenaScope scope;
+        auto* arena = Arena::Current();
+        ASSERT_NE(arena, nullptr);
+
+        auto* a = arena->Allocate(10, 8);
+        auto* b = arena->Allocate(10, 8);
+        EXPECT_TRUE(arena->Owns(a));
+        EXPECT_TRUE(arena->Owns(b));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(b) % 8, 0u);
+        EXPECT_NE(a, b);
+
+        int on_stack = 0;
+        EXPECT_FALSE(arena->Owns(&on_stack));
+    }
+    EXPECT_EQ(Arena::Current(), nullptr);
+}
+
+TEST(ArenaTest, ResetKeepsFirstBlock) {
+    {
+        ArenaScope scope;
+        for (int i = 0; i < 10; ++i)
+            Arena::Current()->Allocate(8 * 1024, 16);
+        EXPECT_GT(Arena::OfThread().BlockCount(), 1u);
+    }
+    EXPECT_EQ(Arena::OfThread().BlockCount(), 1u);
+}
+
+TEST(ArenaTest, NestedScopes) {
+    ArenaScope outer;
+    void* ptr = nullptr;
+    {
+        ArenaScope inner;
+        ptr = Arena::Current()->Allocate(16, 8);
+    }
+    // Inner scope doesn't reset the arena
+    ASSERT_NE(Arena::Current(), nullptr);
+    EXPECT_TRUE(Arena::Current()->Owns(ptr));
+}
+
+TEST(ArenaTest, ContainersMixHeapAndArena) {
+    std::vector<int, ArenaAllocator<int>> heap_vector{1, 2, 3};
+    {
+        ArenaScope scope;
+        std::map<int, int, std::less<int>, ArenaAllocator<std::pair<const int, int>>> arena_map;
+        for (int i = 0; i < 100; ++i)
+            arena_map[i] = i;
+        // Heap memory, freed while arena is active
+        heap_vector.assign(100, 1);
+        EXPECT_EQ(arena_map.size(), 100u);
+    }
+    EXPECT_EQ(heap_vector.size(), 100u);
+}
+
+////////////////////////////////////////////////
+// WriteResponseJson
+
+class ResponseJsonTestFixture : public ::testing::TestWithParam<std::string> {};
+
+TEST_P(ResponseJsonTestFixture, SameAsJsonDump) {
+    nlohmann::json json;
+    json["status"] = 200;
+    json["body"] = GetParam();
+    EXPECT_EQ(WriteResponseJson(200, GetParam()), json.dump());
+}
+
+INSTANTIATE_TEST_CASE_P(ResponseJson, ResponseJsonTestFixture,
+                        ::testing::Values("", "plain", "\"quoted\" \\ slash", "line\nfeed\ttab\r\b\f",
+                                          std::string("\x01\x1f\x7f", 3), std::string("nul\0byte", 8),
+                                          "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82", "\xf0\x9f\x98\x80"));
+
+TEST(ResponseJsonTest, InvalidUtf8) {
+    EXPECT_THROW(WriteResponseJson(200, "\xff"), std::exception);
+    EXPECT_THROW(WriteResponseJson(200, "\xc0\xaf"), std::exception);      // Overlong
+    EXPECT_THROW(WriteResponseJson(200, "\xed\xa0\x80"), std::exception);  // Surrogate
+    EXPECT_THROW(WriteResponseJson(200, "\xd0"), std::exception);          // Truncated
+}
+
+TEST(ResponseJsonTest, BufferIsReused) {
+    const auto* first = &WriteResponseJson(2, "x");
+    EXPECT_EQ(*first, R"({"body":"x","status":2})");
+    const auto* second = &WriteResponseJson(1000, "y");
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(*second, R"({"body":"y","status":1000})");
+}
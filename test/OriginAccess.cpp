@@ -0,0 +1,102 @@
+#include "Config.h"
+#include "OriginMatcher.h"
+
+#include <gtest/gtest.h>
+
+struct OriginMatcherTestParam {
+    std::string url;
+    std::string path;
+    bool allowed;
+};
+
+class OriginMatcherTest : public testing::TestWithParam<OriginMatcherTestParam> {};
+
+TEST_P(OriginMatcherTest, Allows) {
+    const OriginMatcher matcher(
+        {
+            "https://api.example.com",
+            "https://*.cdn.example.com",
+            "http://internal.example.com:8080/public",
+            "upstream://backend",
+        },
+        {
+            "https://api.example.com/admin",
+            "https://evil.cdn.example.com",
+        });
+    EXPECT_EQ(matcher.Allows(GetParam().url, GetParam().path), GetParam().allowed)
+        << GetParam().url << GetParam().path;
+}
+
+const std::vector<OriginMatcherTestParam> kOriginMatcherTestParams = {
+    {"https://api.example.com", "/", true},
+    {"https://API.Example.com:443", "/items", true},   // Canonical form
+    {"https://api.example.com.", "/", true},           // Trailing dot is the same host
+    {"http://api.example.com", "/", false},            // Other scheme and port
+    {"https://api.example.com:8443", "/", false},
+    {"https://example.com", "/", false},
+    {"https://x.api.example.com", "/", false},         // Exact host rule doesn't cover subdomains
+    {"https://api.example.com", "/admin", false},      // Denied path prefix
+    {"https://api.example.com", "/admin/users?x=1", false},
+    {"https://api.example.com", "/admins", true},      // Whole segments only
+    {"https://api.example.com", "//admin", false},
+    {"https://api.example.com", "/x/../admin", false}, // Dot segments aren't resolved, so they're refused
+    {"https://api.example.com", "/%61dmin", false},    // Escaped unreserved characters are decoded
+    {"https://api.example.com", "/%41dmin", true},     // Paths are case-sensitive
+    {"https://api.example.com", "/%2e%2e/admin", false},  // Escaped dot or separator is refused
+    {"https://api.example.com", "/x/%2E./admin", false},
+    {"https://api.example.com", "/admin%2Fusers", false},
+    {"https://api.example.com", "/x%5c..%5cadmin", false},
+    {"https://api.example.com", "/items%", false},     // Malformed escape
+    {"https://api.example.com", "/a%20b%3f", true},    // Reserved and other characters stay escaped
+    {"https://a.cdn.example.com", "/", true},
+    {"https://a.b.cdn.example.com", "/", true},
+    {"https://cdn.example.com", "/", false},           // Wildcard needs at least one label
+    {"https://evil.cdn.example.com", "/", false},
+    {"http://internal.example.com:8080", "/public", true},
+    {"http://internal.example.com:8080", "/public/a", true},
+    {"http://internal.example.com:8080", "/private", false},
+    {"http://internal.example.com:8080", "/", false},
+    {"upstream://backend", "/", true},
+    {"upstream://other", "/", false},
+    {"ftp://api.example.com", "/", false},             // Not a valid upstream url
+};
+
+INSTANTIATE_TEST_CASE_P(OriginMatcherTest, OriginMatcherTest, testing::ValuesIn(kOriginMatcherTestParams));
+
+TEST(OriginMatcherTest, DenyOnly) {
+    const OriginMatcher matcher({}, {"http://*", "https://metadata.internal"});
+    EXPECT_TRUE(matcher.Allows("https://example.com", "/"));
+    EXPECT_FALSE(matcher.Allows("http://example.com", "/"));
+    EXPECT_FALSE(matcher.Allows("https://metadata.internal", "/latest"));
+}
+
+TEST(OriginMatcherTest, Empty) {
+    const OriginMatcher matcher({}, {});
+    EXPECT_TRUE(matcher.Empty());
+    EXPECT_TRUE(matcher.Allows("not a url", "/../x"));
+}
+
+TEST(OriginMatcherTest, ManyRules) {
+    std::vector<std::string> allow;
+    for (int i = 0; i < 5000; ++i)
+        allow.push_back("https://host" + std::to_string(i) + ".example.com/v" + std::to_string(i % 7));
+    const OriginMatcher matcher(allow, {});
+
+    EXPECT_TRUE(matcher.Allows("https://host4321.example.com", "/v2/items"));
+    EXPECT_FALSE(matcher.Allows("https://host4321.example.com", "/v3/items"));
+    EXPECT_FALSE(matcher.Allows("https://host5000.example.com", "/v0"));
+}
+
+TEST(OriginMatcherTest, InvalidRules) {
+    EXPECT_THROW(OriginMatcher({"https://a*.example.com"}, {}), std::exception);
+    EXPECT_THROW(OriginMatcher({"https://api.*.com"}, {}), std::exception);
+    EXPECT_THROW(OriginMatcher({}, {"ftp://example.com"}), std::exception);
+    EXPECT_THROW(OriginMatcher({"upstream://"}, {}), std::exception);
+    EXPECT_THROW(OriginMatcher({}, {"https://example.com/a%2fb"}), std::exception);
+}
+
+TEST(OriginMatcherTest, ParseConfig) {
+    const auto config = ParseConfig(R"({"access": {"allow": ["https://*.example.com"], "deny": ["http://*"]}})");
+    EXPECT_EQ(config.access.allow, std::vector<std::string>{"https://*.example.com"});
+    EXPECT_EQ(config.access.deny, std::vector<std::string>{"http://*"});
+}
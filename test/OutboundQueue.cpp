@@ -0,0 +1,132 @@
+#include "Config.h"
+#include "SendQueue.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+SendQueueConfig SmallQueueConfig() {
+    SendQueueConfig config;
+    config.high_watermark_bytes = 100;
+    config.low_watermark_bytes = 40;
+    config.max_in_flight = 3;
+    config.max_queued_rejections = 4;
+    return config;
+}
+
+}  // namespace
+
+TEST(SendQueueTest, ResponsesInRequestOrder) {
+    SendQueue queue(SmallQueueConfig());
+    const auto first = queue.Reserve(1);
+    const auto second = queue.Reserve(1);
+    const auto third = queue.Reserve(1);
+    ASSERT_TRUE(first && second && third);
+
+    queue.Complete(*second, "2");
+    EXPECT_TRUE(queue.TakeReady().empty());  // Held back by the first one
+    queue.Complete(*third, "3");
+    queue.Complete(*first, "1");
+    EXPECT_EQ(queue.TakeReady(), (std::vector<std::string>{"1", "2", "3"}));
+    EXPECT_EQ(queue.PendingBytes(), 0u);
+    EXPECT_EQ(queue.InFlight(), 0u);
+}
+
+TEST(SendQueueTest, OldestInFlight) {
+    SendQueue queue(SmallQueueConfig());
+    EXPECT_FALSE(queue.OldestInFlight());
+
+    const auto before = SendQueue::Clock::now();
+    const auto first = queue.Reserve(10);
+    const auto second = queue.Reserve(10);
+    ASSERT_TRUE(first && second);
+    const auto oldest = queue.OldestInFlight();
+    ASSERT_TRUE(oldest);
+    EXPECT_GE(*oldest, before);
+
+    // Response waiting to be sent isn't in flight
+    queue.Complete(*first, "response");
+    const auto next = queue.OldestInFlight();
+    ASSERT_TRUE(next);
+    EXPECT_GE(*next, *oldest);
+
+    queue.Complete(*second, "response");
+    EXPECT_FALSE(queue.OldestInFlight());
+}
+
+TEST(SendQueueTest, MaxInFlight) {
+    SendQueue queue(SmallQueueConfig());
+    for (int i = 0; i < 3; ++i)
+        ASSERT_TRUE(queue.Reserve(1));
+    EXPECT_FALSE(queue.Reserve(1));
+
+    queue.Complete(0, "0");
+    EXPECT_TRUE(queue.Reserve(1));
+}
+
+TEST(SendQueueTest, Watermarks) {
+    SendQueue queue(SmallQueueConfig());
+    const auto first = queue.Reserve(10);
+    const auto second = queue.Reserve(10);
+    ASSERT_TRUE(first && second);
+
+    queue.Complete(*second, std::string(90, 'x'));
+    EXPECT_EQ(queue.PendingBytes(), 100u);
+    EXPECT_TRUE(queue.IsPaused());
+    EXPECT_FALSE(queue.Reserve(1));
+
+    // Dropping below high watermark isn't enough
+    queue.Complete(*first, std::string(5, 'x'));
+    EXPECT_TRUE(queue.IsPaused());
+
+    EXPECT_EQ(queue.TakeReady().size(), 2u);
+    EXPECT_FALSE(queue.IsPaused());
+    EXPECT_TRUE(queue.Reserve(1));
+}
+
+TEST(SendQueueTest, RejectionsInOrder) {
+    SendQueue queue(SmallQueueConfig());
+    for (int i = 0; i < 3; ++i)
+        ASSERT_TRUE(queue.Reserve(1));
+    ASSERT_FALSE(queue.Reserve(1));
+
+    // Rejection of the fourth request waits for the first three responses
+    EXPECT_EQ(queue.AppendRejection("rejected"), 3u);
+    EXPECT_TRUE(queue.TakeReady().empty());
+    EXPECT_EQ(queue.PendingBytes(), 3u + 8u);
+    queue.Complete(1, "1");
+    queue.Complete(2, "2");
+    queue.Complete(0, "0");
+    EXPECT_EQ(queue.TakeReady(), (std::vector<std::string>{"0", "1", "2", "rejected"}));
+    EXPECT_EQ(queue.PendingBytes(), 0u);
+    EXPECT_EQ(queue.Reserve(1), 4u);
+}
+
+TEST(SendQueueTest, FloodWhilePaused) {
+    SendQueue queue(SmallQueueConfig());
+    const auto slow = queue.Reserve(100);
+    ASSERT_TRUE(slow);
+    ASSERT_TRUE(queue.IsPaused());
+
+    // Everything behind the slow request waits for it, so only max_queued_rejections are kept
+    for (int i = 0; i < 10000; ++i) {
+        if (!queue.Reserve(1))
+            queue.AppendRejection("rejected");
+    }
+    EXPECT_EQ(queue.PendingBytes(), 100u + 4 * 8u);
+    EXPECT_FALSE(queue.AppendRejection("rejected"));
+
+    queue.Complete(*slow, "0");
+    EXPECT_EQ(queue.TakeReady().size(), 5u);
+    EXPECT_TRUE(queue.AppendRejection("rejected"));
+}
+
+TEST(SendQueueTest, ParseConfig) {
+    const auto config = ParseConfig(R"({"send_queue": {"high_watermark_bytes": 2048, "max_in_flight": 2}})");
+    EXPECT_EQ(config.send_queue.high_watermark_bytes, 2048u);
+    EXPECT_EQ(config.send_queue.max_in_flight, 2u);
+
+    EXPECT_THROW(ParseConfig(R"({"send_queue": {"high_watermark_bytes": 10, "low_watermark_bytes": 20}})"),
+                 std::exception);
+    EXPECT_THROW(ParseConfig(R"({"send_queue": {"max_queued_rejections": 0}})"), std::exception);
+}
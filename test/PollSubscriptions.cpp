@@ -0,0 +1,262 @@
+#include "Config.h"
+#include "Requests.h"
+#include "SubscriptionHub.h"
+
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// Upstream whose body is set by the test
+class FakeUpstream {
+public:
+    void SetBody(std::string body) {
+        auto lock = std::lock_guard(guard_);
+        body_ = std::move(body);
+    }
+
+    SubscriptionHub::Fetch Fetch() {
+        return [this](const Request&) {
+            ++fetches_;
+            auto lock = std::lock_guard(guard_);
+            return Response{200, body_};
+        };
+    }
+
+    int Fetches() const {
+        return fetches_;
+    }
+
+private:
+    std::mutex guard_;
+    std::string body_ = R"({"price":1})";
+    std::atomic<int> fetches_{0};
+};
+
+// Frames pushed to one client
+class FakeClient {
+public:
+    uint64_t Id() const {
+        return id_;
+    }
+
+    SubscriptionHub::Push Push() {
+        return [this](const std::string& frame) {
+            auto lock = std::lock_guard(guard_);
+            if (gone_)
+                return PushResult::Gone;
+            if (!accepting_)
+                return PushResult::Busy;
+            frames_.push_back(nlohmann::json::parse(frame));
+            return PushResult::Sent;
+        };
+    }
+
+    void SetAccepting(bool accepting) {
+        auto lock = std::lock_guard(guard_);
+        accepting_ = accepting;
+    }
+
+    void SetGone() {
+        auto lock = std::lock_guard(guard_);
+        gone_ = true;
+    }
+
+    std::vector<nlohmann::json> Frames() {
+        auto lock = std::lock_guard(guard_);
+        return frames_;
+    }
+
+private:
+    static inline std::atomic<uint64_t> next_id_{0};
+
+    uint64_t id_ = ++next_id_;
+    std::mutex guard_;
+    bool accepting_ = true;
+    bool gone_ = false;
+    std::vector<nlohmann::json> frames_;
+};
+
+SubscriptionConfig TestSubscriptionConfig() {
+    SubscriptionConfig config;
+    config.min_interval = 1ms;
+    config.max_per_client = 2;
+    return config;
+}
+
+// Polls run on the scheduler thread
+SubscriptionHub::Post InlinePost() {
+    return [](std::function<void()> poll) { poll(); };
+}
+
+Request PolledRequest(const std::string& headers = "") {
+    return MakeRequest(R"({"url": "http://prices.example.com", "path": "/latest", "method": "GET", "headers": {)" +
+                       headers + "}}");
+}
+
+template <typename Predicate>
+bool WaitFor(Predicate predicate) {
+    for (int i = 0; i < 1000 && !predicate(); ++i)
+        std::this_thread::sleep_for(2ms);
+    return predicate();
+}
+
+}  // namespace
+
+TEST(SubscriptionTest, MakeMessage) {
+    const auto subscribe = MakeMessage(R"({"type": "subscribe", "subscription": "prices",
+        "url": "http://prices.example.com", "path": "/latest", "interval_ms": 1000, "delta": true})");
+    const auto* command = std::get_if<SubscribeCommand>(&subscribe);
+    ASSERT_TRUE(command);
+    EXPECT_EQ(command->id, "prices");
+    EXPECT_EQ(command->request.GetMethod(), Method::METHOD_GET);
+    EXPECT_EQ(command->request.Path(), "/latest");
+    EXPECT_EQ(command->interval, 1000ms);
+    EXPECT_TRUE(command->delta);
+
+    const auto unsubscribe = MakeMessage(R"({"type": "unsubscribe", "subscription": "prices"})");
+    ASSERT_TRUE(std::get_if<UnsubscribeCommand>(&unsubscribe));
+    EXPECT_EQ(std::get<UnsubscribeCommand>(unsubscribe).id, "prices");
+
+    const auto request = MakeMessage(R"({"url": "http://a.example.com", "method": "POST"})");
+    EXPECT_TRUE(std::get_if<Request>(&request));
+    EXPECT_THROW(MakeMessage(R"({"type": "subscribe", "subscription": "s", "url": "http://a.example.com",
+        "method": "POST", "interval_ms": 1000})"), std::exception);
+    EXPECT_THROW(MakeMessage(R"({"type": "publish"})"), std::exception);
+}
+
+TEST(SubscriptionTest, SharedPollPushesChanges) {
+    FakeUpstream upstream;
+    FakeClient first;
+    FakeClient second;
+    SubscriptionHub hub(TestSubscriptionConfig(), InlinePost());
+
+    hub.Subscribe(first.Id(), "a", PolledRequest(R"("Accept": "application/json", "X-Feed": "1")"), 5ms, false,
+                  upstream.Fetch(), first.Push());
+    ASSERT_TRUE(WaitFor([&first] { return first.Frames().size() == 1; }));
+    // Same request with headers in other order and case
+    hub.Subscribe(second.Id(), "b", PolledRequest(R"("x-feed": "1", "accept": "application/json")"), 5ms, false,
+                  upstream.Fetch(), second.Push());
+    EXPECT_EQ(hub.Polls(), 1u);
+    EXPECT_EQ(hub.Subscribers(), 2u);
+    ASSERT_EQ(second.Frames().size(), 1u);  // Last response, at once
+    EXPECT_EQ(second.Frames()[0]["subscription"], "b");
+    EXPECT_EQ(second.Frames()[0]["body"], R"({"price":1})");
+
+    // Unchanged responses aren't pushed
+    const auto fetches = upstream.Fetches();
+    ASSERT_TRUE(WaitFor([&] { return upstream.Fetches() > fetches + 3; }));
+    EXPECT_EQ(first.Frames().size(), 1u);
+
+    upstream.SetBody(R"({"price":2})");
+    ASSERT_TRUE(WaitFor([&] { return first.Frames().size() == 2 && second.Frames().size() == 2; }));
+    EXPECT_EQ(first.Frames()[1]["body"], R"({"price":2})");
+    EXPECT_EQ(first.Frames()[1]["status"], 200);
+    EXPECT_EQ(hub.Pushes(), 4u);
+}
+
+TEST(SubscriptionTest, DeltaPush) {
+    FakeUpstream upstream;
+    upstream.SetBody(R"({"items":[{"id":1,"price":10},{"id":2,"price":20}],"padding":"......................"})");
+    FakeClient client;
+    SubscriptionHub hub(TestSubscriptionConfig(), InlinePost());
+    hub.Subscribe(client.Id(), "d", PolledRequest(), 5ms, true, upstream.Fetch(), client.Push());
+    ASSERT_TRUE(WaitFor([&client] { return client.Frames().size() == 1; }));
+    EXPECT_TRUE(client.Frames()[0].contains("body"));  // Nothing to diff against yet
+
+    upstream.SetBody(R"({"items":[{"id":1,"price":11},{"id":2,"price":20}],"padding":"......................"})");
+    ASSERT_TRUE(WaitFor([&client] { return client.Frames().size() == 2; }));
+    const auto patch = client.Frames()[1];
+    EXPECT_FALSE(patch.contains("body"));
+    EXPECT_EQ(patch["subscription"], "d");
+    EXPECT_EQ(patch["patch"], nlohmann::json::parse(R"([{"op":"replace","path":"/items/0/price","value":11}])"));
+
+    // Missed update can't be patched, full body follows. A fetch started after the body is set reads it, and polls
+    // don't overlap, so once two have started every push of the body before is over
+    client.SetAccepting(false);
+    upstream.SetBody(R"({"items":[],"padding":"......................"})");
+    auto fetches = upstream.Fetches();
+    ASSERT_TRUE(WaitFor([&] { return upstream.Fetches() > fetches + 1; }));
+    upstream.SetBody(R"({"items":[{"id":3,"price":30}],"padding":"......................"})");
+    fetches = upstream.Fetches();
+    ASSERT_TRUE(WaitFor([&] { return upstream.Fetches() > fetches + 1; }));
+    client.SetAccepting(true);
+    ASSERT_TRUE(WaitFor([&client] { return client.Frames().size() == 3; }));
+    EXPECT_EQ(client.Frames()[2]["body"], R"({"items":[{"id":3,"price":30}],"padding":"......................"})");
+}
+
+TEST(SubscriptionTest, GoneClientIsDropped) {
+    FakeUpstream upstream;
+    FakeClient client;
+    SubscriptionHub hub(TestSubscriptionConfig(), InlinePost());
+    hub.Subscribe(client.Id(), "a", PolledRequest(), 5ms, false, upstream.Fetch(), client.Push());
+    ASSERT_TRUE(WaitFor([&client] { return client.Frames().size() == 1; }));
+
+    // Subscription made after its client was closed goes with the next push
+    client.SetGone();
+    upstream.SetBody(R"({"price":2})");
+    EXPECT_TRUE(WaitFor([&hub] { return hub.Subscribers() == 0; }));
+    EXPECT_EQ(hub.Polls(), 0u);
+}
+
+TEST(SubscriptionTest, PushesOutsideLock) {
+    FakeUpstream upstream;
+    FakeClient client;
+    SubscriptionHub hub(TestSubscriptionConfig(), InlinePost());
+    // Client that unsubscribes from its push, as a closing one may, would deadlock under the hub's lock
+    std::atomic<int> pushes{0};
+    const auto push = client.Push();
+    hub.Subscribe(client.Id(), "a", PolledRequest(), 5ms, false, upstream.Fetch(),
+                  [&hub, &client, &pushes, push](const std::string& frame) {
+                      ++pushes;
+                      hub.Unsubscribe(client.Id(), "a");
+                      return push(frame);
+                  });
+    ASSERT_TRUE(WaitFor([&hub] { return hub.Subscribers() == 0; }));
+    EXPECT_EQ(pushes, 1);
+    EXPECT_EQ(client.Frames().size(), 1u);
+    EXPECT_EQ(hub.Polls(), 0u);
+}
+
+TEST(SubscriptionTest, Unsubscribe) {
+    FakeUpstream upstream;
+    FakeClient client;
+    SubscriptionHub hub(TestSubscriptionConfig(), InlinePost());
+    hub.Subscribe(client.Id(), "a", PolledRequest(), 5ms, false, upstream.Fetch(), client.Push());
+    hub.Subscribe(client.Id(), "b", PolledRequest(), 10ms, false, upstream.Fetch(), client.Push());
+    EXPECT_EQ(hub.Polls(), 2u);  // Interval is part of the poll
+    EXPECT_THROW(hub.Subscribe(client.Id(), "c", PolledRequest(), 5ms, false, upstream.Fetch(), client.Push()),
+                 std::exception);
+    // Same id replaces the subscription
+    hub.Subscribe(client.Id(), "b", PolledRequest(), 5ms, false, upstream.Fetch(), client.Push());
+    EXPECT_EQ(hub.Polls(), 1u);
+
+    EXPECT_TRUE(hub.Unsubscribe(client.Id(), "a"));
+    EXPECT_FALSE(hub.Unsubscribe(client.Id(), "a"));
+    EXPECT_EQ(hub.Subscribers(), 1u);
+    hub.UnsubscribeAll(client.Id());
+    EXPECT_EQ(hub.Subscribers(), 0u);
+    EXPECT_EQ(hub.Polls(), 0u);
+
+    const auto fetches = upstream.Fetches();
+    std::this_thread::sleep_for(30ms);
+    EXPECT_EQ(upstream.Fetches(), fetches);
+
+    EXPECT_THROW(hub.Subscribe(client.Id(), "fast", PolledRequest(), 0ms, false, upstream.Fetch(), client.Push()),
+                 std::exception);
+}
+
+TEST(SubscriptionTest, ParseConfig) {
+    const auto config =
+        ParseConfig(R"({"subscriptions": {"min_interval_ms": 500, "max_per_client": 8, "max_polls": 100}})");
+    EXPECT_EQ(config.subscriptions.min_interval, 500ms);
+    EXPECT_EQ(config.subscriptions.max_per_client, 8u);
+    EXPECT_EQ(config.subscriptions.max_polls, 100u);
+    EXPECT_THROW(ParseConfig(R"({"subscriptions": {"min_interval_ms": 0}})"), std::exception);
+}
@@ -0,0 +1,153 @@
+#include "Config.h"
+#include "ConnectionPool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+constexpr char kOriginUrl[] = "http://backend.example.com:8080";
+constexpr char kOriginKey[] = "http://backend.example.com:8080";
+constexpr char kAddress[] = "10.0.0.1";
+
+PoolConfig TestPoolConfig() {
+    PoolConfig config;
+    config.warm_connections = 2;
+    config.min_idle = 1;
+    config.max_idle = 3;
+    config.idle_timeout = std::chrono::milliseconds(1000);
+    config.refill_interval = std::chrono::milliseconds(5);
+    return config;
+}
+
+// Connects without network, counting connections
+ConnectionPool::Connector CountingConnector(std::atomic<int>& connects) {
+    return [&connects](const std::string& url) -> std::optional<ConnectionPool::Connection> {
+        ++connects;
+        return ConnectionPool::Connection{kAddress, std::make_unique<HttpClient>(url, kAddress)};
+    };
+}
+
+template <typename Predicate>
+bool WaitFor(Predicate predicate) {
+    for (int i = 0; i < 1000 && !predicate(); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    return predicate();
+}
+
+}  // namespace
+
+TEST(ConnectionPoolTest, WarmUpKnownOrigins) {
+    std::atomic<int> connects{0};
+    // Same origin listed twice is warmed once
+    ConnectionPool pool(TestPoolConfig(), {kOriginUrl, "http://BACKEND.example.com:8080"},
+                        CountingConnector(connects));
+
+    ASSERT_TRUE(WaitFor([&pool] { return pool.IsWarm(); }));
+    EXPECT_EQ(pool.Idle(kOriginKey), 2u);
+    EXPECT_EQ(connects, 2);
+}
+
+TEST(ConnectionPoolTest, NotWarmWhileOriginRefuses) {
+    std::atomic<int> connects{0};
+    std::atomic<int> refused{0};
+    std::atomic<bool> refusing{true};
+    auto connector = CountingConnector(connects);
+    ConnectionPool pool(TestPoolConfig(), {kOriginUrl, "http://other.example.com"},
+                        [&](const std::string& url) -> std::optional<ConnectionPool::Connection> {
+                            if (refusing && url == kOriginUrl) {
+                                ++refused;
+                                return {};
+                            }
+                            return connector(url);
+                        });
+
+    // Tried again in background, the other origin being warm isn't enough
+    ASSERT_TRUE(WaitFor([&refused] { return refused > 2; }));
+    EXPECT_EQ(pool.Idle("http://other.example.com:80"), 2u);
+    EXPECT_FALSE(pool.IsWarm());
+    EXPECT_EQ(pool.Idle(kOriginKey), 0u);
+
+    refusing = false;
+    EXPECT_TRUE(WaitFor([&pool] { return pool.IsWarm(); }));
+    EXPECT_GE(pool.Idle(kOriginKey), 1u);
+}
+
+TEST(ConnectionPoolTest, RefillToMinIdle) {
+    auto config = TestPoolConfig();
+    config.min_idle = 2;
+    std::atomic<int> connects{0};
+    ConnectionPool pool(config, {kOriginUrl}, CountingConnector(connects));
+    ASSERT_TRUE(WaitFor([&pool] { return pool.IsWarm(); }));
+
+    EXPECT_TRUE(pool.Acquire(kOriginKey, kAddress));
+    EXPECT_TRUE(pool.Acquire(kOriginKey, kAddress));
+    EXPECT_TRUE(WaitFor([&pool] { return pool.Idle(kOriginKey) == 2; }));
+}
+
+TEST(ConnectionPoolTest, AcquireRelease) {
+    auto config = TestPoolConfig();
+    config.max_idle = 2;
+    std::atomic<int> connects{0};
+    ConnectionPool pool(config, {}, CountingConnector(connects));
+
+    const std::string origin = "https://other.example.com:443";
+    EXPECT_FALSE(pool.Acquire(origin, kAddress));
+
+    auto client = std::make_unique<HttpClient>("https://other.example.com", kAddress);
+    const auto* raw = client.get();
+    EXPECT_TRUE(pool.Release(origin, {kAddress, std::move(client)}));
+    EXPECT_EQ(pool.Idle(origin), 1u);
+    EXPECT_EQ(pool.Acquire(origin, kAddress).get(), raw);
+    EXPECT_EQ(pool.Idle(origin), 0u);
+
+    for (int i = 0; i < 3; ++i)
+        pool.Release(origin, {kAddress, std::make_unique<HttpClient>("https://other.example.com", kAddress)});
+    EXPECT_EQ(pool.Idle(origin), 2u);  // Capped at max_idle
+    EXPECT_EQ(connects, 0);
+}
+
+TEST(ConnectionPoolTest, AddressChanged) {
+    std::atomic<int> connects{0};
+    ConnectionPool pool(TestPoolConfig(), {}, CountingConnector(connects));
+
+    const std::string origin = "https://other.example.com:443";
+    pool.Release(origin, {kAddress, std::make_unique<HttpClient>("https://other.example.com", kAddress)});
+    EXPECT_FALSE(pool.Acquire(origin, "10.0.0.2"));
+    EXPECT_EQ(pool.Idle(origin), 0u);  // Stale connection is closed
+}
+
+TEST(ConnectionPoolTest, IdleTimeout) {
+    auto config = TestPoolConfig();
+    config.refill_interval = std::chrono::hours(1);  // So the clock is only read from this thread
+    auto now = ConnectionPool::Clock::now();
+    std::atomic<int> connects{0};
+    ConnectionPool pool(config, {}, CountingConnector(connects), [&now] { return now; });
+
+    const std::string origin = "https://other.example.com:443";
+    pool.Release(origin, {kAddress, std::make_unique<HttpClient>("https://other.example.com", kAddress)});
+    now += std::chrono::milliseconds(500);
+    pool.Release(origin, {kAddress, std::make_unique<HttpClient>("https://other.example.com", kAddress)});
+    now += std::chrono::milliseconds(600);
+
+    // Newer one is reused, older one timed out
+    EXPECT_TRUE(pool.Acquire(origin, kAddress));
+    EXPECT_FALSE(pool.Acquire(origin, kAddress));
+}
+
+TEST(ConnectionPoolTest, ParseConfig) {
+    const auto config = ParseConfig(
+        R"({"pool": {"origins": ["https://api.example.com"], "warm_connections": 4, "max_idle": 16,
+                     "idle_timeout_ms": 5000, "warm_path": "/health"}})");
+    EXPECT_EQ(config.pool.origins, std::vector<std::string>{"https://api.example.com"});
+    EXPECT_EQ(config.pool.warm_connections, 4u);
+    EXPECT_EQ(config.pool.min_idle, 1u);
+    EXPECT_EQ(config.pool.max_idle, 16u);
+    EXPECT_EQ(config.pool.idle_timeout, std::chrono::milliseconds(5000));
+    EXPECT_EQ(config.pool.warm_path, "/health");
+
+    EXPECT_THROW(ParseConfig(R"({"pool": {"warm_connections": 10, "max_idle": 4}})"), std::exception);
+}
@@ -37,10 +37,10 @@ TEST_P(GetRequestTestFixture, GetRequest) {
     
     const auto request = MakeRequest(GetParam().json);
     const auto expected = GetParam().expected;
-    EXPECT_EQ(request->Url(), expected.url);
-    EXPECT_EQ(request->Path(), expected.path);
-    EXPECT_EQ(request->Headers(), expected.headers);
-    EXPECT_NE(dynamic_cast<GetRequest*>(request.get()), nullptr);
+    EXPECT_EQ(request.Url(), expected.url);
+    EXPECT_EQ(request.Path(), expected.path);
+    EXPECT_EQ(request.Headers(), expected.headers);
+    EXPECT_NE(request.As<GetRequest>(), nullptr);
 }
 
 INSTANTIATE_TEST_CASE_P(GetRequestTest, GetRequestTestFixture, ::testing::ValuesIn(kGetRequestTestParams));
@@ -72,10 +72,10 @@ TEST_P(HeadRequestTestFixture, HeadRequest) {
 
     const auto request = MakeRequest(GetParam().json);
     const auto expected = GetParam().expected;
-    EXPECT_EQ(request->Url(), expected.url);
-    EXPECT_EQ(request->Path(), expected.path);
-    EXPECT_EQ(request->Headers(), expected.headers);
-    EXPECT_NE(dynamic_cast<HeadRequest*>(request.get()), nullptr);
+    EXPECT_EQ(request.Url(), expected.url);
+    EXPECT_EQ(request.Path(), expected.path);
+    EXPECT_EQ(request.Headers(), expected.headers);
+    EXPECT_NE(request.As<HeadRequest>(), nullptr);
 }
 
 INSTANTIATE_TEST_CASE_P(HeadRequestTest, HeadRequestTestFixture, ::testing::ValuesIn(kHeadRequestTestParams));
@@ -145,10 +145,10 @@ TEST_P(PostRequestTestFixture, PostRequest) {
 
     const auto request = MakeRequest(GetParam().json);
     const auto expected = GetParam().expected;
-    EXPECT_EQ(request->Url(), expected.url);
-    EXPECT_EQ(request->Path(), expected.path);
-    EXPECT_EQ(request->Headers(), expected.headers);
-    const auto post_request = dynamic_cast<PostRequest*>(request.get());
+    EXPECT_EQ(request.Url(), expected.url);
+    EXPECT_EQ(request.Path(), expected.path);
+    EXPECT_EQ(request.Headers(), expected.headers);
+    const auto post_request = request.As<PostRequest>();
     ASSERT_NE(post_request, nullptr);
     EXPECT_EQ(post_request->Body(), expected.body);
     EXPECT_EQ(post_request->ContentType(), expected.content_type);
@@ -208,10 +208,10 @@ class PutRequestTestFixture :public ::testing::TestWithParam<PutRequestTestParam
 TEST_P(PutRequestTestFixture, PutRequest) {
     const auto request = MakeRequest(GetParam().json);
     const auto expected = GetParam().expected;
-    EXPECT_EQ(request->Url(), expected.url);
-    EXPECT_EQ(request->Path(), expected.path);
-    EXPECT_EQ(request->Headers(), expected.headers);
-    auto put_request = dynamic_cast<PutRequest*>(request.get());
+    EXPECT_EQ(request.Url(), expected.url);
+    EXPECT_EQ(request.Path(), expected.path);
+    EXPECT_EQ(request.Headers(), expected.headers);
+    auto put_request = request.As<PutRequest>();
     ASSERT_NE(put_request, nullptr);
     EXPECT_EQ(put_request->Body(), expected.body);
     EXPECT_EQ(put_request->ContentType(), expected.content_type);
@@ -276,10 +276,10 @@ TEST_P(DeleteRequestTestFixture, DeleteRequest) {
 
     const auto request = MakeRequest(GetParam().json);
     const auto expected = GetParam().expected;
-    EXPECT_EQ(request->Url(), expected.url);
-    EXPECT_EQ(request->Path(), expected.path);
-    EXPECT_EQ(request->Headers(), expected.headers);
-    const auto delete_request = dynamic_cast<DeleteRequest*>(request.get());
+    EXPECT_EQ(request.Url(), expected.url);
+    EXPECT_EQ(request.Path(), expected.path);
+    EXPECT_EQ(request.Headers(), expected.headers);
+    const auto delete_request = request.As<DeleteRequest>();
     ASSERT_NE(delete_request, nullptr);
     EXPECT_EQ(delete_request->Body(), expected.body);
     EXPECT_EQ(delete_request->ContentType(), expected.content_type);
@@ -313,10 +313,10 @@ TEST_P(OptionsRequestTestFixture, OptionsRequest) {
 
     const auto request = MakeRequest(GetParam().json);
     const auto expected = GetParam().expected;
-    EXPECT_EQ(request->Url(), expected.url);
-    EXPECT_EQ(request->Path(), expected.path);
-    EXPECT_EQ(request->Headers(), expected.headers);
-    EXPECT_NE(dynamic_cast<OptionsRequest*>(request.get()), nullptr);
+    EXPECT_EQ(request.Url(), expected.url);
+    EXPECT_EQ(request.Path(), expected.path);
+    EXPECT_EQ(request.Headers(), expected.headers);
+    EXPECT_NE(request.As<OptionsRequest>(), nullptr);
 }
 
 INSTANTIATE_TEST_CASE_P(OptionsRequestTest, OptionsRequestTestFixture, ::testing::ValuesIn(kOptionsRequestTestParams));
@@ -362,13 +362,66 @@ TEST_P(PatchRequestTestFixture, PatchRequest) {
 
     const auto request = MakeRequest(GetParam().json);
     const auto expected = GetParam().expected;
-    EXPECT_EQ(request->Url(), expected.url);
-    EXPECT_EQ(request->Path(), expected.path);
-    EXPECT_EQ(request->Headers(), expected.headers);
-    const auto patch_request = dynamic_cast<PatchRequest*>(request.get());
+    EXPECT_EQ(request.Url(), expected.url);
+    EXPECT_EQ(request.Path(), expected.path);
+    EXPECT_EQ(request.Headers(), expected.headers);
+    const auto patch_request = request.As<PatchRequest>();
     ASSERT_NE(patch_request, nullptr);
     EXPECT_EQ(patch_request->Body(), expected.body);
     EXPECT_EQ(patch_request->ContentType(), expected.content_type);
 }
 
 INSTANTIATE_TEST_CASE_P(PatchRequestTest, PatchRequestTestFixture, ::testing::ValuesIn(kPatchRequestTestParams));
+
+////////////////////////////////////////////////
+// Request
+
+TEST(RequestTest, MethodOfHeldRequest) {
+    EXPECT_EQ(MakeRequest(R"({"url": "http://a", "method": "GET"})").GetMethod(), Method::METHOD_GET);
+    EXPECT_EQ(MakeRequest(R"({"url": "http://a", "method": "DELETE"})").GetMethod(), Method::METHOD_DELETE);
+
+    const Request request = OptionsRequest("http://a", "/options", {});
+    EXPECT_EQ(request.GetMethod(), Method::METHOD_OPTIONS);
+    EXPECT_EQ(request.As<GetRequest>(), nullptr);
+    EXPECT_EQ(request.Visit([](const auto& r) { return r.Path(); }), "/options");
+}
+
+TEST(RequestTest, ParseMethod) {
+    EXPECT_EQ(ParseMethod("GET"), Method::METHOD_GET);
+    EXPECT_EQ(ParseMethod("pAtCh"), Method::METHOD_PATCH);
+    EXPECT_EQ(ParseMethod("POST"), Method::METHOD_POST);
+    EXPECT_EQ(ParseMethod("PUT"), Method::METHOD_PUT);
+    EXPECT_FALSE(ParseMethod(""));
+    EXPECT_FALSE(ParseMethod("PUSH"));
+    EXPECT_FALSE(ParseMethod("GETS"));
+    EXPECT_FALSE(ParseMethod(std::string_view("G\0T", 3)));
+    EXPECT_THROW(MethodFromString("CONNECT"), std::exception);
+}
+
+////////////////////////////////////////////////
+// HeaderList
+
+TEST(HeaderListTest, WellKnownNames) {
+    for (size_t id = 1; id < kHeaderNames.size(); ++id) {
+        EXPECT_EQ(LookupHeader(kHeaderNames[id]), static_cast<HeaderId>(id));
+        EXPECT_EQ(LookupHeader(ToUpper(std::string(kHeaderNames[id]))), static_cast<HeaderId>(id));
+    }
+    EXPECT_EQ(LookupHeader(""), HeaderId::Unknown);
+    EXPECT_EQ(LookupHeader("Content-Typo"), HeaderId::Unknown);
+}
+
+TEST(HeaderListTest, InlineAndOverflow) {
+    HeaderList headers;
+    for (size_t i = 0; i < HeaderList::kInlineHeaders + 3; ++i)
+        headers.Add("X-Header-" + std::to_string(i), std::to_string(i));
+    headers.Add("content-type", "text/plain");
+
+    ASSERT_EQ(headers.Size(), HeaderList::kInlineHeaders + 4);
+    EXPECT_EQ(headers[HeaderList::kInlineHeaders + 1].value, std::to_string(HeaderList::kInlineHeaders + 1));
+    ASSERT_NE(headers.Find(HeaderId::ContentType), nullptr);
+    EXPECT_EQ(headers.Find(HeaderId::ContentType)->name, "content-type");
+    ASSERT_NE(headers.Find("x-header-10"), nullptr);
+    EXPECT_EQ(headers.Find("x-header-10")->value, "10");
+    EXPECT_EQ(headers.Find(HeaderId::Cookie), nullptr);
+    EXPECT_EQ(headers.ToHttplib().size(), headers.Size());
+}
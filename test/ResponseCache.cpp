@@ -0,0 +1,291 @@
+#include "Config.h"
+#include "DiskCache.h"
+#include "Pipeline.h"
+#include "Requests.h"
+#include "ResponseWriter.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr char kKey[] = "http://backend.example.com/reference";
+
+// Cache file in a temporary directory, removed with it
+class DiskCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        const auto* test = ::testing::UnitTest::GetInstance()->current_test_info();
+        path_ = std::filesystem::temp_directory_path() / (std::string("websockproxy_cache_") + test->name());
+        std::filesystem::remove(path_);
+        config_.enabled = true;
+        config_.path = path_.string();
+        config_.max_bytes = 64 * 1024;
+        config_.max_entry_bytes = 16 * 1024;
+        config_.ttl = std::chrono::hours(1);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove(path_);
+        std::filesystem::remove(path_.string() + ".compact");
+    }
+
+    DiskCache MakeCache() {
+        return DiskCache(config_, [this] { return now_; });
+    }
+
+    std::filesystem::path path_;
+    DiskCacheConfig config_;
+    DiskCache::Clock::time_point now_ = DiskCache::Clock::now();
+};
+
+Response CacheableResponse(std::string body) {
+    Response response{200, std::move(body)};
+    response.headers.Add("Content-Type", "application/json");
+    return response;
+}
+
+}  // namespace
+
+TEST_F(DiskCacheTest, StoreAndLookup) {
+    auto cache = MakeCache();
+    EXPECT_FALSE(cache.Lookup(kKey));
+    ASSERT_TRUE(cache.Store(kKey, CacheableResponse(R"({"items":[1,2,3]})")));
+
+    const auto hit = cache.Lookup(kKey);
+    ASSERT_TRUE(hit);
+    EXPECT_EQ(hit->status, 200);
+    EXPECT_TRUE(hit->body.empty());  // Body is a view into the file
+    EXPECT_EQ(hit->Body(), R"({"items":[1,2,3]})");
+    ASSERT_TRUE(hit->headers.Find(HeaderId::ContentType));
+    EXPECT_EQ(hit->headers.Find(HeaderId::ContentType)->value, "application/json");
+    EXPECT_EQ(WriteResponseJson(*hit),
+              R"({"body":"{\"items\":[1,2,3]}","headers":{"Content-Type":"application/json"},"status":200})");
+
+    // Replaced entry is found, the old record waits for compaction
+    ASSERT_TRUE(cache.Store(kKey, CacheableResponse("v2")));
+    EXPECT_EQ(cache.Lookup(kKey)->Body(), "v2");
+    EXPECT_EQ(cache.Entries(), 1u);
+    EXPECT_EQ(hit->Body(), R"({"items":[1,2,3]})");  // Earlier hit is still valid
+}
+
+TEST_F(DiskCacheTest, CacheControl) {
+    auto cache = MakeCache();
+    EXPECT_FALSE(cache.Store(kKey, Response{404, "missing"}));
+
+    auto response = CacheableResponse("private");
+    response.headers.Add("Cache-Control", "max-age=60, Private");
+    EXPECT_FALSE(cache.Store(kKey, response));
+
+    response = CacheableResponse("no store");
+    response.headers.Add("Cache-Control", "no-store");
+    EXPECT_FALSE(cache.Store(kKey, response));
+
+    response = CacheableResponse("short");
+    response.headers.Add("Cache-Control", "public, max-age=600, s-maxage=60");
+    ASSERT_TRUE(cache.Store(kKey, response));
+    now_ += std::chrono::seconds(59);
+    EXPECT_TRUE(cache.Lookup(kKey));
+    now_ += std::chrono::seconds(2);
+    EXPECT_FALSE(cache.Lookup(kKey));  // s-maxage wins
+    EXPECT_EQ(cache.Entries(), 0u);
+
+    EXPECT_FALSE(cache.Store(kKey, CacheableResponse(std::string(config_.max_entry_bytes, 'x'))));
+}
+
+TEST_F(DiskCacheTest, PerClientResponses) {
+    auto cache = MakeCache();
+
+    auto response = CacheableResponse("session");
+    response.headers.Add("Set-Cookie", "sid=abc; Path=/");
+    EXPECT_FALSE(cache.Store(kKey, response));
+
+    for (const auto* vary : {"Accept", "accept-language", "X-Tenant", "*"}) {
+        response = CacheableResponse("varies");
+        response.headers.Add("Vary", vary);
+        EXPECT_FALSE(cache.Store(kKey, response)) << vary;
+    }
+    EXPECT_EQ(cache.Entries(), 0u);
+}
+
+TEST_F(DiskCacheTest, ReloadAfterRestart) {
+    {
+        auto cache = MakeCache();
+        ASSERT_TRUE(cache.Store(kKey, CacheableResponse("first")));
+        ASSERT_TRUE(cache.Store("http://backend.example.com/other", CacheableResponse("other")));
+        ASSERT_TRUE(cache.Store(kKey, CacheableResponse("second")));
+    }
+    // Record cut short by a crash is dropped
+    const auto size = std::filesystem::file_size(path_);
+    {
+        std::ofstream torn(path_, std::ios::binary | std::ios::app);
+        torn << std::string(60, '\x57');
+    }
+
+    {
+        auto cache = MakeCache();
+        EXPECT_EQ(cache.Entries(), 2u);
+        EXPECT_EQ(cache.FileBytes(), size);
+        EXPECT_EQ(cache.Lookup(kKey)->Body(), "second");
+        EXPECT_EQ(cache.Lookup("http://backend.example.com/other")->Body(), "other");
+    }
+    EXPECT_EQ(std::filesystem::file_size(path_), size);
+
+    // Expired while process was down
+    now_ += std::chrono::hours(2);
+    EXPECT_EQ(MakeCache().Entries(), 0u);
+}
+
+TEST_F(DiskCacheTest, CorruptBodySize) {
+    {
+        auto cache = MakeCache();
+        ASSERT_TRUE(cache.Store(kKey, CacheableResponse("body")));
+    }
+    // Body size that wraps the record size around to zero, so loading would never move past the record
+    {
+        std::fstream file(path_, std::ios::binary | std::ios::in | std::ios::out);
+        constexpr std::streamoff kRecordStart = 16;
+        uint32_t sizes[2] = {};
+        file.seekg(kRecordStart + 32);
+        file.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+        const uint64_t body_size = 0 - (40 + uint64_t{sizes[0]} + sizes[1]);
+        file.seekp(kRecordStart + 24);
+        file.write(reinterpret_cast<const char*>(&body_size), sizeof(body_size));
+    }
+
+    auto cache = MakeCache();
+    EXPECT_EQ(cache.Entries(), 0u);
+    EXPECT_FALSE(cache.Lookup(kKey));
+}
+
+TEST_F(DiskCacheTest, ForeignFileIsReplaced) {
+    {
+        std::ofstream foreign(path_, std::ios::binary);
+        foreign << "not a cache file at all";
+    }
+    auto cache = MakeCache();
+    EXPECT_EQ(cache.Entries(), 0u);
+    EXPECT_TRUE(cache.Store(kKey, CacheableResponse("body")));
+}
+
+TEST_F(DiskCacheTest, CompactKeepsNewest) {
+    auto cache = MakeCache();
+    const std::string body(10 * 1024, 'b');
+    std::optional<Response> oldest;
+    for (int i = 0; i < 20; ++i) {
+        const auto key = "http://backend.example.com/" + std::to_string(i);
+        ASSERT_TRUE(cache.Store(key, CacheableResponse(body + std::to_string(i))));
+        if (i == 0)
+            oldest = cache.Lookup(key);
+        EXPECT_LE(cache.FileBytes(), config_.max_bytes);
+    }
+
+    EXPECT_LT(cache.Entries(), 20u);
+    EXPECT_TRUE(cache.Lookup("http://backend.example.com/19"));
+    EXPECT_FALSE(cache.Lookup("http://backend.example.com/0"));
+    // Hit taken before compaction reads the replaced file
+    ASSERT_TRUE(oldest);
+    EXPECT_EQ(oldest->Body(), body + "0");
+
+    // Compacted file loads the same
+    const auto entries = cache.Entries();
+    EXPECT_EQ(MakeCache().Entries(), entries);
+}
+
+TEST_F(DiskCacheTest, GrowsInSteps) {
+    config_.max_bytes = 1024 * 1024;
+    {
+        auto cache = MakeCache();
+        const std::string body(1024, 'b');
+        for (int i = 0; i < 100; ++i)
+            ASSERT_TRUE(cache.Store("http://backend.example.com/" + std::to_string(i), CacheableResponse(body)));
+        // Grown ahead of the records, they're found through the same mapping
+        EXPECT_GT(std::filesystem::file_size(path_), cache.FileBytes());
+        EXPECT_EQ(cache.Lookup("http://backend.example.com/0")->Body(), body);
+        EXPECT_EQ(cache.Lookup("http://backend.example.com/99")->Body(), body);
+    }
+    auto cache = MakeCache();
+    EXPECT_EQ(cache.Entries(), 100u);
+}
+
+TEST_F(DiskCacheTest, ConcurrentStores) {
+    const auto key_of = [](int i) { return "http://backend.example.com/" + std::to_string(i); };
+    std::vector<std::string> bodies;
+    {
+        auto cache = MakeCache();
+        std::vector<std::thread> threads;
+        // Enough to compact while other records are being written
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&cache, &key_of, t] {
+                for (int i = 0; i < 50; ++i) {
+                    cache.Store(key_of(i % 10), CacheableResponse(std::string(512, static_cast<char>('a' + t))));
+                    const auto hit = cache.Lookup(key_of(i % 10));
+                    EXPECT_TRUE(!hit || hit->Body().size() == 512u);
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        for (int i = 0; i < 10; ++i) {
+            const auto hit = cache.Lookup(key_of(i));
+            ASSERT_TRUE(hit);
+            bodies.emplace_back(hit->Body());
+        }
+    }
+
+    // Record of a key found in memory is the one found after a restart
+    auto cache = MakeCache();
+    for (int i = 0; i < 10; ++i)
+        EXPECT_EQ(cache.Lookup(key_of(i))->Body(), bodies[i]);
+}
+
+TEST_F(DiskCacheTest, KeyOf) {
+    config_.match = {"http://backend.example.com/ref"};
+    auto cache = MakeCache();
+    const auto make = [](const std::string& method, const std::string& headers) {
+        return MakeRequest(R"({"url": "http://backend.example.com", "path": "/reference", "method": ")" + method +
+                           R"(", "headers": {)" + headers + "}}");
+    };
+    EXPECT_EQ(cache.KeyOf(make("GET", "")), kKey);
+    EXPECT_FALSE(cache.KeyOf(make("HEAD", "")));
+    EXPECT_FALSE(cache.KeyOf(make("GET", R"("Authorization": "Bearer x")")));
+    EXPECT_FALSE(
+        cache.KeyOf(MakeRequest(R"({"url": "http://backend.example.com", "path": "/live", "method": "GET"})")));
+}
+
+TEST_F(DiskCacheTest, StagesOnSharedBody) {
+    auto cache = MakeCache();
+    ASSERT_TRUE(cache.Store(kKey, CacheableResponse(R"({"id":1,"name":"élément"})")));
+
+    auto truncated = *cache.Lookup(kKey);
+    const Pipeline truncate(ParseConfig(R"({"routes": [{"post": [{"type": "truncate_body", "max_bytes": 8}]}]})")
+                                .routes.at(0));
+    truncate.After(truncated);
+    EXPECT_EQ(truncated.Body(), R"({"id":1,)");
+    EXPECT_TRUE(truncated.shared_body.owner);  // Cut without a copy
+
+    auto projected = *cache.Lookup(kKey);
+    const Pipeline project(
+        ParseConfig(R"({"routes": [{"post": [{"type": "project", "fields": ["id"]}]}]})").routes.at(0));
+    project.After(projected);
+    EXPECT_EQ(projected.Body(), R"({"id":1})");
+    EXPECT_FALSE(projected.shared_body.owner);
+}
+
+TEST(DiskCacheConfigTest, ParseConfig) {
+    const auto config = ParseConfig(R"({"disk_cache": {"enabled": true, "path": "/var/cache/proxy.cache",
+        "max_bytes": 1000000, "max_entry_bytes": 100000, "ttl_ms": 60000, "match": ["https://ref.example.com"]}})");
+    EXPECT_TRUE(config.disk_cache.enabled);
+    EXPECT_EQ(config.disk_cache.path, "/var/cache/proxy.cache");
+    EXPECT_EQ(config.disk_cache.max_bytes, 1000000u);
+    EXPECT_EQ(config.disk_cache.max_entry_bytes, 100000u);
+    EXPECT_EQ(config.disk_cache.ttl, std::chrono::milliseconds(60000));
+    EXPECT_EQ(config.disk_cache.match, std::vector<std::string>{"https://ref.example.com"});
+
+    EXPECT_THROW(ParseConfig(R"({"disk_cache": {"max_bytes": 1000, "max_entry_bytes": 600}})"), std::exception);
+}
@@ -0,0 +1,171 @@
+#include "Config.h"
+#include "LatencyHistogram.h"
+#include "Retry.h"
+
+#include <httplib.h>
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+////////////////////////////////////////////////
+// Retry conditions
+
+TEST(RetryTest, RetryableStatus) {
+    EXPECT_TRUE(IsRetryableStatus(static_cast<int>(httplib::Error::Connection)));
+    EXPECT_TRUE(IsRetryableStatus(static_cast<int>(httplib::Error::ConnectionTimeout)));
+    EXPECT_TRUE(IsRetryableStatus(static_cast<int>(httplib::Error::Read)));
+    EXPECT_FALSE(IsRetryableStatus(static_cast<int>(httplib::Error::Write)));
+    EXPECT_FALSE(IsRetryableStatus(200));
+    EXPECT_FALSE(IsRetryableStatus(503));
+}
+
+TEST(RetryTest, BackoffIsBounded) {
+    const auto base = std::chrono::milliseconds(10);
+    const auto max = std::chrono::milliseconds(100);
+    for (int attempt = 0; attempt < 40; ++attempt) {
+        const auto delay = BackoffDelay(attempt, base, max);
+        EXPECT_GE(delay.count(), 0);
+        EXPECT_LE(delay, std::min(max, std::chrono::milliseconds(base.count() << std::min(attempt, 30))));
+    }
+}
+
+TEST(RetryTest, ParseRetryConfig) {
+    const auto config = ParseConfig(R"({
+        "retry": {
+            "max_attempts": 3,
+            "methods": ["get", "PUT"],
+            "hedging": {"enabled": true, "percentile": 99, "max_concurrent": 4}
+        }
+    })");
+    EXPECT_EQ(config.retry.max_attempts, 3);
+    EXPECT_EQ(config.retry.methods, (std::vector<Method>{Method::METHOD_GET, Method::METHOD_PUT}));
+    EXPECT_TRUE(config.retry.hedging.enabled);
+    EXPECT_EQ(config.retry.hedging.percentile, 99.0);
+    EXPECT_EQ(config.retry.hedging.max_concurrent, 4u);
+
+    // Retries are opt-in
+    EXPECT_EQ(ParseConfig("{}").retry.max_attempts, 1);
+
+    EXPECT_THROW(ParseConfig(R"({"retry": {"max_attempts": 0}})"), std::exception);
+    EXPECT_THROW(ParseConfig(R"({"retry": {"hedging": {"percentile": 120}}})"), std::exception);
+    EXPECT_THROW(ParseConfig(R"({"retry": {"hedging": {"enabled": true, "max_concurrent": 0}}})"), std::exception);
+}
+
+////////////////////////////////////////////////
+// RetryBudget
+
+TEST(RetryBudgetTest, MinPerSecond) {
+    RetryConfig config;
+    config.budget_ratio = 0.0;
+    config.budget_min_per_second = 2;
+    auto now = RetryBudget::Clock::time_point{} + std::chrono::hours(1);
+    RetryBudget budget(config, [&now] { return now; });
+
+    EXPECT_TRUE(budget.TryWithdraw());
+    EXPECT_TRUE(budget.TryWithdraw());
+    EXPECT_FALSE(budget.TryWithdraw());
+
+    now += std::chrono::seconds(1);
+    EXPECT_TRUE(budget.TryWithdraw());
+}
+
+TEST(RetryBudgetTest, RatioOfRequests) {
+    RetryConfig config;
+    config.budget_ratio = 0.2;
+    config.budget_min_per_second = 0;
+    RetryBudget budget(config);
+
+    EXPECT_FALSE(budget.TryWithdraw());
+    for (int i = 0; i < 10; ++i)
+        budget.Deposit();
+    EXPECT_TRUE(budget.TryWithdraw());
+    EXPECT_TRUE(budget.TryWithdraw());
+    EXPECT_FALSE(budget.TryWithdraw());
+}
+
+////////////////////////////////////////////////
+// HedgeExecutor
+
+TEST(HedgeExecutorTest, RefusedWhenBusy) {
+    HedgeExecutor executor(2);
+    std::mutex guard;
+    std::condition_variable cv;
+    bool release = false;
+    int started = 0;
+    const auto blocking = [&] {
+        auto lock = std::unique_lock(guard);
+        ++started;
+        cv.notify_all();
+        cv.wait(lock, [&release] { return release; });
+    };
+
+    EXPECT_TRUE(executor.TryPost(blocking));
+    EXPECT_TRUE(executor.TryPost(blocking));
+    EXPECT_FALSE(executor.TryPost(blocking));
+    {
+        auto lock = std::unique_lock(guard);
+        cv.wait(lock, [&started] { return started == 2; });
+        release = true;
+    }
+    cv.notify_all();
+
+    // Thread is free again once its task is done
+    bool posted = false;
+    for (int i = 0; i < 200 && !posted; ++i) {
+        posted = executor.TryPost([] {});
+        if (!posted)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_TRUE(posted);
+
+    HedgeExecutor none(0);
+    EXPECT_FALSE(none.TryPost([] {}));
+}
+
+////////////////////////////////////////////////
+// LatencyHistogram
+
+TEST(LatencyHistogramTest, Percentiles) {
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.Percentile(95).count(), 0);
+
+    for (int i = 0; i < 95; ++i)
+        histogram.Record(std::chrono::milliseconds(1));
+    for (int i = 0; i < 5; ++i)
+        histogram.Record(std::chrono::milliseconds(100));
+
+    // Bucket bounds are within a quarter octave of the sample
+    EXPECT_GE(histogram.Percentile(50), std::chrono::milliseconds(1));
+    EXPECT_LE(histogram.Percentile(50), std::chrono::microseconds(1190));
+    EXPECT_LE(histogram.Percentile(95), std::chrono::microseconds(1190));
+    EXPECT_GE(histogram.Percentile(99), std::chrono::milliseconds(100));
+    EXPECT_LE(histogram.Percentile(99), std::chrono::microseconds(119000));
+}
+
+TEST(LatencyHistogramTest, Decay) {
+    LatencyHistogram histogram(100);
+    for (int i = 0; i < 99; ++i)
+        histogram.Record(std::chrono::milliseconds(1));
+    EXPECT_EQ(histogram.Count(), 99u);
+    histogram.Record(std::chrono::milliseconds(1));
+    EXPECT_EQ(histogram.Count(), 50u);
+}
+
+TEST(LatencyTrackerTest, EvictsLeastRecentlyUsed) {
+    LatencyTracker tracker(2);
+    const auto a = tracker.Get("http://a:80");
+    a->Record(std::chrono::milliseconds(1));
+    tracker.Get("http://b:80");
+    EXPECT_EQ(tracker.Get("http://a:80"), a);
+
+    // b is least recently used now
+    tracker.Get("http://c:80");
+    EXPECT_EQ(tracker.Size(), 2u);
+    EXPECT_EQ(tracker.Get("http://a:80"), a);
+    EXPECT_EQ(tracker.Get("http://a:80")->Count(), 1u);
+    EXPECT_EQ(tracker.Get("http://b:80")->Count(), 0u);
+    EXPECT_EQ(tracker.Size(), 2u);
+}
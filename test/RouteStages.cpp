@@ -0,0 +1,224 @@
+#include "Config.h"
+#include "Pipeline.h"
+#include "Requests.h"
+#include "ResponseWriter.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+RouteConfig ParseSingleRoute(const std::string& json) {
+    auto config = ParseConfig(R"({"routes": [)" + json + "]}");
+    return std::move(config.routes.at(0));
+}
+
+Response BodyResponse(std::string body) {
+    return Response{200, std::move(body)};
+}
+
+}  // namespace
+
+TEST(PipelineTest, RequestStages) {
+    const Pipeline pipeline(ParseSingleRoute(R"({"pre": [
+        {"type": "set_headers", "headers": {"X-Api": "v2", "accept": "application/json"}},
+        {"type": "auth_token", "token": "secret"},
+        {"type": "rewrite_url", "from": "http://old.example.com", "to": "http://new.example.com",
+         "path_from": "/v1", "path_to": "/api/v2"}
+    ]})"));
+
+    auto request = MakeRequest(
+        R"({"url": "http://old.example.com", "path": "/v1/items", "method": "GET", "headers": {"Accept": "*/*"}})");
+    EXPECT_FALSE(pipeline.Before(request));
+
+    EXPECT_EQ(request.Url(), "http://new.example.com");
+    EXPECT_EQ(request.Path(), "/api/v2/items");
+    const auto headers = request.Headers();
+    EXPECT_EQ(headers.size(), 3u);  // Accept is replaced, not added
+    EXPECT_EQ(headers.find("Accept")->second, "application/json");
+    EXPECT_EQ(headers.find("X-Api")->second, "v2");
+    EXPECT_EQ(headers.find("Authorization")->second, "secret");
+}
+
+TEST(PipelineTest, OriginFilter) {
+    const Pipeline pipeline(ParseSingleRoute(R"({"pre": [
+        {"type": "origin_filter", "allow": ["https://api.example.com", "upstream://backend"],
+         "deny": ["http://api.example.com:8080"]}
+    ]})"));
+
+    const auto check = [&pipeline](const std::string& url) {
+        auto request = MakeRequest(R"({"method": "GET", "url": ")" + url + R"("})");
+        return !pipeline.Before(request);
+    };
+    EXPECT_TRUE(check("https://api.example.com"));
+    EXPECT_TRUE(check("https://API.example.com:443"));  // Same origin in canonical form
+    EXPECT_TRUE(check("upstream://backend"));
+    EXPECT_FALSE(check("http://api.example.com:8080"));
+    EXPECT_FALSE(check("https://other.example.com"));
+
+    auto request = MakeRequest(R"({"method": "GET", "url": "https://other.example.com"})");
+    const auto rejection = pipeline.Before(request);
+    ASSERT_TRUE(rejection);
+    EXPECT_EQ(rejection->status, static_cast<int>(ProxyStatus::Denied));
+}
+
+TEST(PipelineTest, FilterHeaders) {
+    const Pipeline pipeline(ParseSingleRoute(R"({"post": [
+        {"type": "filter_headers", "allow": ["content-type", "etag", "set-cookie"], "deny": ["Set-Cookie"]}
+    ]})"));
+
+    auto response = BodyResponse("{}");
+    response.headers.Add("Content-Type", "application/json");
+    response.headers.Add("Server", "nginx");
+    response.headers.Add("Set-Cookie", "a=1");
+    response.headers.Add("ETag", "\"1\"");
+    pipeline.After(response);
+
+    ASSERT_EQ(response.headers.Size(), 2u);
+    EXPECT_EQ(response.headers[0].name, "Content-Type");
+    EXPECT_EQ(response.headers[1].name, "ETag");
+}
+
+TEST(PipelineTest, HeadersDroppedWithoutFilter) {
+    const Pipeline pipeline(RouteConfig{});
+    auto response = BodyResponse("{}");
+    response.headers.Add("Server", "nginx");
+    pipeline.After(response);
+    EXPECT_TRUE(response.headers.Empty());
+}
+
+TEST(PipelineTest, TruncateBody) {
+    const Pipeline pipeline(ParseSingleRoute(R"({"post": [{"type": "truncate_body", "max_bytes": 4}]})"));
+
+    auto ascii = BodyResponse("abcdef");
+    pipeline.After(ascii);
+    EXPECT_EQ(ascii.body, "abcd");
+
+    auto utf8 = BodyResponse("abc\xD0\xB6z");  // Limit falls inside two-byte character
+    pipeline.After(utf8);
+    EXPECT_EQ(utf8.body, "abc");
+
+    auto short_body = BodyResponse("ab");
+    pipeline.After(short_body);
+    EXPECT_EQ(short_body.body, "ab");
+}
+
+struct ProjectTestParam {
+    std::vector<std::string> fields;
+    std::string body;
+    std::string expected;
+};
+
+class ProjectTest : public testing::TestWithParam<ProjectTestParam> {};
+
+TEST_P(ProjectTest, Project) {
+    RouteConfig route;
+    route.post.push_back(ProjectStage{GetParam().fields});
+    const Pipeline pipeline(route);
+
+    auto response = BodyResponse(GetParam().body);
+    pipeline.After(response);
+    EXPECT_EQ(response.body, GetParam().expected);
+}
+
+const std::vector<ProjectTestParam> kProjectTestParams = {
+    {{"id", "name"}, R"({"id": 1, "name": "a", "extra": true})", R"({"id":1,"name":"a"})"},
+    {{"user.name"}, R"({"user": {"name": "a", "age": 3}, "id": 1})", R"({"user":{"name":"a"}})"},
+    {{"items.id"}, R"({"items": [{"id": 1, "x": 0}, {"id": 2}]})", R"({"items":[{"id":1},{"id":2}]})"},
+    {{"id"}, R"([{"id": 1, "x": 0}, {"x": 1}])", R"([{"id":1},null])"},
+    {{"missing", "user.missing"}, R"({"user": {"name": "a"}})", "{}"},
+    {{"id"}, "not json", "not json"},
+    {{"id"}, "42", "42"},
+};
+
+INSTANTIATE_TEST_CASE_P(PipelineTest, ProjectTest, testing::ValuesIn(kProjectTestParams));
+
+TEST(RouteTableTest, LongestPrefix) {
+    const auto config = ParseConfig(R"({"routes": [
+        {"match": "http://example.com", "pre": [{"type": "set_headers", "headers": {"X-Route": "host"}}]},
+        {"match": "http://example.com/api", "pre": [{"type": "set_headers", "headers": {"X-Route": "api"}}]}
+    ]})");
+    const RouteTable routes(config.routes);
+
+    const auto route_of = [&routes](const std::string& url, const std::string& path = "") -> std::string {
+        auto request = MakeRequest(R"({"method": "GET", "url": ")" + url + R"(", "path": ")" + path + R"("})");
+        routes.Match(request.Url(), request.Path()).Before(request);
+        const auto headers = request.Headers();
+        const auto it = headers.find("X-Route");
+        return it == headers.end() ? "" : it->second;
+    };
+    EXPECT_EQ(route_of("http://example.com", "/api/v1"), "api");
+    EXPECT_EQ(route_of("http://example.com"), "host");
+    EXPECT_EQ(route_of("http://other.com"), "");
+}
+
+TEST(RouteTableTest, LookAlikeHosts) {
+    const auto config = ParseConfig(R"({"routes": [
+        {"match": "https://api.example.com", "pre": [{"type": "auth_token", "token": "secret"}]}
+    ]})");
+    const RouteTable routes(config.routes);
+
+    const auto token_of = [&routes](const std::string& url, const std::string& path = "") -> std::string {
+        auto request = MakeRequest(R"({"method": "GET", "url": ")" + url + R"(", "path": ")" + path + R"("})");
+        routes.Match(request.Url(), request.Path()).Before(request);
+        const auto headers = request.Headers();
+        const auto it = headers.find("Authorization");
+        return it == headers.end() ? "" : it->second;
+    };
+    EXPECT_EQ(token_of("https://api.example.com"), "secret");
+    EXPECT_EQ(token_of("https://API.example.com:443", "/v1"), "secret");
+    EXPECT_EQ(token_of("https://api.example.com.attacker.net"), "");
+    EXPECT_EQ(token_of("https://api.example.com@attacker.net"), "");
+    EXPECT_EQ(token_of("https://api.example.com:8443"), "");
+    EXPECT_EQ(token_of("http://api.example.com"), "");
+    EXPECT_EQ(token_of("https://api.example.comx"), "");
+}
+
+TEST(RouteTableTest, PathSegments) {
+    const auto config = ParseConfig(R"({"routes": [
+        {"match": "http://example.com/api", "pre": [{"type": "set_headers", "headers": {"X-Route": "api"}}]},
+        {"match": "upstream://orders/v2", "pre": [{"type": "set_headers", "headers": {"X-Route": "orders"}}]},
+        {"pre": [{"type": "set_headers", "headers": {"X-Route": "any"}}]}
+    ]})");
+    const RouteTable routes(config.routes);
+
+    const auto route_of = [&routes](const std::string& url, const std::string& path = "") -> std::string {
+        auto request = MakeRequest(R"({"method": "GET", "url": ")" + url + R"(", "path": ")" + path + R"("})");
+        routes.Match(request.Url(), request.Path()).Before(request);
+        const auto headers = request.Headers();
+        const auto it = headers.find("X-Route");
+        return it == headers.end() ? "" : it->second;
+    };
+    EXPECT_EQ(route_of("http://example.com", "/api"), "api");
+    EXPECT_EQ(route_of("http://example.com", "/api/v1"), "api");
+    EXPECT_EQ(route_of("http://example.com", "/api?x=1"), "api");
+    EXPECT_EQ(route_of("http://example.com", "/apix"), "any");
+    EXPECT_EQ(route_of("http://example.com", "/ap"), "any");
+    EXPECT_EQ(route_of("http://example.com"), "any");
+    EXPECT_EQ(route_of("upstream://orders", "/v2/items"), "orders");
+    EXPECT_EQ(route_of("upstream://orders", "/v20"), "any");
+    EXPECT_EQ(route_of("upstream://orders-eu", "/v2"), "any");
+}
+
+TEST(RouteTableTest, ParseConfigErrors) {
+    EXPECT_THROW(ParseConfig(R"({"routes": [{"pre": [{"type": "unknown"}]}]})"), std::exception);
+    EXPECT_THROW(ParseConfig(R"({"routes": [{"post": [{"type": "set_headers", "headers": {}}]}]})"), std::exception);
+    EXPECT_THROW(ParseConfig(R"({"routes": [{"pre": [{"type": "auth_token"}]}]})"), std::exception);
+    EXPECT_THROW(ParseConfig(R"({"routes": [{"post": [{"type": "project", "fields": []}]}]})"), std::exception);
+}
+
+TEST(RouteTableTest, AuthTokenFromMissingEnvironment) {
+    const auto config =
+        ParseConfig(R"({"routes": [{"pre": [{"type": "auth_token", "token_env": "WEBSOCKPROXY_TEST_UNSET"}]}]})");
+    EXPECT_THROW(RouteTable{config.routes}, std::exception);
+}
+
+TEST(ResponseWriterTest, Headers) {
+    Response response{200, "ok"};
+    EXPECT_EQ(WriteResponseJson(response), R"({"body":"ok","status":200})");
+
+    response.headers.Add("Content-Type", "text/plain");
+    response.headers.Add("Vary", "Accept");
+    response.headers.Add("Vary", "Origin");
+    EXPECT_EQ(WriteResponseJson(response),
+              R"({"body":"ok","headers":{"Content-Type":"text/plain","Vary":"Accept, Origin"},"status":200})");
+}
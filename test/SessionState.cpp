@@ -0,0 +1,244 @@
+#include "Config.h"
+#include "Dispatcher.h"
+#include "Session.h"
+#include "Upstream.h"
+
+#include <gtest/gtest.h>
+
+////////////////////////////////////////////////
+// Config
+
+TEST(ConfigTest, ParseSessions) {
+    const auto config = ParseConfig(R"({
+        "sessions": {"enabled": true, "max_cookies": 10, "max_cookie_bytes": 8192, "max_pinned": 2}
+    })");
+    EXPECT_TRUE(config.sessions.enabled);
+    EXPECT_EQ(config.sessions.max_cookies, 10u);
+    EXPECT_EQ(config.sessions.max_cookie_bytes, 8192u);
+    EXPECT_EQ(config.sessions.max_pinned, 2u);
+
+    EXPECT_FALSE(ParseConfig("{}").sessions.enabled);
+    EXPECT_THROW(ParseConfig(R"({"sessions": {"max_cookie_bytes": 100}})"), std::exception);
+}
+
+////////////////////////////////////////////////
+// Cookies
+
+namespace {
+
+HeaderList SetCookies(std::initializer_list<const char*> values) {
+    HeaderList headers;
+    for (const auto* value : values)
+        headers.Add("Set-Cookie", value);
+    return headers;
+}
+
+SessionConfig EnabledSessions() {
+    SessionConfig config;
+    config.enabled = true;
+    return config;
+}
+
+}  // namespace
+
+TEST(SessionTest, CookiesSentBack) {
+    Session session(EnabledSessions());
+    session.StoreCookies("http://api.example.com", "/account/login",
+                         SetCookies({"sid=abc; Path=/; HttpOnly", "lang=en"}));
+    EXPECT_EQ(session.Cookies(), 2u);
+
+    EXPECT_EQ(session.CookieHeader("http://api.example.com", "/orders"), "sid=abc");
+    // Default path is the directory of the request path
+    EXPECT_EQ(session.CookieHeader("http://api.example.com", "/account/settings?tab=1"), "lang=en; sid=abc");
+    EXPECT_EQ(session.CookieHeader("http://other.example.com", "/"), "");
+    // Host-only cookie isn't sent to subdomains
+    EXPECT_EQ(session.CookieHeader("http://eu.api.example.com", "/"), "");
+}
+
+TEST(SessionTest, DomainAndPath) {
+    Session session(EnabledSessions());
+    session.StoreCookies("https://www.example.com", "/", SetCookies({
+        "wide=1; Domain=.Example.com; Path=/",
+        "deep=2; Path=/shop/cart",
+        "foreign=3; Domain=example.org",
+        "suffix=4; Domain=ample.com",
+    }));
+    EXPECT_EQ(session.Cookies(), 2u);
+
+    EXPECT_EQ(session.CookieHeader("https://img.example.com", "/shop/cart"), "wide=1");
+    EXPECT_EQ(session.CookieHeader("https://www.example.com", "/shop/cart/items"), "deep=2; wide=1");
+    EXPECT_EQ(session.CookieHeader("https://www.example.com", "/shop/carts"), "wide=1");
+}
+
+TEST(SessionTest, TopLevelDomain) {
+    Session session(EnabledSessions());
+    session.StoreCookies("https://www.example.com", "/",
+                         SetCookies({"tld=1; Domain=com; Path=/", "dot=2; Domain=.COM"}));
+    EXPECT_EQ(session.Cookies(), 2u);
+
+    // Kept for the host alone
+    EXPECT_EQ(session.CookieHeader("https://www.example.com", "/"), "tld=1; dot=2");
+    EXPECT_EQ(session.CookieHeader("https://other.com", "/"), "");
+    EXPECT_EQ(session.CookieHeader("https://img.www.example.com", "/"), "");
+
+    session.StoreCookies("http://localhost", "/", SetCookies({"local=3; Domain=localhost"}));
+    EXPECT_EQ(session.CookieHeader("http://localhost", "/"), "local=3");
+}
+
+TEST(SessionTest, SecureCookies) {
+    Session session(EnabledSessions());
+    session.StoreCookies("https://example.com", "/", SetCookies({"token=t; Secure; Path=/"}));
+    EXPECT_EQ(session.CookieHeader("https://example.com", "/"), "token=t");
+    EXPECT_EQ(session.CookieHeader("http://example.com", "/"), "");
+}
+
+TEST(SessionTest, ReplacedAndDeleted) {
+    Session session(EnabledSessions());
+    session.StoreCookies("http://example.com", "/", SetCookies({"sid=old; Path=/"}));
+    session.StoreCookies("http://example.com", "/", SetCookies({"sid=new; Path=/"}));
+    EXPECT_EQ(session.CookieHeader("http://example.com", "/"), "sid=new");
+
+    session.StoreCookies("http://example.com", "/", SetCookies({"sid=; Path=/; Max-Age=0"}));
+    EXPECT_EQ(session.Cookies(), 0u);
+    EXPECT_EQ(session.CookieHeader("http://example.com", "/"), "");
+}
+
+TEST(SessionTest, Expiry) {
+    // Sun, 06 Nov 1994 08:49:37 GMT
+    auto now = Session::Clock::time_point(std::chrono::seconds(784111777));
+    Session session(EnabledSessions(), [&now] { return now; });
+
+    session.StoreCookies("http://example.com", "/", SetCookies({
+        "short=1; Path=/; Max-Age=60",
+        "dated=2; Path=/; Expires=Sun, 06 Nov 1994 09:49:37 GMT",
+        "both=3; Path=/; Expires=Sun, 06 Nov 1994 09:49:37 GMT; Max-Age=10",
+        "past=4; Path=/; Expires=Sat, 05 Nov 1994 08:49:37 GMT",
+        "session=5; Path=/",
+    }));
+    EXPECT_EQ(session.Cookies(), 4u);
+
+    now += std::chrono::seconds(30);
+    EXPECT_EQ(session.CookieHeader("http://example.com", "/"), "short=1; dated=2; session=5");
+    now += std::chrono::seconds(60);
+    EXPECT_EQ(session.CookieHeader("http://example.com", "/"), "dated=2; session=5");
+    now += std::chrono::hours(1);
+    EXPECT_EQ(session.CookieHeader("http://example.com", "/"), "session=5");
+}
+
+TEST(SessionTest, CookieLimits) {
+    auto config = EnabledSessions();
+    config.max_cookies = 3;
+    config.max_cookie_bytes = 4096;
+    Session session(config);
+
+    for (int i = 0; i < 5; ++i) {
+        const auto cookie = "c" + std::to_string(i) + "=v; Path=/";
+        session.StoreCookies("http://example.com", "/", SetCookies({cookie.c_str()}));
+    }
+    EXPECT_EQ(session.CookieHeader("http://example.com", "/"), "c2=v; c3=v; c4=v");
+
+    const auto big = "big=" + std::string(4092, 'x') + "; Path=/";
+    session.StoreCookies("http://example.com", "/", SetCookies({big.c_str()}));
+    EXPECT_EQ(session.Cookies(), 1u);
+
+    const auto huge = "huge=" + std::string(5000, 'x');
+    session.StoreCookies("http://example.com", "/", SetCookies({huge.c_str()}));
+    EXPECT_EQ(session.Cookies(), 1u);
+}
+
+TEST(SessionTest, MalformedSetCookie) {
+    Session session(EnabledSessions());
+    session.StoreCookies("http://example.com", "/", SetCookies({"", "novalue", "=x", ";;;", "a=b; Max-Age=soon"}));
+    EXPECT_EQ(session.CookieHeader("http://example.com", "/"), "a=b");
+}
+
+////////////////////////////////////////////////
+// Pinned connections
+
+TEST(SessionTest, PinnedConnections) {
+    auto config = EnabledSessions();
+    config.max_pinned = 2;
+    Session session(config);
+
+    EXPECT_FALSE(session.TakeConnection("http://a:80"));
+    EXPECT_FALSE(session.PinConnection("http://a:80", {"10.0.0.1", nullptr}));
+    EXPECT_FALSE(session.PinConnection("http://b:80", {"10.0.0.2", nullptr}));
+
+    // Already pinned origin keeps its connection
+    auto rejected = session.PinConnection("http://a:80", {"10.0.0.9", nullptr});
+    ASSERT_TRUE(rejected);
+    EXPECT_EQ(rejected->second.address, "10.0.0.9");
+
+    // Least recently used one is displaced
+    auto taken = session.TakeConnection("http://a:80");
+    ASSERT_TRUE(taken);
+    EXPECT_EQ(taken->address, "10.0.0.1");
+    EXPECT_FALSE(session.PinConnection("http://a:80", std::move(*taken)));
+    auto displaced = session.PinConnection("http://c:80", {"10.0.0.3", nullptr});
+    ASSERT_TRUE(displaced);
+    EXPECT_EQ(displaced->first, "http://b:80");
+    EXPECT_EQ(session.PinnedConnections(), 2u);
+
+    auto released = session.Close();
+    EXPECT_EQ(released.size(), 2u);
+    EXPECT_EQ(session.PinnedConnections(), 0u);
+    // Calls finishing after close don't pin
+    EXPECT_TRUE(session.PinConnection("http://a:80", {"10.0.0.1", nullptr}));
+}
+
+TEST(SessionTest, NoPinnedConnections) {
+    auto config = EnabledSessions();
+    config.max_pinned = 0;
+    Session session(config);
+    EXPECT_TRUE(session.PinConnection("http://a:80", {"10.0.0.1", nullptr}));
+}
+
+////////////////////////////////////////////////
+// Backend affinity
+
+TEST(SessionTest, PreferredBackend) {
+    UpstreamConfig upstream;
+    upstream.name = "orders";
+    upstream.policy = BalancePolicy::LeastOutstanding;
+    upstream.backends = {"http://10.0.0.1", "http://10.0.0.2"};
+    upstream.outlier_detection.consecutive_failures = 1;
+    upstream.outlier_detection.max_ejection_percent = 50;
+    auto now = UpstreamGroup::Clock::now();
+    UpstreamGroup group(upstream, [&now] { return now; });
+
+    // Busy backend is still preferred
+    auto busy = group.Pick();
+    ASSERT_TRUE(busy);
+    const auto preferred = busy->Url();
+    auto lease = group.PickPreferred(preferred);
+    ASSERT_TRUE(lease);
+    EXPECT_EQ(lease->Url(), preferred);
+    lease.reset();
+
+    // Ejected one isn't
+    auto& backend = preferred == group.Backends()[0]->Url() ? *group.Backends()[0] : *group.Backends()[1];
+    group.ReportOutcome(backend, true);
+    auto other = group.PickPreferred(preferred);
+    ASSERT_TRUE(other);
+    EXPECT_NE(other->Url(), preferred);
+
+    EXPECT_TRUE(group.PickPreferred("http://10.0.0.3"));
+}
+
+TEST(SessionTest, UpstreamGroupRequest) {
+    // Nothing listens on port 1, so the call fails fast
+    const auto config = ParseConfig(R"({
+        "sessions": {"enabled": true},
+        "upstreams": {"orders": {"backends": ["http://127.0.0.1:1"]}}
+    })");
+    MetricsRegistry metrics;
+    Dispatcher dispatcher(config, metrics);
+    Session session(config.sessions);
+
+    // Jar is keyed by the backend called, not by the group's url
+    Response response;
+    ASSERT_NO_THROW(response = dispatcher.Dispatch(GetRequest("upstream://orders", "/", {}), &session));
+    EXPECT_LT(response.status, 100);
+    EXPECT_EQ(session.Backend("orders"), "http://127.0.0.1:1");
+    dispatcher.EndSession(session);
+}
@@ -0,0 +1,172 @@
+#include "Config.h"
+#include "Requests.h"
+#include "ResponseWriter.h"
+#include "Trace.h"
+#include "TraceExporter.h"
+
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+#include <thread>
+
+namespace {
+
+constexpr char kTraceparent[] = "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01";
+
+// Keeps batches in memory, the vector is read once exporter is gone
+class MemorySpanSink final : public SpanSink {
+public:
+    explicit MemorySpanSink(std::vector<std::string>& batches) : batches_(batches) {}
+
+    void Write(const std::string& batch) override {
+        batches_.push_back(batch);
+    }
+
+private:
+    std::vector<std::string>& batches_;
+};
+
+std::shared_ptr<Trace> FinishedTrace() {
+    auto trace = std::make_shared<Trace>();
+    trace->Adopt(kTraceparent);
+    trace->Describe("GET", "http://backend.example.com");
+    trace->Mark(TraceStage::Parsed);
+    trace->Mark(TraceStage::Complete);
+    trace->SetStatus(200);
+    return trace;
+}
+
+}  // namespace
+
+TEST(TraceTest, ParseTraceparent) {
+    const auto parent = ParseTraceparent(kTraceparent);
+    ASSERT_TRUE(parent);
+    EXPECT_EQ(parent->trace_id, "4bf92f3577b34da6a3ce929d0e0e4736");
+    EXPECT_EQ(parent->span_id, "00f067aa0ba902b7");
+    EXPECT_EQ(parent->flags, 1);
+
+    // Later versions may carry more fields
+    EXPECT_TRUE(ParseTraceparent("01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00-extra"));
+
+    EXPECT_FALSE(ParseTraceparent(""));
+    EXPECT_FALSE(ParseTraceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-extra"));
+    EXPECT_FALSE(ParseTraceparent("ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"));
+    EXPECT_FALSE(ParseTraceparent("00-4BF92F3577B34DA6A3CE929D0E0E4736-00f067aa0ba902b7-01"));
+    EXPECT_FALSE(ParseTraceparent("00-00000000000000000000000000000000-00f067aa0ba902b7-01"));
+    EXPECT_FALSE(ParseTraceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000000000-01"));
+    EXPECT_FALSE(ParseTraceparent("00_4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"));
+}
+
+TEST(TraceTest, AdoptCallerTrace) {
+    Trace trace;
+    EXPECT_EQ(trace.TraceId().size(), 32u);
+    EXPECT_TRUE(trace.ParentSpanId().empty());
+    EXPECT_TRUE(ParseTraceparent(trace.Traceparent()));
+
+    trace.Adopt("garbage");
+    EXPECT_TRUE(trace.ParentSpanId().empty());
+
+    trace.Adopt(kTraceparent);
+    EXPECT_EQ(trace.TraceId(), "4bf92f3577b34da6a3ce929d0e0e4736");
+    EXPECT_EQ(trace.ParentSpanId(), "00f067aa0ba902b7");
+    // Upstream sees this proxy's span as its parent
+    const auto upstream = ParseTraceparent(trace.Traceparent());
+    ASSERT_TRUE(upstream);
+    EXPECT_EQ(upstream->trace_id, trace.TraceId());
+    EXPECT_EQ(upstream->span_id, trace.SpanId());
+    EXPECT_NE(upstream->span_id, "00f067aa0ba902b7");
+}
+
+TEST(TraceTest, MarkStages) {
+    Trace trace;
+    EXPECT_EQ(trace.Elapsed(TraceStage::Received), std::chrono::microseconds(0));
+    EXPECT_FALSE(trace.Elapsed(TraceStage::Connected));
+
+    Trace::MarkCurrent(TraceStage::Connected);  // No current trace
+    EXPECT_FALSE(trace.Elapsed(TraceStage::Connected));
+    {
+        TraceScope scope(&trace);
+        EXPECT_EQ(Trace::Current(), &trace);
+        std::thread([&trace] {
+            EXPECT_EQ(Trace::Current(), nullptr);  // Current per thread
+            TraceScope inner(&trace);
+            Trace::MarkCurrent(TraceStage::FirstByte);
+        }).join();
+        Trace::MarkCurrent(TraceStage::Connected);
+    }
+    EXPECT_EQ(Trace::Current(), nullptr);
+    EXPECT_TRUE(trace.Elapsed(TraceStage::Connected));
+    EXPECT_TRUE(trace.Elapsed(TraceStage::FirstByte));
+}
+
+TEST(TraceTest, TraceparentField) {
+    const auto request = MakeRequest(std::string(R"({"url": "http://backend.example.com", "method": "GET",
+        "headers": {"traceparent": "00-11111111111111111111111111111111-2222222222222222-01"},
+        "traceparent": ")") + kTraceparent + R"("})");
+    const auto* header = request.HeaderFields().Find(HeaderId::Traceparent);
+    ASSERT_TRUE(header);
+    EXPECT_EQ(header->value, kTraceparent);
+    EXPECT_EQ(request.Headers().size(), 1u);
+}
+
+TEST(TraceTest, TimingBlock) {
+    const auto trace = FinishedTrace();
+    const auto json = nlohmann::json::parse(WriteResponseJson(Response{200, "ok"}, trace.get()));
+    EXPECT_EQ(json["status"], 200);
+    const auto& timing = json["timing"];
+    EXPECT_EQ(timing["trace_id"], "4bf92f3577b34da6a3ce929d0e0e4736");
+    EXPECT_EQ(timing["received"], 0);
+    EXPECT_TRUE(timing.contains("parsed"));
+    EXPECT_TRUE(timing.contains("complete"));
+    EXPECT_FALSE(timing.contains("connected"));
+
+    EXPECT_FALSE(nlohmann::json::parse(WriteResponseJson(Response{200, "ok"})).contains("timing"));
+}
+
+TEST(TraceTest, SerializeSpans) {
+    const auto json = nlohmann::json::parse(SerializeSpans({FinishedTrace()}, "proxy-test"));
+    const auto& resource_spans = json.at("resourceSpans").at(0);
+    EXPECT_EQ(resource_spans["resource"]["attributes"][0]["value"]["stringValue"], "proxy-test");
+
+    const auto& spans = resource_spans.at("scopeSpans").at(0).at("spans");
+    ASSERT_EQ(spans.size(), 3u);  // Whole message, parsed, complete
+    const auto& root = spans[0];
+    EXPECT_EQ(root["traceId"], "4bf92f3577b34da6a3ce929d0e0e4736");
+    EXPECT_EQ(root["parentSpanId"], "00f067aa0ba902b7");
+    EXPECT_EQ(root["name"], "proxy GET");
+    EXPECT_EQ(spans[1]["name"], "parsed");
+    EXPECT_EQ(spans[1]["parentSpanId"], root["spanId"]);
+    EXPECT_EQ(spans[2]["name"], "complete");
+    EXPECT_EQ(spans[2]["endTimeUnixNano"], root["endTimeUnixNano"]);
+}
+
+TEST(TraceTest, ExportBatches) {
+    TracingConfig config;
+    config.max_queued = 2;
+    config.flush_interval = std::chrono::hours(1);
+    std::vector<std::string> batches;
+    {
+        TraceExporter exporter(std::make_unique<MemorySpanSink>(batches), config);
+        for (int i = 0; i < 3; ++i)
+            exporter.Export(FinishedTrace());
+        EXPECT_EQ(exporter.Dropped(), 1u);
+    }
+
+    // Queued ones are flushed on destruction, in one batch
+    ASSERT_EQ(batches.size(), 1u);
+    const auto json = nlohmann::json::parse(batches[0]);
+    EXPECT_EQ(json["resourceSpans"][0]["scopeSpans"][0]["spans"].size(), 6u);
+}
+
+TEST(TraceTest, ParseConfig) {
+    const auto config = ParseConfig(R"({"tracing": {"enabled": true, "timing": true, "exporter": "OTLP",
+        "otlp_endpoint": "http://collector:4318/v1/traces", "flush_interval_ms": 200}})");
+    EXPECT_TRUE(config.tracing.enabled);
+    EXPECT_TRUE(config.tracing.timing);
+    EXPECT_EQ(config.tracing.exporter, TraceExporterType::Otlp);
+    EXPECT_EQ(config.tracing.otlp_endpoint, "http://collector:4318/v1/traces");
+    EXPECT_EQ(config.tracing.flush_interval, std::chrono::milliseconds(200));
+
+    EXPECT_FALSE(ParseConfig("{}").tracing.enabled);
+    EXPECT_THROW(ParseConfig(R"({"tracing": {"exporter": "zipkin"}})"), std::exception);
+}
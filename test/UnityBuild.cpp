@@ -1,5 +1,29 @@
-// This file is a "UnityBuild" pattern to provide test project with appropriate obj files.
+﻿// This file is a "UnityBuild" pattern to provide test project with appropriate obj files.
 // All classes' implementations from project under testing participating in unit-tests should be added here (and only here)
 
+#include "AdminReport.cpp"
+#include "Arena.cpp"
+#include "CircuitBreaker.cpp"
+#include "Config.cpp"
+#include "ConnectionPool.cpp"
+#include "Dispatcher.cpp"
+#include "DiskCache.cpp"
+#include "HappyEyeballs.cpp"
+#include "HeaderList.cpp"
 #include "HttpClient.cpp"
+#include "LatencyHistogram.cpp"
+#include "MappedFile.cpp"
+#include "Metrics.cpp"
+#include "Origin.cpp"
+#include "OriginMatcher.cpp"
+#include "Pipeline.cpp"
 #include "Requests.cpp"
+#include "ResolverCache.cpp"
+#include "ResponseWriter.cpp"
+#include "Retry.cpp"
+#include "SendQueue.cpp"
+#include "Session.cpp"
+#include "SubscriptionHub.cpp"
+#include "Trace.cpp"
+#include "TraceExporter.cpp"
+#include "Upstream.cpp"
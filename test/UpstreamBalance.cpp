@@ -0,0 +1,163 @@
+#include "Config.h"
+#include "Upstream.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+
+////////////////////////////////////////////////
+// Config
+
+TEST(ConfigTest, ParseUpstreams) {
+    const auto config = ParseConfig(R"({
+        "upstreams": {
+            "orders": {
+                "backends": ["http://10.0.0.1:8080", "http://10.0.0.2:8080"],
+                "policy": "least_outstanding",
+                "health_check": {"path": "/ping", "interval_ms": 200},
+                "outlier_detection": {"consecutive_failures": 3, "base_ejection_ms": 100}
+            },
+            "users": {
+                "backends": ["http://10.0.1.1"]
+            }
+        }
+    })");
+
+    ASSERT_EQ(config.upstreams.size(), 2u);
+    const auto& orders = config.upstreams[0];
+    EXPECT_EQ(orders.name, "orders");
+    EXPECT_EQ(orders.backends.size(), 2u);
+    EXPECT_EQ(orders.policy, BalancePolicy::LeastOutstanding);
+    ASSERT_TRUE(orders.health_check);
+    EXPECT_EQ(orders.health_check->path, "/ping");
+    EXPECT_EQ(orders.health_check->interval, std::chrono::milliseconds(200));
+    EXPECT_EQ(orders.outlier_detection.consecutive_failures, 3);
+    EXPECT_EQ(orders.outlier_detection.base_ejection, std::chrono::milliseconds(100));
+
+    const auto& users = config.upstreams[1];
+    EXPECT_EQ(users.policy, BalancePolicy::PowerOfTwoChoices);
+    EXPECT_FALSE(users.health_check);
+}
+
+TEST(ConfigTest, InvalidUpstreams) {
+    EXPECT_THROW(ParseConfig(R"({"upstreams": {"orders": {}}})"), std::exception);
+    EXPECT_THROW(ParseConfig(R"({"upstreams": {"orders": {"backends": []}}})"), std::exception);
+    EXPECT_THROW(ParseConfig(R"({"upstreams": {"orders": {"backends": ["http://a"], "policy": "random"}}})"),
+                 std::exception);
+}
+
+////////////////////////////////////////////////
+// UpstreamGroup
+
+namespace {
+
+UpstreamConfig MakeUpstream(BalancePolicy policy, size_t backends) {
+    UpstreamConfig upstream;
+    upstream.name = "orders";
+    upstream.policy = policy;
+    for (size_t i = 0; i < backends; ++i)
+        upstream.backends.push_back("http://10.0.0." + std::to_string(i + 1));
+    upstream.outlier_detection.consecutive_failures = 3;
+    upstream.outlier_detection.base_ejection = std::chrono::seconds(1);
+    upstream.outlier_detection.max_ejection_percent = 50;
+    return upstream;
+}
+
+}  // namespace
+
+TEST(UpstreamTest, UpstreamName) {
+    EXPECT_EQ(UpstreamName("upstream://orders"), "orders");
+    EXPECT_FALSE(UpstreamName("http://orders"));
+}
+
+TEST(UpstreamTest, LeastOutstanding) {
+    UpstreamGroup group(MakeUpstream(BalancePolicy::LeastOutstanding, 3));
+
+    auto first = group.Pick();
+    auto second = group.Pick();
+    auto third = group.Pick();
+    ASSERT_TRUE(first && second && third);
+    EXPECT_NE(first->Url(), second->Url());
+    EXPECT_NE(first->Url(), third->Url());
+    EXPECT_NE(second->Url(), third->Url());
+
+    const auto freed = second->Url();
+    second.reset();
+    auto fourth = group.Pick();
+    ASSERT_TRUE(fourth);
+    EXPECT_EQ(fourth->Url(), freed);
+}
+
+TEST(UpstreamTest, PowerOfTwoChoicesAvoidsBusyBackend) {
+    UpstreamGroup group(MakeUpstream(BalancePolicy::PowerOfTwoChoices, 2));
+
+    auto busy = group.Pick();
+    ASSERT_TRUE(busy);
+    for (int i = 0; i < 20; ++i) {
+        auto lease = group.Pick();
+        ASSERT_TRUE(lease);
+        EXPECT_NE(lease->Url(), busy->Url());
+    }
+}
+
+TEST(UpstreamTest, OutlierEjection) {
+    auto now = UpstreamGroup::Clock::now();
+    UpstreamGroup group(MakeUpstream(BalancePolicy::PowerOfTwoChoices, 2), [&now] { return now; });
+    auto& bad = *group.Backends()[0];
+
+    for (int i = 0; i < 3; ++i)
+        group.ReportOutcome(bad, true);
+    EXPECT_TRUE(bad.IsEjected(now));
+
+    for (int i = 0; i < 50; ++i) {
+        auto lease = group.Pick();
+        ASSERT_TRUE(lease);
+        EXPECT_NE(lease->Url(), bad.Url());
+    }
+
+    now += std::chrono::milliseconds(1001);
+    EXPECT_FALSE(bad.IsEjected(now));
+}
+
+TEST(UpstreamTest, PassiveFailuresFromResponses) {
+    auto now = UpstreamGroup::Clock::now();
+    UpstreamGroup group(MakeUpstream(BalancePolicy::LeastOutstanding, 2), [&now] { return now; });
+    auto& backend = *group.Backends()[0];
+
+    group.ReportOutcome(backend, IsUpstreamFailure(503));
+    group.ReportOutcome(backend, IsUpstreamFailure(2));  // httplib::Error::Connection
+    group.ReportOutcome(backend, IsUpstreamFailure(404));
+    group.ReportOutcome(backend, IsUpstreamFailure(500));
+    EXPECT_FALSE(backend.IsEjected(now));
+}
+
+TEST(UpstreamTest, MaxEjectionPercent) {
+    auto now = UpstreamGroup::Clock::now();
+    UpstreamGroup group(MakeUpstream(BalancePolicy::LeastOutstanding, 2), [&now] { return now; });
+    auto& first = *group.Backends()[0];
+    auto& second = *group.Backends()[1];
+
+    for (int i = 0; i < 3; ++i) {
+        group.ReportOutcome(first, true);
+        group.ReportOutcome(second, true);
+    }
+    EXPECT_TRUE(first.IsEjected(now));
+    EXPECT_FALSE(second.IsEjected(now));
+}
+
+TEST(UpstreamTest, EjectionTimeGrows) {
+    auto now = UpstreamGroup::Clock::now();
+    UpstreamGroup group(MakeUpstream(BalancePolicy::LeastOutstanding, 2), [&now] { return now; });
+    auto& backend = *group.Backends()[0];
+
+    for (int i = 0; i < 3; ++i)
+        group.ReportOutcome(backend, true);
+    now += std::chrono::milliseconds(1001);
+    for (int i = 0; i < 3; ++i)
+        group.ReportOutcome(backend, true);
+
+    now += std::chrono::milliseconds(1001);
+    EXPECT_TRUE(backend.IsEjected(now));
+    now += std::chrono::milliseconds(1000);
+    EXPECT_FALSE(backend.IsEjected(now));
+}